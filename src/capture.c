@@ -0,0 +1,147 @@
+/*
+ * capture.c	Buffered writer for the capture file.
+ *
+ *		The terminal emulation hands the capture text over one
+ *		character at a time. Instead of a write() for every one
+ *		of them, it is collected here and written out when the
+ *		buffer is full, when the oldest byte in it has waited
+ *		cap_latency milliseconds, at the end of a line if the
+ *		user wants that, and when the capture file is closed.
+ *		So "tail -f" on the capture file still follows along.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "port.h"
+#include "minicom.h"
+
+size_t cap_bufsize = 64 * 1024;	/* -O capbuf=KB */
+int cap_latency = 100;		/* -O capdelay=ms */
+int cap_lineflush;		/* -O capflush=line */
+
+static char *cap_buf;
+static size_t cap_len;
+static size_t cap_size;
+static int cap_timer = -1;
+
+static void cap_due(int id, void *data)
+{
+  (void)id;
+  (void)data;
+  cap_timer = -1;
+  cap_flush();
+}
+
+static void cap_out(const char *s, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fileno(capfp), s, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    mc_stats.cap_bytes += n;
+    mc_stats.cap_writes++;
+    s += n;
+    len -= n;
+  }
+}
+
+/*
+ * Write out whatever is buffered.
+ */
+void cap_flush(void)
+{
+  if (cap_len == 0)
+    return;
+  /* Nothing goes through the stdio buffer, but be safe. */
+  fflush(capfp);
+  cap_out(cap_buf, cap_len);
+  cap_len = 0;
+}
+
+/*
+ * Add len bytes to the capture file.
+ */
+void cap_write(const char *s, size_t len)
+{
+  int eol;
+  size_t n;
+
+  if (capfp == NULL || len == 0)
+    return;
+  if (cap_size != cap_bufsize) {
+    char *p;
+
+    cap_flush();
+    if ((p = realloc(cap_buf, cap_bufsize)) == NULL) {
+      /* No buffer: write it out right away. */
+      cap_out(s, len);
+      return;
+    }
+    cap_buf = p;
+    cap_size = cap_bufsize;
+  }
+
+  eol = cap_lineflush && memchr(s, '\n', len) != NULL;
+  while (len > 0) {
+    n = cap_size - cap_len;
+    if (n > len)
+      n = len;
+    memcpy(cap_buf + cap_len, s, n);
+    cap_len += n;
+    s += n;
+    len -= n;
+    if (cap_len == cap_size)
+      cap_flush();
+  }
+
+  if (cap_len == 0)
+    return;
+  if (eol || cap_latency <= 0)
+    cap_flush();
+  else if (cap_timer < 0 &&
+           (cap_timer = ev_timer_add(cap_latency, 0, cap_due, NULL)) < 0)
+    cap_flush();
+}
+
+void cap_putc(int c)
+{
+  char ch = c;
+
+  cap_write(&ch, 1);
+}
+
+void cap_puts(const char *s)
+{
+  cap_write(s, strlen(s));
+}
+
+/*
+ * Flush and close the capture file.
+ */
+void cap_close(void)
+{
+  if (capfp == NULL)
+    return;
+  cap_flush();
+  fclose(capfp);
+  capfp = NULL;
+  if (cap_timer >= 0) {
+    ev_timer_del(cap_timer);
+    cap_timer = -1;
+  }
+}
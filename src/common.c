@@ -56,7 +56,8 @@ void do_log(const char *line, ...)
 {
 #ifdef LOGFILE
 /* Write a line to the log file.   jl 22.06.97 */
-  FILE *logfile;
+  static FILE *logfile;
+  static char logopen[FILENAME_MAX];	/* name logfile was opened as */
   char *logname = pfix_home(logfname);
   struct tm *ptr;
   time_t    ttime;
@@ -64,9 +65,21 @@ void do_log(const char *line, ...)
 
   if (logfname[0] == 0)
     return;
-  logfile = fopen(logname,"a");
-  if (!logfile)
-    return;
+
+  /* Keep the file open; reopen only when the name changes. */
+  if (logfile && strcmp(logname, logopen)) {
+    fclose(logfile);
+    logfile = NULL;
+  }
+  if (!logfile) {
+    logfile = fopen(logname,"a");
+    if (!logfile)
+      return;
+    fcntl(fileno(logfile), F_SETFD, FD_CLOEXEC);
+    /* One write per line, and the line is in the file right away. */
+    setvbuf(logfile, NULL, _IOLBF, BUFSIZ);
+    snprintf(logopen, sizeof(logopen), "%s", logname);
+  }
 
   va_start(ap, line);
   ttime = time(NULL);
@@ -78,7 +91,6 @@ void do_log(const char *line, ...)
   vfprintf(logfile, line, ap);
   va_end(ap);
   fprintf(logfile, "\n");
-  fclose(logfile);
 #else
   /* dummy, don't do anything */
   (void)line;
@@ -1172,13 +1172,13 @@ static void doscrkeyb(void)
               P_HISTSIZE, 6, 6, 0);
 
         /* In case gibberish or a value was out of bounds, */
-        /* limit history buffer size between 0 to 5000 lines */
-        /* 5000 line history at 80 columns consumes about */
-        /* 800 kilobytes including chars and attrs bytes! */
+        /* limit history buffer size between 0 and 999999 lines. */
+        /* The history is kept compressed (history.c), a line */
+        /* takes about as many bytes as it has characters. */
         if (atoi(P_HISTSIZE) <= 0) 
           strcpy(P_HISTSIZE,"0");
-        else if (atoi(P_HISTSIZE) >= 5000)
-          strcpy(P_HISTSIZE,"5000");
+        else if (atoi(P_HISTSIZE) >= 999999)
+          strcpy(P_HISTSIZE,"999999");
 
         mc_wlocate(w, mbswidth(history_buffer_size) + 1, 10);
         mc_wprintf(w, "%s     ", P_HISTSIZE);
@@ -1925,7 +1925,10 @@ void doconv(void)
           werror(_("Input character ascii value 0-255"));
           break;
         }
-        else vt_inmap[i] = j;
+        else {
+          vt_inmap[i] = j;
+          vt_inmap_changed();
+        }
         sprintf(buf, "%u",(unsigned int) vt_outmap[i]);
         mc_wlocate(w, 54, ymax - 1);
         prompt = _("Change output to: %s");
@@ -1976,6 +1979,7 @@ int loadconv(char *buf)
       werror(_("Cannot read conversion table %s"), pfix_home(buf));
       err = 1;
     }
+  vt_inmap_changed();
 
   fclose(fp);
   return err;
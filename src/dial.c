@@ -186,6 +186,7 @@ void mputs(const char *s, int how)
       if (*s == '^')
         c = *s;
       else if (how == 1 && *s == '~') {
+        tx_flush();
         sleep(1);
         s++;
         continue;
@@ -208,6 +209,7 @@ void mputs(const char *s, int how)
           s++;
           continue;
         case 'B': /* line speed change. */
+          tx_flush();
           s = change_baud(++s);
           continue;
         case 'L': /* toggle linefeed addition */
@@ -219,6 +221,7 @@ void mputs(const char *s, int how)
           s++; /* again, move along. */
           continue;
 	case 'G': /* run a script */
+	  tx_flush();
 	  runscript(0, s + 1, "", "");
 	  return;
         default:
@@ -227,13 +230,14 @@ void mputs(const char *s, int how)
       }
     } else
       c = *s;
-    if (how == 0 && c == '~')
+    if (how == 0 && c == '~') {
+      tx_flush();
       sleep(1);
-    else
-      if (write(portfd, &c, 1) != 1)
-        break;
+    } else
+      tx_put(&c, 1, 0);
     s++;
   }
+  tx_flush();
 }
 
 /*
@@ -246,10 +250,11 @@ void modeminit(void)
   if (P_MINIT[0] == '\0')
     return;
 
-  w = mc_tell(_("Initializing Modem"));
+  w = headless ? NULL : mc_tell(_("Initializing Modem"));
   m_dtrtoggle(portfd, 1);         /* jl 23.06.97 */
   mputs(P_MINIT, 0);
-  mc_wclose(w, 1);
+  if (w)
+    mc_wclose(w, 1);
 }
 
 /*
@@ -430,6 +435,8 @@ long dial(struct dialent *d, struct dialent **d2)
   /*  char logline[128]; */
 
   timer_update(); /* Statusline may still show 'Online' / jl 16.08.97 */
+  /* The modem answers on the port: we read it ourselves from now on. */
+  ingest_stop();
   /* don't do anything if already online! jl 07.07.98 */
   if (P_HASDCD[0]=='Y' && online >= 0) {
     werror(_("You are already online! Hang up first."));
@@ -0,0 +1,972 @@
+/*
+ * evloop.c	Small event loop for the terminal main loop.
+ *
+ *		File descriptors (serial port, keyboard, pipes to child
+ *		processes) are registered with a callback that is run when
+ *		they become readable, timers run a callback when they
+ *		expire.  On Linux this uses epoll and timerfd, elsewhere
+ *		it falls back to poll() and computes the timeout itself.
+ *		Built with --enable-io-uring it uses an io_uring instead
+ *		of epoll if the kernel has one. The port is then read by
+ *		the ring while we wait (ev_io_add_read()), timers are
+ *		read the same way, and polls are re-armed by queueing
+ *		requests that go to the kernel together with the next
+ *		wait, so a round of the loop that brings data from the
+ *		port is a single system call.
+ *
+ *		Entry points:
+ *
+ *		ev_io_add(fd, func, data)     - watch fd for input
+ *		ev_io_add_read(fd, func, data) - same, and read it if we can
+ *		ev_readv(fd, iov, iovcnt)     - read from a watched fd
+ *		ev_io_del(fd)                 - stop watching fd
+ *		ev_timer_add(ms, flags, func, data) - start a timer
+ *		ev_timer_del(id)              - stop a timer
+ *		ev_run(timeout)               - wait for and dispatch events
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define EV_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#if defined(USE_IO_URING) && defined(HAVE_LINUX_IO_URING_H) && \
+    defined(EV_EPOLL)
+#define EV_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "port.h"
+#include "minicom.h"
+
+#ifdef EV_URING
+#define EV_URING_ON	(ur_fd >= 0)
+#else
+#define EV_URING_ON	0
+#endif
+
+#define EV_MAX_IO	16
+#define EV_MAX_TIMER	16
+
+struct ev_io {
+  int fd;		/* -1 if the slot is free */
+  int always;		/* fd can't be polled (regular file), always ready */
+#ifdef EV_URING
+  unsigned gen;		/* tells old completions from current ones */
+#endif
+  ev_io_func func;
+  void *data;
+};
+
+struct ev_timer {
+  int used;
+  int flags;
+  long interval;	/* ms */
+  long long deadline;	/* CLOCK_MONOTONIC, ms (poll backend) */
+#ifdef EV_EPOLL
+  int tfd;
+#endif
+#ifdef EV_URING
+  unsigned gen;
+  int busy;		/* a read of tfd is in the ring */
+  int due;		/* expired while callbacks could not run */
+  uint64_t exp;		/* what the read returns */
+#endif
+  ev_timer_func func;
+  void *data;
+};
+
+static struct ev_io ev_ios[EV_MAX_IO];
+static struct ev_timer ev_timers[EV_MAX_TIMER];
+static int ev_inited;
+
+#ifdef EV_EPOLL
+static int epfd = -1;
+
+/* What the epoll data word refers to. */
+#define EV_KIND_IO	0
+#define EV_KIND_TIMER	1
+
+static uint64_t ev_key(int kind, int idx, int fd)
+{
+  return ((uint64_t)(unsigned)fd << 32) | ((unsigned)kind << 16) | idx;
+}
+#endif
+
+#ifdef EV_URING
+#define EV_KIND_NONE	2	/* completion of a cancel */
+#define EV_KIND_READ	3	/* read of the fd from ev_io_add_read() */
+#define UR_ENTRIES	64
+#define UR_READ_SIZE	65536
+
+static int ur_fd = -1;
+static unsigned *ur_sq_head, *ur_sq_tail, *ur_sq_mask, *ur_sq_array;
+static unsigned *ur_cq_head, *ur_cq_tail, *ur_cq_mask;
+static struct io_uring_sqe *ur_sqes;
+static struct io_uring_cqe *ur_cqes;
+static unsigned ur_tail;	/* our copy of the SQ tail */
+static unsigned ur_gen;
+
+/*
+ * The fd the ring reads for us. A read is only queued while
+ * run_uring() waits; what it got stays here until ev_readv() hands
+ * it out.
+ */
+static struct {
+  int idx;		/* slot in ev_ios, -1 if none */
+  int fd;		/* fd the data below came from */
+  int busy;		/* a read is in the ring */
+  unsigned gen;		/* generation of that read */
+  char *buf;
+  size_t off, len;	/* data not handed out yet */
+  int eof;		/* the read returned 0 */
+  int err;		/* or failed with this errno */
+} ur_rd = { -1, -1, 0, 0, NULL, 0, 0, 0, 0 };
+
+/* In the user data: generation, kind and slot of what was polled. */
+static uint64_t ur_key(int kind, int idx, unsigned gen)
+{
+  return ((uint64_t)(gen & 0xffffff) << 32) | ((unsigned)kind << 16) | idx;
+}
+
+static int ur_enter(unsigned submit, unsigned wait, unsigned flags,
+                    void *arg, size_t argsz)
+{
+  return syscall(__NR_io_uring_enter, ur_fd, submit, wait, flags,
+                 arg, argsz);
+}
+
+/* Number of queued entries the kernel has not picked up yet. */
+static unsigned ur_unsubmitted(void)
+{
+  return ur_tail - __atomic_load_n(ur_sq_head, __ATOMIC_ACQUIRE);
+}
+
+static int ur_setup(void)
+{
+  struct io_uring_params p;
+  size_t sqsize, cqsize;
+  char *sq;
+
+  memset(&p, 0, sizeof(p));
+  ur_fd = syscall(__NR_io_uring_setup, UR_ENTRIES, &p);
+  if (ur_fd < 0)
+    return -1;
+  /* Waiting with a timeout needs EXT_ARG (Linux 5.11). */
+  if (!(p.features & IORING_FEAT_EXT_ARG) ||
+      !(p.features & IORING_FEAT_SINGLE_MMAP))
+    goto fail;
+
+  sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (cqsize > sqsize)
+    sqsize = cqsize;
+  sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ur_fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    goto fail;
+  ur_sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ur_fd, IORING_OFF_SQES);
+  if (ur_sqes == MAP_FAILED) {
+    munmap(sq, sqsize);
+    goto fail;
+  }
+  ur_sq_head = (unsigned *)(sq + p.sq_off.head);
+  ur_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ur_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ur_sq_array = (unsigned *)(sq + p.sq_off.array);
+  ur_cq_head = (unsigned *)(sq + p.cq_off.head);
+  ur_cq_tail = (unsigned *)(sq + p.cq_off.tail);
+  ur_cq_mask = (unsigned *)(sq + p.cq_off.ring_mask);
+  ur_cqes = (struct io_uring_cqe *)(sq + p.cq_off.cqes);
+  ur_tail = *ur_sq_tail;
+  return 0;
+
+fail:
+  close(ur_fd);
+  ur_fd = -1;
+  return -1;
+}
+
+/* Get a free submission entry, submitting what we have if full. */
+static struct io_uring_sqe *ur_get_sqe(void)
+{
+  struct io_uring_sqe *sqe;
+  unsigned idx;
+
+  while (ur_unsubmitted() >= UR_ENTRIES)
+    if (ur_enter(ur_unsubmitted(), 0, 0, NULL, 0) < 0 && errno != EINTR)
+      return NULL;
+  idx = ur_tail & *ur_sq_mask;
+  sqe = &ur_sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  ur_sq_array[idx] = idx;
+  return sqe;
+}
+
+static void ur_queue(void)
+{
+  __atomic_store_n(ur_sq_tail, ++ur_tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Poll fd for input. This is a one-shot poll that run_uring() re-arms
+ * after each event: a multishot poll only reports new wakeups, and
+ * the callbacks expect to hear again about data they left unread.
+ */
+static int ur_watch(int fd, int kind, int idx, unsigned gen)
+{
+  struct io_uring_sqe *sqe;
+
+  if ((sqe = ur_get_sqe()) == NULL)
+    return -1;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = ur_key(kind, idx, gen);
+  ur_queue();
+  return 0;
+}
+
+/* Read the next expiry count of timer idx into its exp field. */
+static int ur_timer_read(int idx)
+{
+  struct ev_timer *t = &ev_timers[idx];
+  struct io_uring_sqe *sqe;
+
+  if ((sqe = ur_get_sqe()) == NULL)
+    return -1;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = t->tfd;
+  sqe->addr = (uintptr_t)&t->exp;
+  sqe->len = sizeof(t->exp);
+  sqe->off = (uint64_t)-1;
+  sqe->user_data = ur_key(EV_KIND_TIMER, idx, t->gen);
+  ur_queue();
+  t->busy = 1;
+  return 0;
+}
+
+/* Read the fd of ev_io_add_read() into ur_rd.buf. */
+static int ur_read(void)
+{
+  struct ev_io *io = &ev_ios[ur_rd.idx];
+  struct io_uring_sqe *sqe;
+
+  if (ur_rd.buf == NULL && (ur_rd.buf = malloc(UR_READ_SIZE)) == NULL)
+    return -1;
+  if ((sqe = ur_get_sqe()) == NULL)
+    return -1;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = io->fd;
+  sqe->addr = (uintptr_t)ur_rd.buf;
+  sqe->len = UR_READ_SIZE;
+  sqe->off = (uint64_t)-1;
+  sqe->user_data = ur_key(EV_KIND_READ, ur_rd.idx, io->gen);
+  ur_queue();
+  ur_rd.fd = io->fd;
+  ur_rd.gen = io->gen;
+  ur_rd.busy = 1;
+  return 0;
+}
+
+/*
+ * Cancel a request and submit that right away, so that the ring does
+ * not keep the fd open after the caller closes it.
+ */
+static void ur_cancel(int kind, int idx, unsigned gen)
+{
+  struct io_uring_sqe *sqe;
+
+  if ((sqe = ur_get_sqe()) == NULL)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = ur_key(kind, idx, gen);
+  sqe->user_data = ur_key(EV_KIND_NONE, 0, 0);
+  ur_queue();
+  while (ur_enter(ur_unsubmitted(), 0, 0, NULL, 0) < 0 && errno == EINTR)
+    ;
+}
+
+static int ur_stop_read(int run);
+#endif
+
+static long long now_ms(clockid_t clk)
+{
+  struct timespec ts;
+
+  clock_gettime(clk, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Milliseconds until the first expiry of a timer.  With EV_ALIGN
+ * the timer fires on a multiple of its interval in wall clock
+ * time, so a 1000 ms timer ticks when the second changes.
+ */
+static long first_expiry(long ms, int flags)
+{
+  if ((flags & EV_ALIGN) && ms > 0)
+    return ms - now_ms(CLOCK_REALTIME) % ms;
+  return ms;
+}
+
+static int ev_init(void)
+{
+  int i;
+
+  if (ev_inited)
+    return 0;
+  for (i = 0; i < EV_MAX_IO; i++)
+    ev_ios[i].fd = -1;
+#ifdef EV_URING
+  if (ur_setup() == 0) {
+    ev_inited = 1;
+    return 0;
+  }
+#endif
+#ifdef EV_EPOLL
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  /* If this fails we still have the poll() backend. */
+#endif
+  ev_inited = 1;
+  return 0;
+}
+
+/*
+ * Name of the backend in use, for the statistics and debug output.
+ */
+const char *ev_backend(void)
+{
+  ev_init();
+#ifdef EV_URING
+  if (ur_fd >= 0)
+    return "io_uring";
+#endif
+#ifdef EV_EPOLL
+  if (epfd >= 0)
+    return "epoll";
+#endif
+  return "poll";
+}
+
+static struct ev_io *find_io(int fd)
+{
+  int i;
+
+  for (i = 0; i < EV_MAX_IO; i++)
+    if (ev_ios[i].fd == fd)
+      return &ev_ios[i];
+  return NULL;
+}
+
+static int io_add(int fd, ev_io_func func, void *data, int read)
+{
+  struct ev_io *io;
+
+  if (fd < 0)
+    return -1;
+  ev_init();
+
+  if ((io = find_io(fd)) != NULL) {
+    io->func = func;
+    io->data = data;
+    return 0;
+  }
+  if ((io = find_io(-1)) == NULL)
+    return -1;
+
+  io->fd = fd;
+  io->always = 0;
+  io->func = func;
+  io->data = data;
+#ifdef EV_URING
+  if (ur_fd >= 0) {
+    io->gen = ++ur_gen;
+    if (read && ur_rd.idx < 0) {
+      /* run_uring() reads it. Data of a port that is gone goes. */
+      ur_rd.idx = io - ev_ios;
+      if (ur_rd.fd != fd) {
+        ur_rd.off = ur_rd.len = 0;
+        ur_rd.eof = ur_rd.err = 0;
+      }
+      return 0;
+    }
+    if (ur_watch(fd, EV_KIND_IO, io - ev_ios, io->gen) < 0) {
+      io->fd = -1;
+      return -1;
+    }
+    return 0;
+  }
+#else
+  (void)read;
+#endif
+#ifdef EV_EPOLL
+  if (epfd >= 0) {
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = ev_key(EV_KIND_IO, io - ev_ios, fd);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      if (errno == EEXIST)
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+      else if (errno == EPERM)
+        io->always = 1;	/* regular file or /dev/null */
+      else {
+        io->fd = -1;
+        return -1;
+      }
+    }
+  }
+#endif
+  return 0;
+}
+
+/*
+ * Watch fd for input. Registering an fd that is already watched
+ * just replaces the callback; if nothing changed no system call is
+ * made, so callers may simply re-register on every iteration.
+ */
+int ev_io_add(int fd, ev_io_func func, void *data)
+{
+  return io_add(fd, func, data, 0);
+}
+
+/*
+ * Like ev_io_add(), but the data must be read with ev_readv(): the
+ * io_uring backend reads fd itself while it waits. That is for the
+ * port, so only one fd at a time is read like this.
+ */
+int ev_io_add_read(int fd, ev_io_func func, void *data)
+{
+  return io_add(fd, func, data, 1);
+}
+
+/*
+ * Stop watching fd. Must be called before the fd is closed, or a
+ * new descriptor with the same number would not be seen by epoll.
+ */
+void ev_io_del(int fd)
+{
+  struct ev_io *io;
+
+  if (fd < 0 || (io = find_io(fd)) == NULL)
+    return;
+#ifdef EV_URING
+  if (ur_fd >= 0 && io - ev_ios == ur_rd.idx) {
+    ur_stop_read(0);
+    ur_rd.idx = -1;
+  } else if (ur_fd >= 0)
+    ur_cancel(EV_KIND_IO, io - ev_ios, io->gen);
+#endif
+#ifdef EV_EPOLL
+  if (epfd >= 0 && !io->always)
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+  io->fd = -1;
+}
+
+/*
+ * Read from fd like readv(). For the fd of ev_io_add_read() this
+ * hands out what the ring has read, without a system call, and says
+ * EAGAIN when that is all gone.
+ */
+ssize_t ev_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+#ifdef EV_URING
+  if (ur_fd >= 0 && fd == ur_rd.fd) {
+    size_t n, total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt && ur_rd.off < ur_rd.len; i++) {
+      n = ur_rd.len - ur_rd.off;
+      if (n > iov[i].iov_len)
+        n = iov[i].iov_len;
+      memcpy(iov[i].iov_base, ur_rd.buf + ur_rd.off, n);
+      ur_rd.off += n;
+      total += n;
+    }
+    if (total)
+      return total;
+    if (ur_rd.eof || ur_rd.err) {
+      ssize_t r = ur_rd.eof ? 0 : -1;
+
+      errno = ur_rd.err;
+      ur_rd.eof = ur_rd.err = 0;
+      return r;
+    }
+    if (ur_rd.busy) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+#endif
+  return readv(fd, iov, iovcnt);
+}
+
+ssize_t ev_read(int fd, void *buf, size_t len)
+{
+  struct iovec iov;
+
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  return ev_readv(fd, &iov, 1);
+}
+
+/* How much of fd ev_readv() has waiting. */
+size_t ev_io_buffered(int fd)
+{
+#ifdef EV_URING
+  if (ur_fd >= 0 && fd == ur_rd.fd)
+    return ur_rd.len - ur_rd.off;
+#endif
+  (void)fd;
+  return 0;
+}
+
+/*
+ * Start a timer that expires after ms milliseconds. With EV_PERIODIC
+ * it keeps firing every ms milliseconds until removed, otherwise it
+ * is removed before its callback runs. Returns a timer id or -1.
+ */
+int ev_timer_add(long ms, int flags, ev_timer_func func, void *data)
+{
+  int id;
+  struct ev_timer *t;
+  long first;
+
+  ev_init();
+  for (id = 0; id < EV_MAX_TIMER; id++)
+    if (!ev_timers[id].used)
+      break;
+  if (id == EV_MAX_TIMER)
+    return -1;
+
+  t = &ev_timers[id];
+  t->flags = flags;
+  t->interval = ms;
+  t->func = func;
+  t->data = data;
+  first = first_expiry(ms, flags);
+  t->deadline = now_ms(CLOCK_MONOTONIC) + first;
+
+#ifdef EV_EPOLL
+  t->tfd = -1;
+  if (epfd >= 0 || EV_URING_ON) {
+    struct itimerspec its;
+    struct epoll_event ev;
+
+    /* The ring would not wait on a non-blocking fd. */
+    t->tfd = timerfd_create(CLOCK_MONOTONIC,
+                            (EV_URING_ON ? 0 : TFD_NONBLOCK) | TFD_CLOEXEC);
+    if (t->tfd < 0)
+      return -1;
+    if (first <= 0)
+      first = 1;	/* zero would disarm the timer */
+    its.it_value.tv_sec = first / 1000;
+    its.it_value.tv_nsec = (first % 1000) * 1000000L;
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 0;
+    if (flags & EV_PERIODIC) {
+      its.it_interval.tv_sec = ms / 1000;
+      its.it_interval.tv_nsec = (ms % 1000) * 1000000L;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = ev_key(EV_KIND_TIMER, id, t->tfd);
+    if (timerfd_settime(t->tfd, 0, &its, NULL) < 0) {
+      close(t->tfd);
+      return -1;
+    }
+#ifdef EV_URING
+    if (ur_fd >= 0) {
+      t->gen = ++ur_gen;
+      t->due = 0;
+      if (ur_timer_read(id) < 0) {
+        close(t->tfd);
+        return -1;
+      }
+    } else
+#endif
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, t->tfd, &ev) < 0) {
+      close(t->tfd);
+      return -1;
+    }
+  }
+#endif
+  t->used = 1;
+  return id;
+}
+
+void ev_timer_del(int id)
+{
+  struct ev_timer *t;
+
+  if (id < 0 || id >= EV_MAX_TIMER || !ev_timers[id].used)
+    return;
+  t = &ev_timers[id];
+#ifdef EV_EPOLL
+  if (t->tfd >= 0) {
+#ifdef EV_URING
+    if (ur_fd >= 0) {
+      if (t->busy)
+        ur_cancel(EV_KIND_TIMER, id, t->gen);
+      t->busy = 0;
+    } else
+#endif
+    epoll_ctl(epfd, EPOLL_CTL_DEL, t->tfd, NULL);
+    close(t->tfd);
+    t->tfd = -1;
+  }
+#endif
+  t->used = 0;
+}
+
+/* Run the callback of an expired timer. */
+static void timer_fire(int id)
+{
+  struct ev_timer *t = &ev_timers[id];
+  ev_timer_func func = t->func;
+  void *data = t->data;
+
+  if (!(t->flags & EV_PERIODIC))
+    ev_timer_del(id);
+  func(id, data);
+}
+
+/* Is there an fd that can't be waited for? Then don't block. */
+static int have_always(void)
+{
+  int i;
+
+  for (i = 0; i < EV_MAX_IO; i++)
+    if (ev_ios[i].fd >= 0 && ev_ios[i].always)
+      return 1;
+  return 0;
+}
+
+#ifdef EV_EPOLL
+static int run_epoll(int timeout)
+{
+  struct epoll_event evs[EV_MAX_IO + EV_MAX_TIMER];
+  int n, i, done = 0;
+
+  n = epoll_wait(epfd, evs, EV_MAX_IO + EV_MAX_TIMER, timeout);
+  if (n < 0)
+    return -1;
+
+  for (i = 0; i < n; i++) {
+    int fd = (int)(evs[i].data.u64 >> 32);
+    int kind = (evs[i].data.u64 >> 16) & 0xffff;
+    int idx = evs[i].data.u64 & 0xffff;
+
+    if (kind == EV_KIND_TIMER) {
+      uint64_t exp;
+      struct ev_timer *t = &ev_timers[idx];
+
+      /* An earlier callback may have removed this timer. */
+      if (!t->used || t->tfd != fd)
+        continue;
+      if (read(fd, &exp, sizeof(exp)) != sizeof(exp))
+        continue;
+      timer_fire(idx);
+    } else {
+      struct ev_io *io = &ev_ios[idx];
+
+      if (io->fd != fd)
+        continue;
+      io->func(fd, (evs[i].events & (EPOLLERR | EPOLLHUP)) ?
+               EV_READ | EV_ERROR : EV_READ, io->data);
+    }
+    done++;
+  }
+  return done;
+}
+#endif
+
+#ifdef EV_URING
+/*
+ * Handle what the ring has completed. With run 0 no callbacks are
+ * run (we are not in ev_run()): polls are re-armed, so that they
+ * complete again, and expired timers fire on the next round.
+ * Returns the number of callbacks run.
+ */
+static int ur_reap(int run)
+{
+  struct io_uring_cqe cqe;
+  unsigned head, gen;
+  int kind, idx, done = 0;
+
+  while ((head = *ur_cq_head) != __atomic_load_n(ur_cq_tail,
+                                                  __ATOMIC_ACQUIRE)) {
+    cqe = ur_cqes[head & *ur_cq_mask];
+    __atomic_store_n(ur_cq_head, head + 1, __ATOMIC_RELEASE);
+
+    kind = (cqe.user_data >> 16) & 0xffff;
+    idx = cqe.user_data & 0xffff;
+    gen = cqe.user_data >> 32;
+    if (kind == EV_KIND_TIMER) {
+      struct ev_timer *t = &ev_timers[idx];
+
+      /* An earlier callback may have removed this timer. */
+      if (!t->used || (t->gen & 0xffffff) != gen)
+        continue;
+      t->busy = 0;
+      if (cqe.res == -ECANCELED)
+        continue;
+      /* Read on first: the callback may remove the timer. */
+      if (t->flags & EV_PERIODIC)
+        ur_timer_read(idx);
+      if (cqe.res != sizeof(t->exp))
+        continue;
+      if (!run) {
+        t->due = 1;
+        continue;
+      }
+      timer_fire(idx);
+      done++;
+    } else if (kind == EV_KIND_IO) {
+      struct ev_io *io = &ev_ios[idx];
+
+      if (io->fd < 0 || (io->gen & 0xffffff) != gen ||
+          cqe.res == -ECANCELED)
+        continue;
+      /* Re-arm first: the callback may remove the fd again. */
+      ur_watch(io->fd, kind, idx, io->gen);
+      if (!run)
+        continue;
+      io->func(io->fd, (cqe.res < 0 || (cqe.res & (POLLERR | POLLHUP))) ?
+               EV_READ | EV_ERROR : EV_READ, io->data);
+      done++;
+    } else if (kind == EV_KIND_READ) {
+      struct ev_io *io = &ev_ios[idx];
+
+      if (!ur_rd.busy || (ur_rd.gen & 0xffffff) != gen)
+        continue;
+      ur_rd.busy = 0;
+      if (cqe.res == -ECANCELED)
+        continue;
+      if (cqe.res == -EAGAIN) {
+        /* A non-blocking fd: the ring does not wait for those. */
+        if (idx == ur_rd.idx) {
+          ur_rd.idx = -1;
+          ur_watch(io->fd, EV_KIND_IO, idx, io->gen);
+        }
+        continue;
+      }
+      if (cqe.res > 0) {
+        ur_rd.off = 0;
+        ur_rd.len = cqe.res;
+      } else if (cqe.res == 0)
+        ur_rd.eof = 1;
+      else
+        ur_rd.err = -cqe.res;
+      if (!run || idx != ur_rd.idx || io->fd != ur_rd.fd)
+        continue;
+      io->func(io->fd, cqe.res > 0 ? EV_READ : EV_READ | EV_ERROR, io->data);
+      done++;
+    }
+  }
+  return done;
+}
+
+/*
+ * Take the read of the port out of the ring, waiting until it is
+ * done, so that nothing reads the port while we are not looking.
+ * What it got stays for ev_readv().
+ */
+static int ur_stop_read(int run)
+{
+  int done = 0;
+
+  if (!ur_rd.busy)
+    return 0;
+  ur_cancel(EV_KIND_READ, ur_rd.idx, ur_rd.gen);
+  while (ur_rd.busy) {
+    if (*ur_cq_head == __atomic_load_n(ur_cq_tail, __ATOMIC_ACQUIRE) &&
+        ur_enter(0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+        errno != EINTR)
+      break;
+    done += ur_reap(run);
+  }
+  return done;
+}
+
+/*
+ * What came in while no callbacks could run, or was not taken the
+ * last time round. Returns the number of callbacks run.
+ */
+static int ur_pending(void)
+{
+  struct ev_io *io;
+  int i, done = 0;
+
+  for (i = 0; i < EV_MAX_TIMER; i++) {
+    if (ev_timers[i].used && ev_timers[i].due) {
+      ev_timers[i].due = 0;
+      timer_fire(i);
+      done++;
+    }
+  }
+  if (ur_rd.idx >= 0 && (io = &ev_ios[ur_rd.idx])->fd == ur_rd.fd &&
+      (ur_rd.off < ur_rd.len || ur_rd.eof || ur_rd.err)) {
+    io->func(io->fd, ur_rd.off < ur_rd.len ? EV_READ : EV_READ | EV_ERROR,
+             io->data);
+    done++;
+  }
+  return done;
+}
+
+static int run_uring(int timeout)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  int n, err, done;
+
+  /* Something left over: report it, and do not wait. */
+  if ((done = ur_pending()) > 0)
+    timeout = 0;
+  /* Read the port while we wait, unless its last data is still here. */
+  else if (ur_rd.idx >= 0 && !ur_rd.busy)
+    ur_read();
+
+  memset(&arg, 0, sizeof(arg));
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    arg.ts = (uintptr_t)&ts;
+  }
+  /* Submit what is queued and wait, unless there is something already. */
+  if (*ur_cq_head == __atomic_load_n(ur_cq_tail, __ATOMIC_ACQUIRE))
+    n = ur_enter(ur_unsubmitted(), timeout ? 1 : 0,
+                 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                 &arg, sizeof(arg));
+  else
+    n = ur_unsubmitted() ? ur_enter(ur_unsubmitted(), 0, 0, NULL, 0) : 0;
+  err = n < 0 ? errno : 0;
+
+  done += ur_reap(1);
+  /* Back to the caller, who may read the port itself. */
+  done += ur_stop_read(1);
+  if (err && err != ETIME && err != EBUSY && !done) {
+    errno = err;
+    return -1;
+  }
+  return done;
+}
+#endif
+
+static int run_poll(int timeout)
+{
+  struct pollfd pfd[EV_MAX_IO];
+  int idx[EV_MAX_IO];
+  long long now, wait;
+  int n = 0, i, done = 0;
+
+  for (i = 0; i < EV_MAX_IO; i++) {
+    if (ev_ios[i].fd < 0)
+      continue;
+    pfd[n].fd = ev_ios[i].fd;
+    pfd[n].events = POLLIN;
+    idx[n++] = i;
+  }
+
+  /* Do not sleep past the first timer. */
+  now = now_ms(CLOCK_MONOTONIC);
+  for (i = 0; i < EV_MAX_TIMER; i++) {
+    if (!ev_timers[i].used)
+      continue;
+    wait = ev_timers[i].deadline - now;
+    if (wait < 0)
+      wait = 0;
+    if (timeout < 0 || wait < timeout)
+      timeout = wait;
+  }
+
+  if (poll(pfd, n, timeout) < 0)
+    return -1;
+
+  for (i = 0; i < n; i++) {
+    struct ev_io *io = &ev_ios[idx[i]];
+
+    if (!pfd[i].revents || io->fd != pfd[i].fd)
+      continue;
+    io->func(io->fd, (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL)) ?
+             EV_READ | EV_ERROR : EV_READ, io->data);
+    done++;
+  }
+
+  now = now_ms(CLOCK_MONOTONIC);
+  for (i = 0; i < EV_MAX_TIMER; i++) {
+    struct ev_timer *t = &ev_timers[i];
+
+    if (!t->used || t->deadline > now)
+      continue;
+    if (t->flags & EV_PERIODIC) {
+      /* Skip expiries we slept through instead of firing them all. */
+      while (t->deadline <= now)
+        t->deadline += t->interval > 0 ? t->interval : 1;
+    }
+    timer_fire(i);
+    done++;
+  }
+  return done;
+}
+
+/*
+ * Wait at most timeout milliseconds (-1 means until something
+ * happens) and run the callbacks of whatever became ready.
+ * Returns the number of callbacks run, 0 on timeout, -1 on error
+ * (errno EINTR if a signal came in, e.g. SIGWINCH).
+ */
+int ev_run(int timeout)
+{
+  int i, done = 0;
+
+  ev_init();
+
+  if (have_always()) {
+    timeout = 0;
+    for (i = 0; i < EV_MAX_IO; i++) {
+      if (ev_ios[i].fd >= 0 && ev_ios[i].always) {
+        ev_ios[i].func(ev_ios[i].fd, EV_READ, ev_ios[i].data);
+        done++;
+      }
+    }
+  }
+
+#ifdef EV_URING
+  if (ur_fd >= 0)
+    i = run_uring(timeout);
+  else
+#endif
+#ifdef EV_EPOLL
+  if (epfd >= 0)
+    i = run_epoll(timeout);
+  else
+#endif
+  i = run_poll(timeout);
+  return i < 0 && !done ? -1 : done + (i > 0 ? i : 0);
+}
@@ -0,0 +1,555 @@
+/*
+ * history.c	The scrollback buffer of a window.
+ *
+ *		A line of cells takes sizeof(ELM) bytes a column, which
+ *		for a long history on a wide screen is a lot of memory
+ *		that is mostly spaces. Here every line is kept as a
+ *		record: the number of characters, the attribute runs,
+ *		then the characters in UTF-8 with the trailing spaces
+ *		left off. hist_get() turns a record back into cells
+ *		when it is looked at.
+ *
+ *		Records are stored one after the other in blocks. Lines
+ *		leave the history in the order they came in, so a block
+ *		is freed when the last of its lines is gone.
+ *
+ *		With a history file (-O histfile=FILE) every line is also
+ *		appended to that file, and its offset to an index in a
+ *		temporary file. Lines that left the memory can then still
+ *		be read back, through mmap() of both files, so the history
+ *		view reaches back to the start of the session.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/mman.h>
+
+#include "port.h"
+#include "minicom.h"
+
+const char *hist_file;		/* -O histfile=FILE */
+
+#define HBLOCK	65536		/* Usual size of a block */
+#define NOUT	4		/* Lines from hist_get() valid at once */
+#define SPILLBUF 65536		/* Bytes gathered before writing the file */
+#define SPILLIDX 4096		/* Offsets gathered before writing the index */
+
+struct hblock {
+  struct hblock *next;
+  int size;			/* Bytes in data */
+  int used;			/* Bytes in use */
+  int live;			/* Records still in the history */
+  unsigned char *data;
+};
+
+struct hist {
+  int xs;			/* Cells in a line */
+  int lines;			/* Lines in the history */
+  unsigned char **rec;		/* Record of each line, NULL if blank */
+  struct hblock *head;		/* Oldest block */
+  struct hblock *tail;		/* Block being filled */
+  char attr, color;		/* Of a blank line */
+  unsigned char *tmp;		/* A record being made */
+  int maxrec;			/* Size of tmp */
+  ELM *out;			/* Lines handed out by hist_get() */
+  int nout;
+  char *text;			/* Line from hist_text() */
+  struct spill *spill;		/* History file, if any */
+};
+
+struct spill {
+  int fd;			/* The history file */
+  FILE *idx;			/* Offset of every line in it */
+  unsigned long long size;	/* Bytes in the file */
+  int lines;			/* Lines in the file */
+  unsigned char *buf;		/* Not written yet */
+  int nbuf;
+  unsigned long long off[SPILLIDX];
+  int noff;
+  const unsigned char *map;	/* The file, mapped */
+  size_t maplen;
+  const unsigned long long *imap; /* The index, mapped */
+  size_t imaplen;
+};
+
+/* A number in 7 bit groups, lowest first. */
+static unsigned char *put_num(unsigned char *p, unsigned n)
+{
+  while (n >= 0x80) {
+    *p++ = n | 0x80;
+    n >>= 7;
+  }
+  *p++ = n;
+  return p;
+}
+
+static const unsigned char *get_num(const unsigned char *p, unsigned *n)
+{
+  int shift = 0;
+
+  *n = 0;
+  do {
+    *n |= (unsigned)(*p & 0x7f) << shift;
+    shift += 7;
+  } while (*p++ & 0x80);
+  return p;
+}
+
+/*
+ * A cell value in UTF-8. The right half of a wide character
+ * (WIDE_PAD) and raw bytes from the port do not fit, those go
+ * after a 0xff byte as they are.
+ */
+static unsigned char *put_char(unsigned char *p, wchar_t wc)
+{
+  unsigned c = (unsigned)wc;
+
+  if (c < 0x80)
+    *p++ = c;
+  else if (c < 0x800) {
+    *p++ = 0xc0 | c >> 6;
+    *p++ = 0x80 | (c & 0x3f);
+  } else if (c < 0x10000) {
+    *p++ = 0xe0 | c >> 12;
+    *p++ = 0x80 | (c >> 6 & 0x3f);
+    *p++ = 0x80 | (c & 0x3f);
+  } else if (c < 0x110000) {
+    *p++ = 0xf0 | c >> 18;
+    *p++ = 0x80 | (c >> 12 & 0x3f);
+    *p++ = 0x80 | (c >> 6 & 0x3f);
+    *p++ = 0x80 | (c & 0x3f);
+  } else {
+    *p++ = 0xff;
+    memcpy(p, &wc, sizeof(wc));
+    p += sizeof(wc);
+  }
+  return p;
+}
+
+static const unsigned char *get_char(const unsigned char *p, wchar_t *wc)
+{
+  unsigned c = *p++;
+
+  if (c < 0x80)
+    *wc = c;
+  else if (c == 0xff) {
+    memcpy(wc, p, sizeof(*wc));
+    p += sizeof(*wc);
+  } else if (c < 0xe0) {
+    *wc = (c & 0x1f) << 6 | (p[0] & 0x3f);
+    p += 1;
+  } else if (c < 0xf0) {
+    *wc = (c & 0x0f) << 12 | (p[0] & 0x3f) << 6 | (p[1] & 0x3f);
+    p += 2;
+  } else {
+    *wc = (c & 0x07) << 18 | (p[0] & 0x3f) << 12 | (p[1] & 0x3f) << 6 |
+          (p[2] & 0x3f);
+    p += 3;
+  }
+  return p;
+}
+
+/*
+ * Make a history of 'lines' lines of xs cells, all blank in
+ * attr and color to begin with.
+ */
+struct hist *hist_new(int xs, int lines, int attr, int color)
+{
+  struct hist *h;
+
+  if ((h = calloc(1, sizeof(struct hist))) == NULL)
+    return NULL;
+  h->xs = xs;
+  h->lines = lines;
+  h->attr = attr;
+  h->color = color;
+  /* Runs of up to 5 + 2 bytes, characters of up to 5. */
+  h->maxrec = 5 + xs * (7 + 1 + sizeof(wchar_t));
+  h->rec = calloc(lines, sizeof(unsigned char *));
+  h->tmp = malloc(h->maxrec);
+  h->out = malloc(NOUT * xs * sizeof(ELM));
+  h->text = malloc(xs * 4 + 1);
+  if (h->rec == NULL || h->tmp == NULL || h->out == NULL ||
+      h->text == NULL) {
+    hist_free(h);
+    return NULL;
+  }
+  return h;
+}
+
+static void spill_close(struct spill *s)
+{
+  if (s->map)
+    munmap((void *)s->map, s->maplen);
+  if (s->imap)
+    munmap((void *)s->imap, s->imaplen);
+  if (s->fd >= 0)
+    close(s->fd);
+  if (s->idx)
+    fclose(s->idx);
+  free(s->buf);
+  free(s);
+}
+
+void hist_free(struct hist *h)
+{
+  struct hblock *b;
+
+  if (h == NULL)
+    return;
+  if (h->spill)
+    spill_close(h->spill);
+  while ((b = h->head) != NULL) {
+    h->head = b->next;
+    free(b);
+  }
+  free(h->rec);
+  free(h->tmp);
+  free(h->out);
+  free(h->text);
+  free(h);
+}
+
+/*
+ * The record in slot n goes away. It is the oldest one there is,
+ * so it is in the first block.
+ */
+static void hist_drop(struct hist *h, int n)
+{
+  struct hblock *b = h->head;
+
+  if (h->rec[n] == NULL)
+    return;
+  h->rec[n] = NULL;
+  if (--b->live > 0)
+    return;
+  if (b == h->tail) {
+    b->used = 0;
+    return;
+  }
+  h->head = b->next;
+  free(b);
+}
+
+/* Room for len bytes at the end of the last block. */
+static unsigned char *hist_room(struct hist *h, int len)
+{
+  struct hblock *b = h->tail;
+  int size;
+
+  if (b == NULL || b->used + len > b->size) {
+    size = len > HBLOCK ? len : HBLOCK;
+    if ((b = malloc(sizeof(struct hblock) + size)) == NULL)
+      return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    b->live = 0;
+    b->data = (unsigned char *)(b + 1);
+    if (h->tail)
+      h->tail->next = b;
+    else
+      h->head = b;
+    h->tail = b;
+  }
+  b->live++;
+  b->used += len;
+  return b->data + b->used - len;
+}
+
+/*
+ * Write out what is gathered. If the file can't be written, it is
+ * given up; the lines in memory are still there.
+ */
+static int spill_flush(struct hist *h)
+{
+  struct spill *s = h->spill;
+  int n, done;
+
+  for (done = 0; done < s->nbuf; done += n)
+    if ((n = write(s->fd, s->buf + done, s->nbuf - done)) <= 0) {
+      if (n < 0 && errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      break;
+    }
+  if (done < s->nbuf ||
+      fwrite(s->off, sizeof(s->off[0]), s->noff, s->idx) != (size_t)s->noff ||
+      fflush(s->idx) != 0) {
+    spill_close(s);
+    h->spill = NULL;
+    return -1;
+  }
+  s->nbuf = 0;
+  s->noff = 0;
+  return 0;
+}
+
+static void spill_put(struct hist *h, const unsigned char *rec, int len)
+{
+  struct spill *s = h->spill;
+
+  if ((s->nbuf + len > SPILLBUF || s->noff == SPILLIDX) &&
+      spill_flush(h) < 0)
+    return;
+  memcpy(s->buf + s->nbuf, rec, len);
+  s->nbuf += len;
+  s->off[s->noff++] = s->size;
+  s->size += len;
+  s->lines++;
+}
+
+/*
+ * Also keep the lines in file, from now on.
+ */
+int hist_spill(struct hist *h, const char *file)
+{
+  struct spill *s;
+
+  if ((s = calloc(1, sizeof(struct spill))) == NULL)
+    return -1;
+  s->fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  s->idx = tmpfile();
+  /* A record can be larger than SPILLBUF on a very wide screen. */
+  s->buf = malloc(SPILLBUF > h->maxrec ? SPILLBUF : h->maxrec);
+  if (s->fd < 0 || s->idx == NULL || s->buf == NULL) {
+    spill_close(s);
+    return -1;
+  }
+  h->spill = s;
+  return 0;
+}
+
+/*
+ * Lines that are in the history file, but no longer in memory.
+ */
+int hist_spilled(struct hist *h)
+{
+  if (h == NULL || h->spill == NULL || h->spill->lines <= h->lines)
+    return 0;
+  return h->spill->lines - h->lines;
+}
+
+/*
+ * Put a line of cells in slot n, in place of what was there.
+ * Slots must be filled in turn, like the ring buffer that the
+ * window keeps the history in.
+ */
+void hist_put(struct hist *h, int n, const ELM *e)
+{
+  unsigned char *p, *rec;
+  int x, run, end;
+
+  hist_drop(h, n);
+
+  for (end = h->xs; end > 0; end--)
+    if (e[end - 1].value != ' ')
+      break;
+  p = put_num(h->tmp, end);
+  for (x = 0; x < h->xs; x += run) {
+    for (run = 1; x + run < h->xs; run++)
+      if (e[x + run].attr != e[x].attr || e[x + run].color != e[x].color)
+        break;
+    p = put_num(p, run);
+    *p++ = e[x].attr;
+    *p++ = e[x].color;
+  }
+  for (x = 0; x < end; x++)
+    p = put_char(p, e[x].value);
+  if (h->spill)
+    spill_put(h, h->tmp, p - h->tmp);
+
+  /* A line of spaces in the blank attributes needs no record. */
+  if (end == 0) {
+    for (x = 0; x < h->xs; x++)
+      if (e[x].attr != h->attr || e[x].color != h->color)
+        break;
+    if (x == h->xs)
+      return;
+  }
+
+  if ((rec = hist_room(h, p - h->tmp)) == NULL)
+    return;	/* Out of memory: the line is lost, but blank. */
+  memcpy(rec, h->tmp, p - h->tmp);
+  h->rec[n] = rec;
+}
+
+/*
+ * The cells of a record, or a blank line if there is none. The line
+ * stays valid until NOUT more lines have been asked for.
+ */
+static ELM *hist_decode(struct hist *h, const unsigned char *p)
+{
+  ELM *e = h->out + h->nout * h->xs;
+  unsigned run, end;
+  int x;
+  char attr, color;
+
+  h->nout = (h->nout + 1) % NOUT;
+
+  if (p == NULL) {
+    for (x = 0; x < h->xs; x++) {
+      e[x].value = ' ';
+      e[x].attr = h->attr;
+      e[x].color = h->color;
+    }
+    return e;
+  }
+  p = get_num(p, &end);
+  for (x = 0; x < h->xs; ) {
+    p = get_num(p, &run);
+    attr = *p++;
+    color = *p++;
+    for (run += x; x < (int)run; x++) {
+      e[x].attr = attr;
+      e[x].color = color;
+    }
+  }
+  for (x = 0; x < (int)end; x++)
+    p = get_char(p, &e[x].value);
+  for (; x < h->xs; x++)
+    e[x].value = ' ';
+  return e;
+}
+
+/*
+ * The cells of slot n.
+ */
+ELM *hist_get(struct hist *h, int n)
+{
+  return hist_decode(h, h->rec[n]);
+}
+
+/*
+ * Map what is in the history file and the index, again if they
+ * grew since the last time.
+ */
+static int spill_map(struct hist *h)
+{
+  struct spill *s = h->spill;
+  size_t ilen = (size_t)s->lines * sizeof(s->off[0]);
+  void *m;
+
+  if (spill_flush(h) < 0)
+    return -1;
+  if (s->maplen < s->size) {
+    if (s->map)
+      munmap((void *)s->map, s->maplen);
+    s->map = NULL;
+    if ((m = mmap(NULL, s->size, PROT_READ, MAP_SHARED, s->fd, 0))
+        == MAP_FAILED)
+      return -1;
+    s->map = m;
+    s->maplen = s->size;
+  }
+  if (s->imaplen < ilen) {
+    if (s->imap)
+      munmap((void *)s->imap, s->imaplen);
+    s->imap = NULL;
+    if ((m = mmap(NULL, ilen, PROT_READ, MAP_SHARED, fileno(s->idx), 0))
+        == MAP_FAILED)
+      return -1;
+    s->imap = m;
+    s->imaplen = ilen;
+  }
+  return 0;
+}
+
+/*
+ * Line no of those that are only in the history file, the
+ * oldest is 0. A blank line if the file can't be read.
+ */
+ELM *hist_old(struct hist *h, int no)
+{
+  if (no < 0 || no >= hist_spilled(h) || spill_map(h) < 0)
+    return hist_decode(h, NULL);
+  return hist_decode(h, h->spill->map + h->spill->imap[no]);
+}
+
+/*
+ * The characters of a record as a string, for searching: UTF-8,
+ * without the trailing spaces and the right halves of wide
+ * characters. Raw bytes from the port are '?'. The records have
+ * it nearly like that already, so this is mostly a copy.
+ */
+static const char *rec_text(struct hist *h, const unsigned char *p, int *len)
+{
+  char *t = h->text;
+  unsigned run, end;
+  wchar_t wc;
+  int x;
+
+  if (p != NULL) {
+    p = get_num(p, &end);
+    for (x = 0; x < h->xs; x += run) {
+      p = get_num(p, &run);
+      p += 2;
+    }
+    for (; end > 0; end--) {
+      if (*p < 0x80)
+        *t++ = *p++;
+      else if (*p == 0xff) {
+        p = get_char(p, &wc);
+        if (wc != WIDE_PAD)
+          *t++ = '?';
+      } else {
+        /* The length of the sequence is in its first byte. */
+        x = *p < 0xe0 ? 2 : *p < 0xf0 ? 3 : 4;
+        while (x--)
+          *t++ = *p++;
+      }
+    }
+  }
+  *t = 0;
+  *len = t - h->text;
+  return h->text;
+}
+
+/* The text of slot n, see rec_text(). */
+const char *hist_text(struct hist *h, int n, int *len)
+{
+  return rec_text(h, h->rec[n], len);
+}
+
+/* The text of line no in the history file, see hist_old(). */
+const char *hist_old_text(struct hist *h, int no, int *len)
+{
+  if (no < 0 || no >= hist_spilled(h) || spill_map(h) < 0)
+    return rec_text(h, NULL, len);
+  return rec_text(h, h->spill->map + h->spill->imap[no], len);
+}
+
+/* The same for a line of cells that is not in the history. */
+const char *elm_text(const ELM *e, int xs, int *len)
+{
+  static char text[MAXCOLS * 4 + 1];
+  unsigned char *p = (unsigned char *)text;
+  int x, end;
+
+  for (end = xs; end > 0; end--)
+    if (e[end - 1].value != ' ')
+      break;
+  for (x = 0; x < end && x < MAXCOLS; x++) {
+    if (e[x].value == WIDE_PAD)
+      continue;
+    if (e[x].value < 0 || e[x].value >= 0x110000)
+      *p++ = '?';
+    else
+      p = put_char(p, e[x].value);
+  }
+  *p = 0;
+  *len = (char *)p - text;
+  return text;
+}
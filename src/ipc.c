@@ -30,7 +30,7 @@
 
 int read_buf(int fd, char *buf, int bufsize)
 {
-  int i = read(fd, buf, bufsize - 1);
+  int i = ev_read(fd, buf, bufsize - 1);
 
 #ifdef USE_SOCKET
   if (i < 1 && portfd_is_socket && portfd == fd) {
@@ -44,41 +44,92 @@ int read_buf(int fd, char *buf, int bufsize)
   return i;
 }
 
-/* Check if there is IO pending. */
+/* What the event loop callbacks below have seen since the last check. */
+static int io_ready;
+static int tick_id = -1;
+
+static void port_ready(int fd, int events, void *data)
+{
+  (void)fd; (void)data;
+  io_ready |= 1;
+  if (events & EV_ERROR)
+    io_ready |= 8;
+}
+
+static void key_ready(int fd, int events, void *data)
+{
+  (void)fd; (void)events; (void)data;
+  io_ready |= 2;
+}
+
+static void tick(int id, void *data)
+{
+  (void)id; (void)data;
+  io_ready |= 4;
+}
+
+/*
+ * Check if there is IO pending.
+ *
+ * Returns a mask: 1 - data from fd1 (read into buf if given),
+ * 2 - keyboard input, 4 - the one second tick went off,
+ * 8 - fd1 reported an error or end of file.
+ */
 static int check_io(int fd1, int fd2, int tmout, char *buf,
                     int bufsize, int *bytes_read)
 {
-  int n = 0, i;
-  struct timeval tv;
-  fd_set fds;
-
-  tv.tv_sec = tmout / 1000;
-  tv.tv_usec = (tmout % 1000) * 1000L;
-
-  i = fd1;
-  if (fd2 > fd1)
-    i = fd2;
-
-  FD_ZERO(&fds);
-  if (fd1 >= 0)
-    FD_SET(fd1, &fds);
-  else
-    fd1 = 0;
+  static int port_watched = -1;
+  int n, i, want;
+  struct timeval end, now;
+
+  /*
+   * The port may have been closed and reopened meanwhile. When only
+   * the keyboard is of interest, stop watching the port or pending
+   * data would wake us up over and over again.
+   */
+  if (fd1 != port_watched) {
+    ev_io_del(port_watched);
+    port_watched = -1;
+  }
+  if (fd1 >= 0 && (fd1 == rxt_fd() ? ev_io_add(fd1, port_ready, NULL) :
+                   ev_io_add_read(fd1, port_ready, NULL)) == 0)
+    port_watched = fd1;
   if (fd2 >= 0)
-    FD_SET(fd2, &fds);
-  else
-    fd2 = 0;
+    ev_io_add(fd2, key_ready, NULL);
+
+  /* Only an unlimited wait returns on the tick. */
+  want = (fd1 >= 0 ? 1 | 8 : 0) | (fd2 >= 0 ? 2 : 0) | (tmout < 0 ? 4 : 0);
 
+  io_ready = 0;
   if (fd2 == 0 && io_pending)
-    n = 2;
-  else if (select(i + 1, &fds, NULL, NULL, &tv) > 0)
-    n = 1 * (FD_ISSET(fd1, &fds) > 0) + 2 * (FD_ISSET(fd2, &fds) > 0);
+    io_ready = 2;
+  else {
+    gettimeofday(&end, NULL);
+    end.tv_sec += tmout / 1000;
+    end.tv_usec += (tmout % 1000) * 1000L;
+    if (end.tv_usec >= 1000000) {
+      end.tv_sec++;
+      end.tv_usec -= 1000000;
+    }
+    while (ev_run(tmout) >= 0 && !(io_ready & want) && tmout > 0) {
+      gettimeofday(&now, NULL);
+      tmout = (end.tv_sec - now.tv_sec) * 1000 +
+              (end.tv_usec - now.tv_usec) / 1000;
+      if (tmout <= 0)
+        break;
+    }
+  }
+
+  n = io_ready & want;
 
   /* If there is data put it in the buffer. */
   if (buf) {
-    if ((n & 1) == 1)
+    if ((n & 1) == 1) {
       i = read_buf(fd1, buf, bufsize);
-    else
+      /* EOF or error: let the caller check the device. */
+      if (i <= 0 && !(i < 0 && errno == EAGAIN))
+        n |= 8;
+    } else
       i = 0;
 
     if (bytes_read)
@@ -88,9 +139,20 @@ static int check_io(int fd1, int fd2, int tmout, char *buf,
   return n;
 }
 
+/*
+ * Wait for data from the port or the keyboard. Returns at least once
+ * a second, when the wall clock second changes, with bit 4 set, so
+ * callers can update clocks and counters without polling.
+ */
 int check_io_frontend(char *buf, int buf_size, int *bytes_read)
 {
-  return check_io(portfd_connected(), 0, 1000, buf, buf_size, bytes_read);
+  if (tick_id < 0)
+    tick_id = ev_timer_add(1000, EV_PERIODIC | EV_ALIGN, tick, NULL);
+  /* With a reader thread, it tells us when there is data. Without a
+   * screen there is no keyboard either. */
+  return check_io(rxt_running() ? rxt_fd() : portfd_connected(),
+                  headless ? -1 : 0,
+                  tick_id < 0 ? 1000 : -1, buf, buf_size, bytes_read);
 }
 
 bool check_io_input(int timeout_ms)
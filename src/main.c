@@ -33,6 +33,7 @@
 
 #include <stdbool.h>
 #include <assert.h>
+#include <poll.h>
 
 #ifdef SVR4_LOCKS
 #include <sys/types.h>
@@ -57,7 +58,7 @@ const char *Version = VERSION;
 /*
  * Find out name to use for lockfile when locking tty.
  */
-static char *mdevlockname(char *s, char *res, int reslen)
+static char *mdevlockname(const char *s, char *res, int reslen)
 {
   char *p;
 
@@ -70,11 +71,9 @@ static char *mdevlockname(char *s, char *res, int reslen)
         *p = '_';
   } else {
     /* Outside of /dev. Do something sensible. */
-    if ((p = strrchr(s, '/')) == NULL)
-      p = s;
-    else
-      p++;
-    strncpy(res, p, reslen - 1);
+    const char *base = strrchr(s, '/');
+
+    strncpy(res, base ? base + 1 : s, reslen - 1);
     res[reslen-1] = 0;
   }
 
@@ -117,6 +116,7 @@ void leave(const char *s)
 {
   if (stdwin)
     mc_wclose(stdwin, 1);
+  pane_close_all();
   if (portfd > 0) {
     m_restorestate(portfd);
     close(portfd);
@@ -124,6 +124,8 @@ void leave(const char *s)
   lockfile_remove();
   if (P_CALLIN[0])
     fastsystem(P_CALLIN, NULL, NULL, NULL);
+  cap_close();
+  rec_close();
   fprintf(stderr, "%s", s);
   exit(1);
 }
@@ -243,6 +245,8 @@ void term_socket_connect(void)
  */
 void term_socket_close(void)
 {
+  rxt_stop();
+  ev_io_del(portfd);
   close(portfd);
   portfd_is_connected = 0;
   portfd = -1;
@@ -250,19 +254,83 @@ void term_socket_close(void)
 #endif /* USE_SOCKET */
 
 /*
- * Open the terminal.
- *
- * \return -1 on error, 0 on success
+ * Put the name of the UUCP lock file for device dev into buf, or an
+ * empty string if there is no lock directory.
  */
-int open_term(int doinit, int show_win_on_error, int no_msgs)
+void lockfile_name(const char *dev, char *buf, size_t len)
 {
+  buf[0] = 0;
+#if !HAVE_LOCKDEV
   struct stat stt;
+
+  /* First see if the lock file directory is present. */
+  if (!P_LOCK[0] || stat(P_LOCK, &stt) != 0)
+    return;
+
+#ifdef SVR4_LOCKS
+  stat(dev, &stt);
+  snprintf(buf, len, "%s/LK.%03d.%03d.%03d",
+                     P_LOCK, major(stt.st_dev),
+                     major(stt.st_rdev), minor(stt.st_rdev));
+
+#else /* SVR4_LOCKS */
+  char name[128];
+
+  snprintf(buf, len, "%s/LCK..%s",
+                     P_LOCK, mdevlockname(dev, name, sizeof(name)));
+#endif /* SVR4_LOCKS */
+#else
+  (void)dev;
+  (void)len;
+#endif
+}
+
+/*
+ * See if the lock file name is held by a running process. A stale
+ * lock file is removed. Returns 1 if the device is in use.
+ */
+int lockfile_busy(const char *name)
+{
   union {
 	char bytes[128];
 	int kermit;
   } buf;
-  int fd, n = 0;
+  int fd, n;
   int pid;
+
+  if (!name[0] || (fd = open(name, O_RDONLY)) < 0)
+    return 0;
+  n = read(fd, buf.bytes, 127);
+  close(fd);
+  if (n > 0) {
+    pid = -1;
+    if (n == 4)
+      /* Kermit-style lockfile. */
+      pid = buf.kermit;
+    else {
+      /* Ascii lockfile. */
+      buf.bytes[n] = 0;
+      sscanf(buf.bytes, "%d", &pid);
+    }
+    if (pid > 0 && kill((pid_t)pid, 0) < 0 &&
+        errno == ESRCH) {
+      fprintf(stderr, _("Lockfile is stale. Overriding it..\n"));
+      sleep(1);
+      unlink(name);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Open the terminal.
+ *
+ * \return -1 on error, 0 on success
+ */
+int open_term(int doinit, int show_win_on_error, int no_msgs)
+{
+  int n = 0;
 #ifdef HAVE_ERRNO_H
   int s_errno;
 #endif
@@ -283,53 +351,13 @@ int open_term(int doinit, int show_win_on_error, int no_msgs)
     goto nolock;
 
 #if !HAVE_LOCKDEV
-  /* First see if the lock file directory is present. */
-  if (P_LOCK[0] && stat(P_LOCK, &stt) == 0) {
-
-#ifdef SVR4_LOCKS
-    stat(dial_tty, &stt);
-    sprintf(lockfile, "%s/LK.%03d.%03d.%03d",
-                      P_LOCK, major(stt.st_dev),
-                      major(stt.st_rdev), minor(stt.st_rdev));
-
-#else /* SVR4_LOCKS */
-    snprintf(lockfile, sizeof(lockfile),
-                       "%s/LCK..%s",
-                       P_LOCK, mdevlockname(dial_tty, buf.bytes,
-                                            sizeof(buf.bytes)));
-#endif /* SVR4_LOCKS */
+  lockfile_name(dial_tty, lockfile, sizeof(lockfile));
 
-  }
-  else
-    lockfile[0] = 0;
-
-  if (doinit > 0 && lockfile[0] && (fd = open(lockfile, O_RDONLY)) >= 0) {
-    n = read(fd, buf.bytes, 127);
-    close(fd);
-    if (n > 0) {
-      pid = -1;
-      if (n == 4)
-        /* Kermit-style lockfile. */
-        pid = buf.kermit;
-      else {
-        /* Ascii lockfile. */
-        buf.bytes[n] = 0;
-        sscanf(buf.bytes, "%d", &pid);
-      }
-      if (pid > 0 && kill((pid_t)pid, 0) < 0 &&
-          errno == ESRCH) {
-        fprintf(stderr, _("Lockfile is stale. Overriding it..\n"));
-        sleep(1);
-        unlink(lockfile);
-      } else
-        n = 0;
-    }
-    if (n == 0) {
-      if (stdwin)
-        mc_wclose(stdwin, 1);
-      fprintf(stderr, _("Device %s is locked.\n"), dial_tty);
-      return -1;
-    }
+  if (doinit > 0 && lockfile_busy(lockfile)) {
+    if (stdwin)
+      mc_wclose(stdwin, 1);
+    fprintf(stderr, _("Device %s is locked.\n"), dial_tty);
+    return -1;
   }
 #endif
 
@@ -416,33 +444,12 @@ nolock:
 }
 
 
-/* Function to write output. */
+/* Function to write output. It is sent by tx_flush(). */
 static void do_output(const char *s, int len)
 {
-  char buf[256];
-
   if (len == 0)
     len = strlen(s);
-
-  if (P_PARITY[0] == 'M') {
-    int f;
-    for (f = 0; f < len && f < (int)sizeof(buf); f++)
-      buf[f] = *s++ | 0x80;
-    len = f;
-    s = buf;
-  }
-
-  int r;
-  int b = vt_ch_delay ? 1 : len;
-  while (len && (r = write(portfd, s, b)) >= 0)
-    {
-      s   += r;
-      len -= r;
-      if (vt_ch_delay)
-        usleep(vt_ch_delay * 1000);
-      else
-        b = len;
-    }
+  tx_put(s, len, P_PARITY[0] == 'M');
 }
 
 /* Function to handle keypad mode switches. */
@@ -462,6 +469,7 @@ void init_emul(int type, int do_init)
   char attr = 0;
   int maxy;
   int ypos;
+  int x1, y1, x2, y2;
 
   if (st) {
     mc_wclose(st, 1);
@@ -496,12 +504,16 @@ void init_emul(int type, int do_init)
   num_hist_lines = atoi(P_HISTSIZE);
   if (num_hist_lines < 0)
     num_hist_lines = 0;
-  if (num_hist_lines > 5000)
-    num_hist_lines = 5000;
+  if (num_hist_lines > 999999)
+    num_hist_lines = 999999;
 
-  /* Open a new main window, and define the configured history buffer size. */
-  us = mc_wopen(0, 0, COLS - 1, maxy,
+  /* Open a new main window, and define the configured history buffer size.
+   * With --pane ports it only gets its tile of the screen. */
+  pane_main(maxy, &x1, &y1, &x2, &y2);
+  us = mc_wopen(x1, y1, x2, y2,
               BNONE, XA_NORMAL, tfcolor, tbcolor, 1, num_hist_lines, 0);
+  if (hist_file && us->histbuf && hist_spill(us->histbuf, hist_file) < 0)
+    werror(_("Cannot open history file %s"), hist_file);
 
   if (x >= 0) {
     mc_wlocate(us, x, y);
@@ -514,6 +526,10 @@ void init_emul(int type, int do_init)
   terminal = type;
   lines = LINES - (st != NULL);
   cols = COLS;
+  if (npanes) {
+    lines = us->ys;
+    cols = us->xs;
+  }
 
   /* Install and reset the terminal emulator. */
   if (do_init) {
@@ -522,6 +538,7 @@ void init_emul(int type, int do_init)
   } else
     vt_pinit(us, -1, -1);
 
+  pane_wopen(maxy);
   show_status();
 }
 
@@ -532,6 +549,7 @@ void init_emul(int type, int do_init)
 static void ret_csr(void)
 {
   mc_wlocate(us, us->curx, us->cury);
+  pane_cursor();
   mc_wflush();
 }
 
@@ -644,6 +662,33 @@ static void show_status_fmt(const char *fmt)
                 }
               break;
 
+            case 'r':
+              bufi += snprintf(buf + bufi, COLS - bufi, "%luB/rd %zuk",
+                               rx_stats.reads ? rx_stats.bytes / rx_stats.reads : 0,
+                               rx_stats.size / 1024);
+              if (rxt_enabled && bufi < COLS)
+                bufi += snprintf(buf + bufi, COLS - bufi, " ring %zu%% drop %lu",
+                                 rx_stats.ring_size ?
+                                 rx_stats.ring_peak * 100 / rx_stats.ring_size : 0,
+                                 rx_stats.dropped);
+              break;
+
+            case 'R':
+            case 'S':
+            case 'E':
+            case 'O':
+                {
+                  char b[16];
+
+                  stats_rate(b, sizeof(b),
+                             func == 'R' ? mc_stats.rx_rate :
+                             func == 'S' ? mc_stats.tx_rate :
+                             func == 'E' ? mc_stats.vt_rate :
+                             mc_stats.scr_rate);
+                  bufi += snprintf(buf + bufi, COLS - bufi, "%s", b);
+                }
+              break;
+
             case '$':
               bufi += snprintf(buf + bufi, COLS - bufi, "%s", status_message);
               break;
@@ -810,22 +855,454 @@ static void showtemp(void)
   tempst = 1;
 }
 
+int render_fps = 60;		/* -O fps=N, 0 draws everything at once */
+static struct timeval last_frame;
+static int frame_timer = -1;
+
+static void frame_due(int id, void *data)
+{
+  (void)id;
+  (void)data;
+  frame_timer = -1;
+  mc_wframe();
+  gettimeofday(&last_frame, NULL);
+}
+
+/*
+ * Put what changed on the screen, but not more than render_fps times
+ * a second. The first update after a quiet spell is drawn right away
+ * so typing stays snappy; during a burst the rest waits for a timer.
+ */
+static void render(void)
+{
+  struct timeval now;
+  long ms, period;
+
+  if (!mc_wpending() || frame_timer >= 0)
+    return;
+  period = 1000 / render_fps;
+  gettimeofday(&now, NULL);
+  ms = (now.tv_sec - last_frame.tv_sec) * 1000 +
+       (now.tv_usec - last_frame.tv_usec) / 1000;
+  if (ms >= 0 && ms < period &&
+      (frame_timer = ev_timer_add(period - ms, 0, frame_due, NULL)) >= 0)
+    return;
+  mc_wframe();
+  last_frame = now;
+}
+
+/* Draw what is left and go back to updating the screen directly. */
+static void render_stop(void)
+{
+  if (frame_timer >= 0) {
+    ev_timer_del(frame_timer);
+    frame_timer = -1;
+  }
+  mc_wdefer(0);
+}
+
 /*
  * The main terminal loop:
  *	- If there are characters received send them
  *	  to the screen via the appropriate translate function.
  */
+/*
+ * The port is gone, most probably someone unplugged the USB-serial. We
+ * need to free the FD so that a replug can get the same device filename,
+ * open it again and be back. Returns what open_term() returned.
+ */
+static int reopen_port(void)
+{
+  int reopen = portfd == -1;
+
+  rxt_stop();
+  ev_io_del(portfd);
+  close(portfd);
+  lockfile_remove();
+  portfd = -1;
+  return open_term(reopen, reopen, 1);
+}
+
+static volatile int headless_stop;
+
+static void headless_sig(int sig)
+{
+  (void)sig;
+  headless_stop = 1;
+}
+
+/*
+ * Terminal mode without a screen (--headless). What the port sends
+ * goes to the capture file, or to standard output if there is none,
+ * as it comes in and without terminal emulation; rx_fill() writes it
+ * out, we only have to throw it away afterwards. A port that goes
+ * away is reopened like in do_terminal(). Returns on SIGTERM, SIGHUP
+ * or SIGINT.
+ */
+void do_headless(void)
+{
+  static unsigned long dropped;
+  int x, blen, lost = 0;
+
+  signal(SIGTERM, headless_sig);
+  signal(SIGHUP, headless_sig);
+  signal(SIGINT, headless_sig);
+
+  rx_capture(capfp ? fileno(capfp) : STDOUT_FILENO);
+
+  /* Do the timer and device checks right away. */
+  x = 4;
+
+  while (!headless_stop) {
+    if (stats_dump_pending)
+      stats_dump();
+
+    if (x & (4 | 8))
+      timer_update();
+
+    if ((x & (4 | 8)) && !get_device_status(portfd_connected())) {
+      if (reopen_port() < 0) {
+        if (!lost)
+          fprintf(stderr, _("Cannot open %s!\n"), dial_tty);
+        lost = 1;
+      } else
+        lost = 0;
+    }
+
+    if ((x & 4) && rxt_enabled && !rxt_running() && portfd_connected() >= 0)
+      rxt_start(portfd_connected());
+
+    x = check_io_frontend(NULL, 0, NULL);
+
+    if (x & 4) {
+      rx_idle();
+      stats_tick();
+      if (rx_stats.dropped != dropped) {
+        dropped = rx_stats.dropped;
+        fprintf(stderr, _("Reader overrun, %lu bytes lost\n"), dropped);
+      }
+    }
+
+    if ((x & 1) == 1 && (blen = rx_fill(portfd_connected())) <= 0 &&
+        !(blen < 0 && errno == EAGAIN))
+      x |= 8;
+    rx_consume(rx_used());
+  }
+
+  rxt_stop();
+  rx_capture(-1);
+}
+
+/*
+ * Show received data in hex, or with the parity bit stripped, one
+ * character at a time.
+ */
+static void show_raw(const char *s, int len)
+{
+  wchar_t wc;
+  int c, n;
+
+  while (len > 0) {
+    c = *s;
+    n = 1;
+    if (P_PARITY[0] == 'M' || P_PARITY[0] == 'S')
+      c &= 0x7f;
+    if (display_hex) {
+      unsigned char l = c;
+      unsigned char u = l >> 4;
+      l &= 0xf;
+      vt_out(u > 9 ? 'a' + (u - 10) : '0' + u, 0);
+      vt_out(l > 9 ? 'a' + (l - 10) : '0' + l, 0);
+      vt_out(' ', 0);
+    } else {
+      n = one_mbtowc(&wc, s, len);
+      vt_out(c, wc);
+    }
+    s += n;
+    len -= n;
+  }
+}
+
+/*
+ * Run the data in the receive buffer through the emulator. With
+ * zauto set, stop right after a zmodem signature and return 1.
+ */
+static int rx_show(int zauto, int *zpos)
+{
+  static const char zsig[] = "**\030B00";
+  char obuf[4096];
+  char *ptr;
+  int blen;
+  unsigned long long t0 = stats_ns(), r0 = mc_stats.render_ns;
+
+  vt_rxtime(rx_arrival());
+  while ((blen = rx_peek(&ptr)) > 0) {
+    size_t pending = 0;
+
+    if (using_iconv()) {
+      char *otmp = obuf;
+      size_t output_len = sizeof(obuf);
+      /* Leave room for the conversion to expand the text. */
+      size_t input_len = blen > (int)sizeof(obuf) / 4 ?
+                         sizeof(obuf) / 4 : (size_t)blen;
+      char *iptr = ptr;
+      size_t chunk = input_len;
+
+      do_iconv(&iptr, &input_len, &otmp, &output_len);
+
+      // something happened at all?
+      if (output_len < sizeof(obuf))
+        {
+          rx_consume(chunk - input_len);
+          pending = input_len;
+          blen = sizeof(obuf) - output_len;
+          ptr = obuf;
+        }
+      else
+        rx_consume(blen);
+    } else {
+      rx_consume(blen);
+    }
+
+    mc_stats.vt_bytes += blen;
+    while (blen > 0) {
+      int n = blen;
+
+      /* Auto zmodem detect: stop right after the signature. */
+      if (zauto)
+        for (n = 0; n < blen && zsig[*zpos]; n++)
+          *zpos = zsig[*zpos] == ptr[n] ? *zpos + 1 : 0;
+      if (display_hex || P_PARITY[0] == 'M' || P_PARITY[0] == 'S')
+        show_raw(ptr, n);
+      else
+        vt_feed(vt_main, ptr, n);
+      blen -= n;
+      ptr += n;
+      if (zauto && zsig[*zpos] == 0)
+        return 1;
+    }
+
+    /* An incomplete character is all that is left: wait for more. */
+    if (pending && pending == rx_used())
+      break;
+  }
+  vt_rxtime(NULL);
+  mc_wflush();
+  /* Not counting what went to the terminal on the way. */
+  mc_stats.parse_ns += stats_ns() - t0 - (mc_stats.render_ns - r0);
+  return 0;
+}
+
+/*
+ * Menus and the history view wait for keys in wxgetch(), and while
+ * they do, nothing would read the port: on a fast line the kernel
+ * buffer overflows. So wxgetch() keeps reading it into the receive
+ * buffer, which terminal mode then shows as if it had just come in.
+ * Only for what does not talk to the port itself, see main() in
+ * minicom.c.
+ */
+static int ingest_on;		/* Reading the port in wxgetch() */
+static int ingest_tell;		/* wxgetch() returns K_PORT for new data */
+static long long ingest_told;	/* When it last did, in ms */
+
+static int ingest(int ready)
+{
+  struct timeval tv;
+  long long ms;
+  int n;
+
+  if (ready && (((n = rx_fill(portfd_connected())) <= 0 &&
+                 !(n < 0 && errno == EAGAIN)) || rx_full())) {
+    /* Full, or trouble with the port: the main loop sees to it. */
+    wxgetch_bg(-1, 0, NULL);
+    return 0;
+  }
+  if (!ingest_tell || rx_used() == 0)
+    return 0;
+  /* Not more than ten times a second. */
+  gettimeofday(&tv, NULL);
+  ms = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+  if (ms - ingest_told < 100)
+    return 0;
+  ingest_told = ms;
+  return 1;
+}
+
+void ingest_start(void)
+{
+  if (ingest_on || portfd_connected() < 0)
+    return;
+  ingest_on = 1;
+  rx_hold(1);
+  wxgetch_bg(portfd_connected(), ingest_tell ? 100 : 0, ingest);
+}
+
+void ingest_stop(void)
+{
+  if (ingest_on) {
+    wxgetch_bg(-1, 0, NULL);
+    rx_hold(0);
+    ingest_on = 0;
+  }
+}
+
+/* Have wxgetch() return K_PORT when new data is waiting. */
+void ingest_report(int on)
+{
+  ingest_tell = on;
+  if (ingest_on) {
+    ingest_on = 0;
+    ingest_start();
+  }
+}
+
+/*
+ * Run the data read so far through the emulator without drawing
+ * it: the history view covers the screen. No auto zmodem here.
+ */
+void ingest_show(void)
+{
+  WIN *w = vt_window(vt_main);
+  char d0 = w->direct, d1 = us->direct;
+
+  w->direct = us->direct = 0;
+  rx_show(0, NULL);
+  w->direct = d0;
+  us->direct = d1;
+  tx_flush();
+}
+
+double replay_speed;		/* -O speed=N, 0 is as fast as we can */
+double replay_from;		/* -O from=SECONDS into a recording */
+const char *replay_dump;	/* -O dump=FILE gets the screen at the end */
+
+/*
+ * Wait until stats_ns() is at due, drawing what changed when a frame
+ * is due. Returns 1 if a key was pressed, which stops playback.
+ */
+static int replay_wait(unsigned long long due, unsigned long long period,
+                       unsigned long long *frame)
+{
+  static int no_keys;		/* stdin is at EOF */
+  unsigned long long now, until;
+  struct pollfd pfd;
+  ssize_t n;
+  char c;
+
+  while ((now = stats_ns()) < due) {
+    until = due;
+    if (period && mc_wpending()) {
+      if (now - *frame >= period) {
+        mc_wframe();
+        *frame = now;
+      } else if (*frame + period < until)
+        until = *frame + period;
+    }
+    /* poll() just sleeps on a negative fd. */
+    pfd.fd = no_keys ? -1 : STDIN_FILENO;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, (until - now + 999999) / 1000000) > 0) {
+      if ((n = read(STDIN_FILENO, &c, 1)) == 1)
+        return 1;
+      if (n == 0 || (errno != EINTR && errno != EAGAIN))
+        no_keys = 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Feed a capture of what a port sent (--replay) through the emulator
+ * and onto the screen, in reads of the size the port gave us, with
+ * the frames terminal mode would draw. A raw capture goes as fast as
+ * we can; a recording (-O record) at replay_speed times the speed it
+ * came in, starting replay_from seconds into it. To have the screen
+ * right there, what came in before that is run through the emulation
+ * without drawing it, from the index entry before (see record.c).
+ * What it cost goes into report. Returns -1 if the file can not be
+ * read.
+ */
+int do_replay(const char *file, char *report, size_t len)
+{
+  char buf[REC_CHUNK];
+  unsigned long long t0, t1, frame = 0, period = 0;
+  unsigned long long bytes = 0, from = 0, ns = 0, base = 0;
+  double secs;
+  int recorded, warm = 0, type = REC_RX, n;
+  FILE *fp;
+
+  if ((fp = fopen(file, "r")) == NULL) {
+    snprintf(report, len, "%s: %s\n", file, strerror(errno));
+    return -1;
+  }
+  memset(&mc_stats, 0, sizeof(mc_stats));
+  if ((recorded = rec_check(fp)) && replay_from > 0) {
+    from = replay_from * 1e9;
+    rec_seek(fp, file, from);
+    warm = 1;
+  }
+  if (render_fps > 0)
+    period = 1000000000ULL / render_fps;
+  if (period || warm)
+    mc_wdefer(1);
+  t0 = stats_ns();
+  while (1) {
+    if (!recorded)
+      n = fread(buf, 1, 4096, fp);
+    else if ((n = rec_next(fp, &type, &ns, buf, sizeof(buf))) > 0 &&
+             type != REC_RX)
+      continue;
+    if (n <= 0)
+      break;
+    if (warm && ns >= from) {
+      /* Caught up: show it, and play on from here. */
+      warm = 0;
+      if (!period)
+        mc_wdefer(0);
+      else
+        mc_wframe();
+      frame = stats_ns();
+    }
+    if (recorded && !warm && replay_speed > 0) {
+      if (!base)
+        base = stats_ns() - (ns - from) / replay_speed;
+      if (replay_wait(base + (ns - from) / replay_speed, period, &frame))
+        break;
+    }
+    bytes += n;
+    rx_put(buf, n);
+    rx_show(0, NULL);
+    /* Like render(): not more than render_fps frames a second. */
+    if (period && !warm && stats_ns() - frame >= period) {
+      mc_wframe();
+      frame = stats_ns();
+    }
+  }
+  mc_wdefer(0);
+  mc_wflush();
+  t1 = stats_ns();
+  fclose(fp);
+
+  secs = (t1 - t0) / 1e9;
+  snprintf(report, len,
+           _("replay %s: %llu bytes in %.3f s, %.1f MB/s\n"
+             "  emulation %.3f s, screen %.3f s, %llu frames\n"
+             "  terminal output %llu bytes in %llu writes\n"),
+           file, bytes, secs, secs > 0 ? bytes / secs / 1e6 : 0.0,
+           mc_stats.parse_ns / 1e9, mc_stats.render_ns / 1e9,
+           mc_stats.frames, mc_stats.scr_bytes, mc_stats.scr_writes);
+  return n < 0 ? -1 : 0;
+}
+
 int do_terminal(void)
 {
-  char buf[128];
-  int buf_offset = 0;
   int c;
   int x;
   int blen;
   int zauto = 0;
-  static const char zsig[] = "**\030B00";
   int zpos = 0;
   const char *s;
+  static unsigned long dropped;
   dirflush = 0;
   WIN *error_on_open_window = NULL;
 
@@ -849,12 +1326,27 @@ dirty_goto:
 
   keyboard(KSTART, 0);
 
+  /* The --pane ports are read while we are in terminal mode. */
+  pane_start();
+
+  /* Collect screen updates and draw them at most render_fps a second. */
+  if (render_fps > 0)
+    mc_wdefer(1);
+
+  /* Do the timer and device checks right away. */
+  x = 4;
+
   /* Main loop */
   while (1) {
+    /* Statistics asked for with SIGUSR1. */
+    if (stats_dump_pending)
+      stats_dump();
     /* See if window size changed */
     if (size_changed) {
+      render_stop();
       wrapln = us->wrap;
       /* I got the resize code going again! Yeah! */
+      pane_wclose();
       mc_wclose(us, 0);
       us = NULL;
       if (st)
@@ -867,20 +1359,19 @@ dirty_goto:
       setcbreak(2); /* Raw, no echo */
       init_emul(terminal, 0);
       size_changed = 0;
+      if (render_fps > 0)
+        mc_wdefer(1);
     }
-    /* Update the timer. */
-    timer_update();
+    /*
+     * Update the timer and check the device once a second, when we
+     * come back from a menu, or when the port reported an error.
+     */
+    if (x & (4 | 8))
+      timer_update();
 
     /* check if device is ok, if not, try to open it */
-    if (!get_device_status(portfd_connected())) {
-      /* Ok, it's gone, most probably someone unplugged the USB-serial, we
-       * need to free the FD so that a replug can get the same device
-       * filename, open it again and be back */
-      int reopen = portfd == -1;
-      close(portfd);
-      lockfile_remove();
-      portfd = -1;
-      if (open_term(reopen, reopen, 1) < 0) {
+    if ((x & (4 | 8)) && !get_device_status(portfd_connected())) {
+      if (reopen_port() < 0) {
         if (!error_on_open_window)
           error_on_open_window = mc_tell(_("Cannot open %s!"), dial_tty);
       } else {
@@ -891,89 +1382,65 @@ dirty_goto:
       }
     }
 
-    /* Check for I/O or timer. */
-    x = check_io_frontend(buf + buf_offset, sizeof(buf) - buf_offset, &blen);
-    blen += buf_offset;
-    buf_offset = 0;
-
-    /* Data from the modem to the screen. */
-    if ((x & 1) == 1) {
-      char obuf[sizeof(buf)];
-      char *ptr;
-
-      if (using_iconv()) {
-        char *otmp = obuf;
-        size_t output_len = sizeof(obuf);
-        size_t input_len = blen;
-
-        ptr = buf;
-        do_iconv(&ptr, &input_len, &otmp, &output_len);
-
-        // something happened at all?
-        if (output_len < sizeof(obuf))
-          {
-            if (input_len)
-              { // something remained, we need to adapt buf accordingly
-                memmove(buf, ptr, input_len);
-                buf_offset = input_len;
-              }
-
-            blen = sizeof(obuf) - output_len;
-            ptr = obuf;
-          }
-	else
-	  ptr = buf;
-      } else {
-        ptr = buf;
+    /* (Re)start the reader thread if we use one. */
+    if ((x & 4) && rxt_enabled && !rxt_running() && portfd_connected() >= 0)
+      rxt_start(portfd_connected());
+
+    /* Send what we have for the port, draw the screen if it is time,
+     * then check for I/O or timer. */
+    tx_flush();
+    render();
+    x = check_io_frontend(NULL, 0, NULL);
+
+    /* Once a second, let the receive buffer shrink if it is idle. */
+    if (x & 4) {
+      rx_idle();
+      stats_tick();
+      pane_tick();
+      if (rx_stats.dropped != dropped) {
+        char msg[80];
+
+        dropped = rx_stats.dropped;
+        snprintf(msg, sizeof(msg), _("Reader overrun, %lu bytes lost"),
+                 dropped);
+        status_set_display(msg, 5);
       }
+    }
 
-      while (blen > 0) {
-	int c = *ptr;
-        /* Auto zmodem detect */
-        if (zauto) {
-          if (zsig[zpos] == c)
-            zpos++;
-          else
-            zpos = 0;
-        }
-        if (P_PARITY[0] == 'M' || P_PARITY[0] == 'S')
-          c &= 0x7f;
-        if (display_hex) {
-          unsigned char l = c;
-          unsigned char u = l >> 4;
-          l &= 0xf;
-          vt_out(u > 9 ? 'a' + (u - 10) : '0' + u, 0);
-          vt_out(l > 9 ? 'a' + (l - 10) : '0' + l, 0);
-          vt_out(' ', 0);
-
-          --blen;
-          ++ptr;
-        } else {
-          wchar_t wc;
-          size_t len = one_mbtowc(&wc, ptr, blen);
-          vt_out(c, wc);
-          blen -= len;
-          ptr += len;
-        }
-        if (zauto && zsig[zpos] == 0) {
-          dirflush = 1;
-          keyboard(KSTOP, 0);
-          updown('D', zauto - 'A');
-          dirflush = 0;
-          zpos = 0;
-          blen = 0;
-          goto dirty_goto;
-        }
-      }
-      mc_wflush();
+    /* Drain the port into the receive buffer. */
+    if ((x & 1) == 1 && (blen = rx_fill(portfd_connected())) <= 0 &&
+        !(blen < 0 && errno == EAGAIN))
+      x |= 8;
+
+    /* Data from the modem to the screen. */
+    if (rx_used() > 0 && rx_show(zauto, &zpos)) {
+      dirflush = 1;
+      keyboard(KSTOP, 0);
+      rxt_stop();
+      pane_stop();
+      render_stop();
+      tx_flush();
+      vt_rxtime(NULL);
+      rx_consume(rx_used());
+      updown('D', zauto - 'A');
+      dirflush = 0;
+      zpos = 0;
+      goto dirty_goto;
     }
 
+    /* Data from the --pane ports. */
+    pane_io();
+
     /* Read from the keyboard and send to modem. */
     if ((x & 2) == 2) {
       /* See which key was pressed. */
       c = keyboard(KGETKEY, 0);
-      if (c == EOF)
+      if (c == EOF) {
+        rxt_stop();
+        pane_stop();
+        render_stop();
         return EOF;
+      }
 
       if (c < 0) /* XXX - shouldn't happen */
         c += 256;
@@ -986,6 +1453,9 @@ dirty_goto:
         /* Stop keyserv process if we have it. */
         keyboard(KSTOP, 0);
 
+        /* The command may wait for a key: show the screen as it is. */
+        render_stop();
+
         /* Show status line temporarily */
         showtemp();
         if (c == escape) /* CTRL A */
@@ -999,6 +1469,9 @@ dirty_goto:
         if (c > 128)
           c -= 128;
         if (c > ' ') {
+          /* The menus talk to the port directly. */
+          rxt_stop();
+          pane_stop();
           dirflush = 1;
           m_flush(0);
           return c;
@@ -1012,6 +1485,12 @@ dirty_goto:
         goto dirty_goto;
       }
 
+      /* A key for the port in another pane? */
+      if (pane_focused()) {
+        pane_send(c);
+        continue;
+      }
+
       /* No, just a key to be sent. */
       if (((c >= K_F1 && c <= K_F10) || c == K_F11 || c == K_F12)
 	  && P_MACENAB[0] == 'Y') {
@@ -49,6 +49,11 @@ static const char option_string[] =
 #define RESET 1
 #define NORESET 2
 
+/* Long options without a short one. */
+#define OPT_HEADLESS 256
+#define OPT_PANE 257
+#define OPT_REPLAY 258
+
 #ifdef DEBUG
 /* Show signals when debug is on. */
 static void signore(int sig)
@@ -61,6 +66,7 @@ static void signore(int sig)
 #endif /*DEBUG*/
 
 static int line_timestamp;
+static int capture_raw;		/* -O capture=raw */
 
 /*
  * Sub - menu's.
@@ -74,9 +80,20 @@ static const char *c7[] = { N_("   Yes  "), N_("   No   "), NULL };
 /* Initialize modem port. */
 void port_init(void)
 {
-  m_setparms(portfd, P_BAUDRATE, P_PARITY, P_BITS, P_STOPB,
+  port_init_fd(portfd, NULL, NULL, NULL, NULL);
+  pane_port_init();
+}
+
+/*
+ * Set the configured port parameters on fd. A speed or format given
+ * (a --pane port's own) is used instead of the configured one.
+ */
+void port_init_fd(int fd, char *baudr, char *par, char *bits, char *stopb)
+{
+  m_setparms(fd, baudr ? baudr : P_BAUDRATE, par ? par : P_PARITY,
+             bits ? bits : P_BITS, stopb ? stopb : P_STOPB,
              P_HASRTS[0] == 'Y', P_HASXON[0] == 'Y', P_RS485_EN[0] == 'Y');
-  m_set485parms(portfd, P_RS485_EN[0] == 'Y',
+  m_set485parms(fd, P_RS485_EN[0] == 'Y',
                 P_RS485_RTS_ON_SEND[0] == 'Y',
                 P_RS485_RTS_AFTER_SEND[0] == 'Y',
                 P_RS485_RX_DURING_TX[0] == 'Y',
@@ -102,8 +119,7 @@ static void hangsig(int sig)
 {
   if (stdwin)
     werror(_("Killed by signal %d !\n"), sig);
-  if (capfp)
-    fclose(capfp);
+  cap_close();
 
   keyboard(KUNINSTALL, 0);
   hangup();
@@ -169,12 +185,24 @@ static void shjump(int sig)
 }
 #endif /*SIGTSTP*/
 
+/* Lines in the history, with those only in the history file. */
+static int histsize(void)
+{
+  return us->histlines + hist_spilled(us->histbuf);
+}
+
 /* Get a line from either window or scroll back buffer. */
 static ELM *mc_getline(WIN *w, int no)
 {
   int i;
   static ELM outofrange[MAXCOLS] = {{0,0,0}};
 
+  /* Lines before those in memory are in the history file. */
+  i = hist_spilled(us->histbuf);
+  if (no < i)
+    return hist_old(us->histbuf, no);
+  no -= i;
+
   if (no < us->histlines) {
     /* Get a line from the history buffer. */
     i = no + us->histline /*- 1*/;
@@ -182,7 +210,7 @@ static ELM *mc_getline(WIN *w, int no)
       i -= us->histlines;
     if (i < 0)
       i = us->histlines - 1;
-    return us->histbuf + (i * us->xs);
+    return hist_get(us->histbuf, i);
   }
 
   /* Get a line from the "us" window. */
@@ -201,6 +229,39 @@ static ELM *mc_getline(WIN *w, int no)
   return w->map + (no * us->xs);
 }
 
+/*
+ * The text of a line, for searching. Lines in the history are not
+ * turned back into cells for this, see hist_text().
+ */
+static const char *mc_gettext(WIN *w, int no, int *len)
+{
+  int i, n = no;
+
+  i = hist_spilled(us->histbuf);
+  if (n < i)
+    return hist_old_text(us->histbuf, n, len);
+  n -= i;
+  if (n < us->histlines) {
+    i = n + us->histline;
+    if (i >= us->histlines)
+      i -= us->histlines;
+    return hist_text(us->histbuf, i, len);
+  }
+  return elm_text(mc_getline(w, no), us->xs, len);
+}
+
+/* Does line no have what we look for? */
+static int mc_matches(WIN *w, int no, struct search *look)
+{
+  const char *text;
+  int len;
+
+  if (look == NULL)
+    return 0;
+  text = mc_gettext(w, no, &len);
+  return search_line(look, text, len);
+}
+
 /* Redraw the window. */
 static void drawhist(WIN *w, int y, int r)
 {
@@ -221,27 +282,17 @@ static void drawhist(WIN *w, int y, int r)
  * pattern 'look'
  * Needed by re-draw screen function after EACH find_next()
  */
-void drawhist_look(WIN *w, int y, int r, wchar_t *look, int case_matters)
+void drawhist_look(WIN *w, int y, int r, struct search *look)
 {
   int f;
-  ELM *tmp_e;
-  wchar_t tmp_line[MAXCOLS];
 
-  tmp_line[0]='\0';
   w->direct = 0;
-  for (f = 0; f < w->ys; f++) {
-    tmp_e = mc_getline(w, y++);
-
-    /* First we "accumulate" the line into a variable */
-    mc_wdrawelm_var(w, tmp_e, tmp_line);
-
+  for (f = 0; f < w->ys; f++, y++) {
     /* Does it have what we want? */
-    if (wcslen(look) > 1 && wcslen(tmp_line) > 1) {
-      if (StrStr(tmp_line,look, case_matters))
-        mc_wdrawelm_inverse(w, f, tmp_e); /* 'inverse' it */
-      else
-        mc_wdrawelm(w, f, tmp_e); /* 'normal' output */
-    }
+    if (mc_matches(w, y, look))
+      mc_wdrawelm_inverse(w, f, mc_getline(w, y)); /* 'inverse' it */
+    else
+      mc_wdrawelm(w, f, mc_getline(w, y)); /* 'normal' output */
   }
 
   if (r)
@@ -304,42 +355,30 @@ void searchhist(WIN *w_hist, wchar_t *str)
  */
 int find_next(WIN *w, WIN *w_hist,
               int hit_line,     /* 'current' Match line */
-              wchar_t *look,    /* pattern */
-              int case_matters) /* guess... */
+              struct search *look) /* pattern, from search_new() */
 {
   int next_line;
-  ELM *tmp_e;
-  wchar_t tmp_line[MAXCOLS];
   int all_lines;
 
+  (void)w;
   if (!look)
     return(++hit_line); /* next line */
 
-  tmp_line[0] = '\0';	/* Personal phobia, I need to do this.. */
-
   hit_line++;           /* we NEED this so we don't search only same line! */
-  all_lines = w->histlines + w_hist->ys;
+  all_lines = histsize() + w_hist->ys;
 
   if (hit_line >= all_lines) {	/* Make sure we've got a valid line! */
     werror(_("Search Wrapping Around to Start!"));
     hit_line = 0;
   }
 
-  for (next_line = hit_line; next_line <= all_lines; next_line++) {
-    /* we do 'something' here... :-) */
-    tmp_e = mc_getline(w_hist, next_line);
-
-    /*
-     * First we "accumulate" the line into a variable.
-     * To see 'why', see what an 'ELM' structure looks like!
-     */
-    mc_wdrawelm_var(w, tmp_e, tmp_line);
-
-    /* Does it have what we want? */
-    if (wcslen(tmp_line) > 1 && wcslen(look) > 1)
-      if (StrStr(tmp_line, look, case_matters))
-        return next_line;
-  }
+  /*
+   * The lines are searched as text, without turning them back
+   * into cells first.
+   */
+  for (next_line = hit_line; next_line < all_lines; next_line++)
+    if (mc_matches(w_hist, next_line, look))
+      return next_line;
 
   if (hit_line >= all_lines) {	/* Make sure we've got a valid line! */
     werror(_("Search Wrapping Around to Start!"));
@@ -350,33 +389,24 @@ int find_next(WIN *w, WIN *w_hist,
 }
 
 /*
- * fmg 8/22/97
- * Needed this for the case-less comparison... and Linux libc
- * doesn't seem to have a strnstr function... so we fudge.. ;-)
- */
-const wchar_t *upcase(wchar_t *dest, wchar_t *src)
-{
-  wchar_t *d = dest;
-
-  while (*src)
-    *d++ = towupper(*src++);
-  *d = '\0';
-  return dest;
-}
-
-/*
- * fmg 8/22/97
- * Needed this for the case-less comparison... and Linux libc
- * doesn't seem to have a strnstr function... so we fudge.. ;-)
+ * The help line of the history view, and how many lines came in
+ * since we left the end.
  */
-wchar_t *StrStr(wchar_t *str1, wchar_t *str2, int case_matters)
+static void hist_help(WIN *w, const char *hline, int newlines)
 {
-  wchar_t tmpstr1[MAXCOLS], tmpstr2[MAXCOLS];
-
-  if (case_matters)
-    return wcsstr(str1, str2);
-  else
-    return wcsstr(upcase(tmpstr1, str1), upcase(tmpstr2, str2));
+  char buf[32];
+  int n;
+
+  mc_wlocate(w, 0, 0);
+  mc_wprintf(w, "%s", hline);
+  if (newlines > 0) {
+    n = snprintf(buf, sizeof(buf), _(" %d new, G=End "), newlines);
+    if (n < w->xs) {
+      mc_wlocate(w, w->xs - n, 0);
+      mc_wprintf(w, "%s", buf);
+    }
+  }
+  mc_wredraw(w, 1);
 }
 
 static void drawcite(WIN *w, int y, int citey, int start, int end)
@@ -422,6 +452,7 @@ static void do_cite(WIN *w, int start, int end)
     }
     vt_send(13);
   }
+  tx_flush();
 }
 
 /* Scroll back */
@@ -429,16 +460,17 @@ static void scrollback(void)
 {
   int y,c;
   WIN *b_us, *b_st;
-  ELM *tmp_e;
-  int case_matters=0;	/* fmg: case-importance, needed for 'N' */
-  static wchar_t look_for[MAX_SEARCH];	/* fmg: last used search pattern */
-  wchar_t tmp_line[MAXCOLS];
+  static wchar_t look_for[MAX_SEARCH + 1];	/* fmg: last used search pattern */
+  static struct search *matcher;	/* look_for, ready to search with */
   int citemode = 0;
-  int cite_ystart = 1000000,
+  int cite_ystart = INT_MAX,
       cite_yend = -1,
       cite_y = 0;
   int inverse;
   int loop = 1;
+  int newlines = 0;	/* Came in while we were not at the end */
+  unsigned long added;
+  int size, shift;
 
   char hline0[128], hline1[128], *hline;
   static int hit=0;
@@ -467,7 +499,7 @@ static void scrollback(void)
    * Hope you like it :-)
    */
   strcpy(hline0,
-         _("HISTORY: U=Up D=Down F=PgDn B=PgUp s=Srch S=CaseLess N=Next C=Cite ESC=Exit "));
+         _("HISTORY: U=Up D=Down F=PgDn B=PgUp s=Srch r=Regex N=Next #=Count C=Cite ESC=Exit "));
 
   if (b_st->xs < 127)
     hline0[b_st->xs] = 0;
@@ -477,7 +509,7 @@ static void scrollback(void)
   mc_wflush();
 
   /* And do the job. */
-  y = us->histlines;
+  y = histsize();
 
   /* fmg 8/20/97
    * Needed for N)extSearch, keeps track of line on which current "hit"
@@ -489,22 +521,26 @@ static void scrollback(void)
   drawhist(b_us, y, 0);
 
   while (loop) {
+    /* Show what the port sends while we are here, see K_PORT. */
+    ingest_report(1);
     c = wxgetch();
+    ingest_report(0);
     switch (c) {
       /*
        * fmg 8/22/97
        * Take care of the search key: Caseless
        */
+      /*
+       * fmg 8/22/97
+       * Take care of the search keys: Exact Match, Caseless, and the
+       * same for a regular expression.
+       */
       case '\\':
       case 'S':
-        case_matters = 0; /* case-importance, ie. none :-) */
-        /*
-         * fmg 8/22/97
-         * Take care of the search key: Exact Match
-         */
-	/* FALLTHRU */
       case '/':
       case 's':
+      case 'r':
+      case 'R':
         if (!us->histlines) {
           mc_wbell();
           werror(_("History buffer Disabled!"));
@@ -518,19 +554,25 @@ static void scrollback(void)
         if (citemode)
           break;
 
-        /* we need this for the case-importance-toggle to work.. */
-        if (c == '/' || c == 's')
-          case_matters=1; /* case-importance, ie. DOES */
-
         /* open up new search window... */
         searchhist(b_us, look_for);
         /* must redraw status line... */
-        mc_wlocate(b_st, 0, 0); /* move back to column 0! */
-        mc_wprintf(b_st, "%s", hline); /* and show the above-defined hline */
-        mc_wredraw(b_st, 1); /* again... */
+        hist_help(b_st, hline, newlines);
+
+        search_free(matcher);
+        matcher = NULL;
+        if (look_for[0]) {
+          matcher = search_new(look_for, c == '/' || c == 's' || c == 'r',
+                               c == 'r' || c == 'R');
+          if (matcher == NULL) {
+            mc_wbell();
+            werror(_("Bad regular expression"));
+            break;
+          }
+        }
         /* highlight any matches */
-        if (wcslen(look_for) > 1) {
-          hit = find_next(us, b_us, y, look_for, case_matters);
+        if (matcher) {
+          hit = find_next(us, b_us, y, matcher);
 
           if (hit == -1) {
             mc_wbell();
@@ -538,7 +580,7 @@ static void scrollback(void)
             hit = 0;
             break;
           }
-          drawhist_look(b_us, hit, 1, look_for, case_matters);
+          drawhist_look(b_us, hit, 1, matcher);
           y = hit;
         } else {
           mc_wbell();
@@ -557,8 +599,8 @@ static void scrollback(void)
         /* highlight NEXT match */
         if (citemode)
           break;
-        if (wcslen(look_for) > 1) {
-          hit = find_next(us, b_us, y, look_for, case_matters);
+        if (matcher) {
+          hit = find_next(us, b_us, y, matcher);
 
           if (hit == -1) {
             mc_wbell();
@@ -566,7 +608,7 @@ static void scrollback(void)
             hit = 0;
             break;
           }
-          drawhist_look(b_us, hit, 1, look_for, case_matters);
+          drawhist_look(b_us, hit, 1, matcher);
           y = hit;
         } else	{ /* no search pattern... */
           mc_wbell();
@@ -574,13 +616,32 @@ static void scrollback(void)
         }
         mc_wflush();
         break;
+      case '#':
+        /* How many lines have the pattern? */
+        if (citemode)
+          break;
+        if (matcher) {
+          WIN *w;
+          int n = 0, all_lines = histsize() + b_us->ys;
+
+          for (c = 0; c < all_lines; c++)
+            n += mc_matches(b_us, c, matcher);
+          w = mc_tell(_("%d of %d lines match"), n, all_lines);
+          wxgetch();
+          mc_wclose(w, 1);
+        } else	{ /* no search pattern... */
+          mc_wbell();
+          werror(_("No previous search!\n  Please 's' or 'S' first!"));
+        }
+        mc_wflush();
+        break;
 
       case 'u':
       case 'U':
       case K_UP:
         if (citemode && cite_y) {
           cite_y--;
-          if (cite_ystart != 1000000) {
+          if (cite_ystart != INT_MAX) {
             cite_yend = y + cite_y;
             drawcite(b_us, cite_y+1, y, cite_ystart, cite_yend);
             drawcite(b_us, cite_y, y, cite_ystart, cite_yend);
@@ -591,7 +652,7 @@ static void scrollback(void)
         if (y <= 0)
           break;
         y--;
-        if (cite_ystart != 1000000)
+        if (cite_ystart != INT_MAX)
           cite_yend = y + cite_y;
         mc_wscroll(b_us, S_DOWN);
 
@@ -604,14 +665,8 @@ static void scrollback(void)
         if (citemode) {
           inverse = (y+cite_y >= cite_ystart && y+cite_y <= cite_yend);
         } else {
-          tmp_e = mc_getline(b_us, y);
-          if (wcslen(look_for) > 1) {
-            /* quick scan for pattern match */
-            mc_wdrawelm_var(b_us, tmp_e, tmp_line);
-            inverse = (wcslen(tmp_line)>1 &&
-                         StrStr(tmp_line, look_for, case_matters));
-          } else
-            inverse = 0;
+          /* quick scan for pattern match */
+          inverse = mc_matches(b_us, y, matcher);
         }
 
         if (inverse)
@@ -627,7 +682,7 @@ static void scrollback(void)
       case K_DN:
         if (citemode && cite_y < b_us->ys-1) {
           cite_y++;
-          if (cite_ystart != 1000000) {
+          if (cite_ystart != INT_MAX) {
             cite_yend = y + cite_y;
             drawcite(b_us, cite_y-1, y, cite_ystart, cite_yend);
             drawcite(b_us, cite_y, y, cite_ystart, cite_yend);
@@ -636,10 +691,10 @@ static void scrollback(void)
           break;
         }
 
-        if (y >= us->histlines)
+        if (y >= histsize())
           break;
         y++;
-        if (cite_ystart != 1000000)
+        if (cite_ystart != INT_MAX)
           cite_yend = y + cite_y;
         mc_wscroll(b_us, S_UP);
 
@@ -652,14 +707,8 @@ static void scrollback(void)
         if (citemode) {
           inverse = (y+cite_y >= cite_ystart && y+cite_y <= cite_yend);
         } else {
-          tmp_e = mc_getline(b_us, y + b_us->ys - 1);
-          if (wcslen(look_for) > 1) {
-            /* quick scan for pattern match */
-            mc_wdrawelm_var(b_us, tmp_e, tmp_line);
-            inverse = (wcslen(tmp_line)>1 &&
-                         StrStr(tmp_line, look_for, case_matters));
-          } else
-            inverse = 0;
+          /* quick scan for pattern match */
+          inverse = mc_matches(b_us, y + b_us->ys - 1, matcher);
         }
 
         if (inverse)
@@ -680,7 +729,7 @@ static void scrollback(void)
         y -= b_us->ys;
         if (y < 0)
           y = 0;
-        if (cite_ystart != 1000000)
+        if (cite_ystart != INT_MAX)
           cite_yend = y + cite_y;
 
         /*
@@ -689,8 +738,8 @@ static void scrollback(void)
          * the lines that have the pattern we wanted... it's just nice.
          * Highlight any matches
          */
-        if (wcslen(look_for) > 1 && us->histline)
-          drawhist_look(b_us, y, 1, look_for, case_matters);
+        if (matcher && us->histline)
+          drawhist_look(b_us, y, 1, matcher);
         else
           drawhist(b_us, y, 1);
 
@@ -701,12 +750,12 @@ static void scrollback(void)
       case 'F':
       case ' ': /* filipg: space bar will go page-down... pager-like */
       case K_PGDN:
-        if (y >= us->histlines)
+        if (y >= histsize())
           break;
         y += b_us->ys;
-        if (y > us->histlines)
-          y=us->histlines;
-        if (cite_ystart != 1000000)
+        if (y > histsize())
+          y = histsize();
+        if (cite_ystart != INT_MAX)
           cite_yend = y + cite_y;
 
         /*
@@ -715,17 +764,69 @@ static void scrollback(void)
          * the lines that have the pattern we wanted... it's just nice.
          * Highlight any matches
          */
-        if (wcslen(look_for) > 1 && us->histline)
-          drawhist_look(b_us, y, 1, look_for, case_matters);
+        if (matcher && us->histline)
+          drawhist_look(b_us, y, 1, matcher);
+        else
+          drawhist(b_us, y, 1);
+        if (citemode)
+          mc_wlocate(b_us, 0, cite_y);
+        break;
+      case 'g':
+      case 'G':
+      case K_END:
+        /* To the end, which then follows what comes in. */
+        y = histsize();
+        if (cite_ystart != INT_MAX)
+          cite_yend = y + cite_y;
+        if (citemode)
+          drawcite_whole(b_us, y, cite_ystart, cite_yend);
+        else if (matcher && us->histline)
+          drawhist_look(b_us, y, 1, matcher);
+        else
+          drawhist(b_us, y, 1);
+        if (citemode)
+          mc_wlocate(b_us, 0, cite_y);
+        break;
+      case K_PORT:
+        /*
+         * The port sent more. It goes to the window we cover, with
+         * the lines it scrolls off into the history.
+         */
+        added = us->histcount;
+        size = histsize();
+        ingest_show();
+        mc_wresave(b_us, us);
+        mc_wresave(b_st, us);
+        if (st && tempst)
+          mc_wresave(st, us);
+        added = us->histcount - added;
+        /* Lines that fell out of the history moved the rest up. */
+        shift = histsize() - size - (int)added;
+        if (y >= size)
+          y = histsize();
+        else {
+          y = y + shift < 0 ? 0 : y + shift;
+          newlines += added;
+        }
+        if (cite_ystart != INT_MAX) {
+          cite_ystart = cite_ystart + shift < 0 ? 0 : cite_ystart + shift;
+          cite_yend = y + cite_y;
+        }
+        if (citemode)
+          drawcite_whole(b_us, y, cite_ystart, cite_yend);
+        else if (matcher)
+          drawhist_look(b_us, y, 1, matcher);
         else
           drawhist(b_us, y, 1);
+        hist_help(b_st, hline, newlines);
         if (citemode)
           mc_wlocate(b_us, 0, cite_y);
+        mc_wflush();
         break;
       case 'C': case 'c': /* start citation mode */
         if (citemode ^= 1) {
           cite_y = 0;
-          cite_ystart = 1000000;
+          cite_ystart = INT_MAX;
           cite_yend = -1;
           strcpy(hline1, _("  CITATION: ENTER=select start line ESC=exit                               "));
           if (b_st->xs < 127)
@@ -734,15 +835,13 @@ static void scrollback(void)
         } else {
           hline = hline0;
         }
-        mc_wlocate(b_st, 0, 0);
-        mc_wprintf(b_st, "%s", hline);
-        mc_wredraw(b_st, 1);
+        hist_help(b_st, hline, newlines);
         if (citemode)
           mc_wlocate(b_us, 0, cite_y);
         break;
       case 10: case 13:
         if (!citemode) break;
-        if (cite_ystart == 1000000) {
+        if (cite_ystart == INT_MAX) {
           cite_yend = cite_ystart = y + cite_y;
           strcpy(hline1, _("  CITATION: ENTER=select end line ESC=exit                                 "));
           if (b_st->xs < 127)
@@ -750,13 +849,11 @@ static void scrollback(void)
         } else {
           if (cite_ystart > cite_yend)
             break;
-          drawcite_whole(b_us, y, 1000000, -1);
+          drawcite_whole(b_us, y, INT_MAX, -1);
           loop = 0;
           break;
         }
-        mc_wlocate(b_st, 0, 0);
-        mc_wprintf(b_st, "%s", hline);
-        mc_wredraw(b_st, 1);
+        hist_help(b_st, hline, newlines);
         mc_wdrawelm_inverse(b_us, cite_y, mc_getline(b_us, cite_ystart));
         mc_wlocate(b_us, 0, cite_y);
         break;
@@ -765,26 +862,31 @@ static void scrollback(void)
           loop = 0;
           break;
         }
-        if (cite_ystart == 1000000) {
+        if (cite_ystart == INT_MAX) {
           citemode = 0;
           hline = hline0;
         } else {
-          cite_ystart = 1000000;
+          cite_ystart = INT_MAX;
           strcpy(hline1, _("  CITATION: ENTER=select start line ESC=exit                               "));
         }
         drawcite_whole(b_us, y, cite_ystart, cite_yend);
-        mc_wlocate(b_st, 0, 0);
-        mc_wprintf(b_st, "%s", hline);
-        mc_wredraw(b_st, 1);
+        hist_help(b_st, hline, newlines);
         if (citemode)
           mc_wlocate(b_us, 0, cite_y);
         break;
     }
+    /* Back at the end: nothing new below any more. */
+    if (newlines && y >= histsize()) {
+      newlines = 0;
+      hist_help(b_st, hline, newlines);
+      if (citemode)
+        mc_wlocate(b_us, 0, cite_y);
+    }
   }
   /* Cleanup. */
   if (citemode)
     do_cite(b_us, cite_ystart, cite_yend);
-  mc_wclose(b_us, y == us->histlines ? 0 : 1);
+  mc_wclose(b_us, y == histsize() ? 0 : 1);
   mc_wclose(b_st, 1);
   mc_wlocate(us, us->curx, us->cury);
   mc_wflush();
@@ -837,6 +939,10 @@ static void helpthem(void)
     "  -d, --dial=ENTRY       : dial ENTRY from the dialing directory\n"
     "  -p, --ptty=TTYP        : connect to pseudo terminal\n"
     "  -C, --capturefile=FILE : start capturing to FILE\n"
+    "      --headless         : no screen, port data to capture file or stdout\n"
+    "      --pane=DEV[,FILE]  : also show port DEV, capturing to FILE\n"
+    "                           (DEV@SPEED[:8N1] for a speed of its own)\n"
+    "      --replay=FILE      : show FILE as if the port sent it, and time it\n"
     "  -F, --statlinefmt      : format of status line\n"
     "  -R, --remotecharset    : character set of communication partner\n"
     "  -v, --version          : output version information and exit\n"
@@ -904,6 +1010,20 @@ static void toggle_line_timestamp(void)
   set_line_timestamp(line_timestamp);
 }
 
+/*
+ * Start or stop capturing after docap or capfp changed. Text capture
+ * is done by the emulator, raw capture by the receive buffer.
+ */
+static void set_capture(void)
+{
+  int mode = docap ? (capture_raw ? 2 : 1) : 0;
+
+  if (capfp)
+    cap_flush();
+  rx_capture(mode == 2 ? fileno(capfp) : -1);
+  vt_set(addlf, -1, mode, -1, -1, -1, -1, -1, addcr);
+}
+
 /* -------------------------------------------- */
 
 static void do_iconv_just_copy(char **inbuf, size_t *inbytesleft,
@@ -1074,6 +1194,98 @@ static void parse_options(char *option)
           else
             usage_and_exit_if(true, "Unknown timestamp variant '%s'.\n", o);
         }
+      else if (!strcmp(key, "reader"))
+        {
+          if (o == NULL || !strcmp(o, "thread"))
+            rxt_enabled = 1;
+          else if (!strcmp(o, "direct"))
+            rxt_enabled = 0;
+          else
+            usage_and_exit_if(true, "Unknown reader variant '%s'.\n", o);
+#if !defined(HAVE_PTHREAD_H) || !defined(HAVE_STDATOMIC_H)
+          usage_and_exit_if(rxt_enabled, "Reader thread not supported.\n");
+#endif
+        }
+      else if (!strcmp(key, "readerbuf"))
+        {
+          usage_and_exit_if(o == NULL || atoi(o) < 4,
+                            "readerbuf needs a size of at least 4 KB.\n");
+          rxt_ring_kb = atoi(o);
+        }
+      else if (!strcmp(key, "capture"))
+        {
+          if (o && !strcmp(o, "raw"))
+            capture_raw = 1;
+          else if (o && !strcmp(o, "text"))
+            capture_raw = 0;
+          else
+            usage_and_exit_if(true, "Unknown capture variant '%s'.\n",
+                              o ? o : "");
+        }
+      else if (!strcmp(key, "capbuf"))
+        {
+          usage_and_exit_if(o == NULL || atoi(o) < 1,
+                            "capbuf needs a size of at least 1 KB.\n");
+          cap_bufsize = atoi(o) * 1024;
+        }
+      else if (!strcmp(key, "capdelay"))
+        {
+          usage_and_exit_if(o == NULL || atoi(o) < 0,
+                            "capdelay needs a time in milliseconds.\n");
+          cap_latency = atoi(o);
+        }
+      else if (!strcmp(key, "capflush"))
+        {
+          if (o && !strcmp(o, "line"))
+            cap_lineflush = 1;
+          else if (o && !strcmp(o, "buffer"))
+            cap_lineflush = 0;
+          else
+            usage_and_exit_if(true, "Unknown capflush variant '%s'.\n",
+                              o ? o : "");
+        }
+      else if (!strcmp(key, "statsfile"))
+        {
+          usage_and_exit_if(o == NULL || !*o,
+                            "statsfile needs a file name.\n");
+          stats_file = strdup(o);
+        }
+      else if (!strcmp(key, "histfile"))
+        {
+          usage_and_exit_if(o == NULL || !*o,
+                            "histfile needs a file name.\n");
+          hist_file = strdup(o);
+        }
+      else if (!strcmp(key, "record"))
+        {
+          usage_and_exit_if(o == NULL || !*o,
+                            "record needs a file name.\n");
+          rec_file = strdup(o);
+        }
+      else if (!strcmp(key, "speed"))
+        {
+          usage_and_exit_if(o == NULL || atof(o) < 0,
+                            "speed needs a factor, 0 for as fast as possible.\n");
+          replay_speed = atof(o);
+        }
+      else if (!strcmp(key, "from"))
+        {
+          usage_and_exit_if(o == NULL || atof(o) < 0,
+                            "from needs a time in seconds.\n");
+          replay_from = atof(o);
+        }
+      else if (!strcmp(key, "dump"))
+        {
+          usage_and_exit_if(o == NULL || !*o,
+                            "dump needs a file name.\n");
+          replay_dump = strdup(o);
+        }
+      else if (!strcmp(key, "fps"))
+        {
+          usage_and_exit_if(o == NULL || atoi(o) < 0 || atoi(o) > 1000,
+                            "fps needs a value from 0 to 1000.\n");
+          render_fps = atoi(o);
+        }
       else
         usage_and_exit_if(true, "Unknown option '%s'.\n", key);
     }
@@ -1098,6 +1310,7 @@ int main(int argc, char **argv)
   char *cmdline_baudrate = NULL;/* Baudrate given on the command line via -b */
   char *cmdline_device = NULL;  /* Device/Port given on the command line via -D */
   char *remote_charset = NULL;  /* Remote charset given on the command line via -R */
+  char *replay_file = NULL;	/* Capture to show, --replay */
   char pseudo[64];
   /* char* console_encoding = getenv ("LC_CTYPE"); */
 
@@ -1129,6 +1342,9 @@ int main(int argc, char **argv)
     { "remotecharset", required_argument, NULL, 'R' },
     { "option",        required_argument, NULL, 'O' },
     { "statlinefmt",   required_argument, NULL, 'F' },
+    { "headless",      no_argument,       NULL, OPT_HEADLESS },
+    { "pane",          required_argument, NULL, OPT_PANE },
+    { "replay",        required_argument, NULL, OPT_REPLAY },
     { NULL, 0, NULL, 0 }
   };
 
@@ -1333,7 +1549,6 @@ int main(int argc, char **argv)
             exit(1);
           }
           docap = 1;
-          vt_set(addlf, -1, docap, -1, -1, -1, -1, -1, addcr);
           break;
         case 'S': /* start Script */
           strncpy(scr_name, optarg, sizeof(scr_name) - 1);
@@ -1369,6 +1584,16 @@ int main(int argc, char **argv)
 	case 'O':
 	  parse_options(optarg);
 	  break;
+        case OPT_HEADLESS:
+          headless = 1;
+          break;
+        case OPT_PANE:
+          usage_and_exit_if(pane_add(optarg) < 0,
+                            "Can not add --pane %s.\n", optarg);
+          break;
+        case OPT_REPLAY:
+          replay_file = optarg;
+          break;
         default:
           usage(env_args, optind, mc);
           break;
@@ -1381,7 +1606,13 @@ int main(int argc, char **argv)
     /* Loop again if more options */
   } while (optind < argk);
 
+  usage_and_exit_if(headless && (dosetup || cmd_dial || npanes),
+                    "--headless can not be used with -s, -d or --pane.\n");
+  usage_and_exit_if(replay_file && (headless || dosetup || cmd_dial || npanes),
+                    "--replay can not be used with --headless, -s, -d or --pane.\n");
+
   init_iconv(remote_charset);
+  set_capture();
 
   if (screen_iso && screen_ibmpc)
     /* init VT */
@@ -1453,7 +1684,9 @@ int main(int argc, char **argv)
     st_attr = XA_REVERSE;
   }
 
-  if (dial_tty == NULL) {
+  if (replay_file)
+    dial_tty = replay_file; /* No port, the status line shows the file. */
+  else if (dial_tty == NULL) {
     if (!dosetup) {
       while ((dial_tty = get_port(P_PORT)) != NULL && open_term(doinit, 1, 0) < 0)
         ;
@@ -1466,6 +1699,37 @@ int main(int argc, char **argv)
       exit(1);
   }
 
+  if (rec_file && !replay_file && rec_open(rec_file) < 0) {
+    fprintf(stderr, _("Cannot create %s: %s\n"), rec_file, strerror(errno));
+    exit(1);
+  }
+
+  /* Without a screen there is nothing else to set up. */
+  if (headless) {
+    signal(SIGPIPE, SIG_IGN);
+#ifdef SIGUSR1
+    signal(SIGUSR1, stats_signal);
+#endif
+    if (doinit)
+      modeminit();
+    if (scr_name[0])
+      runscript(0, scr_name, "", "");
+    do_headless();
+
+    m_restorestate(portfd);
+    cap_close();
+    rec_close();
+    lockfile_remove();
+    close(portfd);
+    if (P_CALLIN[0])
+      fastsystem(P_CALLIN, NULL, NULL, NULL);
+    close_iconv();
+    return 0;
+  }
+
+  /* The other ports, before curses takes the screen. */
+  pane_open_all();
+
   mc_setenv("TERM", termtype);
 
   if (win_init(tfcolor, tbcolor, XA_NORMAL) < 0)
@@ -1473,6 +1737,8 @@ int main(int argc, char **argv)
 
   if (COLS < 40 || LINES < 10)
     leave(_("Sorry. Your screen is too small.\n"));
+  if (!pane_fits(LINES - 2))
+    leave(_("Sorry. Your screen is too small for that many ports.\n"));
 
   if (dosetup) {
     if (config(1)) {
@@ -1503,6 +1769,9 @@ int main(int argc, char **argv)
 #ifdef SIGWINCH
   signal(SIGWINCH, change_size);
 #endif
+#ifdef SIGUSR1
+  signal(SIGUSR1, stats_signal);
+#endif
 
 #ifdef DEBUG
   for(c = 1; c < _NSIG; c++) {
@@ -1541,6 +1810,41 @@ int main(int argc, char **argv)
 
   init_emul(VT100, 1);
 
+  if (replay_file) {
+    char report[512];
+
+    c = do_replay(replay_file, report, sizeof(report));
+    if (c == 0 && replay_dump) {
+      FILE *fp = fopen(replay_dump, "w");
+
+      if (fp == NULL) {
+        snprintf(report, sizeof(report), _("Cannot create %s: %s\n"),
+                 replay_dump, strerror(errno));
+        c = -1;
+      } else {
+        mc_wdump(us, fp);
+        fclose(fp);
+      }
+    }
+    mc_wclose(us, 0);
+    mc_wclose(st, 0);
+    mc_wclose(stdwin, 1);
+    keyboard(KUNINSTALL, 0);
+    fputs(report, stderr);
+    /* With -O statsfile=, keep the numbers from run to run. */
+    if (c == 0 && stats_file) {
+      FILE *fp = fopen(stats_file, "a");
+
+      if (fp) {
+        fputs(report, fp);
+        fclose(fp);
+      }
+    }
+    cap_close();
+    close_iconv();
+    return c < 0;
+  }
+
   if (doinit)
     modeminit();
 
@@ -1587,7 +1891,20 @@ int main(int argc, char **argv)
   /* The main loop calls do_terminal and gets a function key back. */
   while (!quit) {
     c = do_terminal();
+    /* Don't keep data back while we are in a menu. */
+    tx_flush();
+    if (capfp)
+      cap_flush();
 dirty_goto:
+    /*
+     * Keep reading the port while a menu waits for keys, if it does
+     * not talk to the port itself; a transfer stops it in updown().
+     */
+    if (c > 0 && c < 256 &&
+        strchr("bdloprstvz", c + 32 * (c >= 'A' && c <= 'Z')))
+      ingest_start();
+    else
+      ingest_stop();
     switch (c + 32 *(c >= 'A' && c <= 'Z')) {
       case 'a': /* Add line feed */
         toggle_addlf();
@@ -1599,6 +1916,15 @@ dirty_goto:
         s = addcr ?  _("Add carriage return ON") : _("Add carriage return OFF");
         status_set_display(s, 0);
         break;
+      case 'v': /* Statistics */
+        stats_show();
+        break;
+      case '>': /* Keyboard to the next pane */
+        pane_focus(1);
+        break;
+      case '<': /* Keyboard to the previous pane */
+        pane_focus(-1);
+        break;
       case 'e': /* Local echo on/off. */
         toggle_local_echo();
         s = local_echo ?  _("Local echo ON") : _("Local echo OFF");
@@ -1671,8 +1997,7 @@ dirty_goto:
         } else if (capfp != (FILE *)0 && !docap) {
           c = ask(_("Capture file"), c3);
           if (c == 0) {
-            fclose(capfp);
-            capfp = (FILE *)NULL;
+            cap_close();
             docap = 0;
           }
           if (c == 1)
@@ -1680,14 +2005,13 @@ dirty_goto:
         } else if (capfp != (FILE *)0 && docap) {
           c = ask(_("Capture file"), c2);
           if (c == 0) {
-            fclose(capfp);
-            capfp = (FILE *)NULL;
+            cap_close();
             docap = 0;
           }
           if (c == 1)
             docap = 0;
         }
-        vt_set(addlf, -1, docap, -1, -1, -1, -1, -1, addcr);
+        set_capture();
         break;
       case 'p': /* Set parameters */
         get_bbp(P_BAUDRATE, P_BITS, P_PARITY, P_STOPB, 0);
@@ -1711,7 +2035,7 @@ dirty_goto:
         break;
       case 'w': /* Line wrap on-off */
         c = !us->wrap;
-        vt_set(addlf, c, docap, -1, -1, -1, -1, -1, addcr);
+        vt_set(addlf, c, -1, -1, -1, -1, -1, -1, addcr);
         s = c ? _("Linewrap ON") : _("Linewrap OFF");
 	status_set_display(s, 0);
         break;
@@ -1767,6 +2091,7 @@ dirty_goto:
       default:
         break;
     }
+    ingest_stop();
   };
 
   /* Reset parameters */
@@ -1785,12 +2110,14 @@ dirty_goto:
 #endif
   signal(SIGQUIT, SIG_DFL);
 
-  if (capfp != (FILE *)0)
-    fclose(capfp);
+  cap_close();
+  rec_close();
+  pane_wclose();
   mc_wclose(us, 0);
   mc_wclose(st, 0);
   mc_wclose(stdwin, 1);
   keyboard(KUNINSTALL, 0);
+  pane_close_all();
   lockfile_remove();
   close(portfd);
 
@@ -66,11 +66,11 @@ EXTERN int COLS;
 #endif
 
 EXTERN int dosetup;     /* In setup mode (-s) */
+EXTERN int headless;    /* No screen, just log the port (--headless) */
 
 EXTERN char stdattr;	/* Standard attribute */
 
 EXTERN WIN *us;		/* User screen */
-EXTERN WIN *us_alternate; /* Alternate user screen */
 EXTERN WIN *st;		/* Status Line */
 
 EXTERN short terminal;	/* terminal type */
@@ -140,7 +140,7 @@ static inline int portfd_connected(void)
  * fmg 8/22/97
  * Search pattern can be THIS long (x characters)
  */
-#define MAX_SEARCH      30
+#define MAX_SEARCH      128
 
 /* fmg 1/11/94 colors */
 
@@ -210,6 +210,35 @@ void dialone(char *entry);
 void dialdir(void);
 void free_dialents(void);
 
+/* Prototypes from file: capture.c */
+extern size_t cap_bufsize;
+extern int cap_latency;
+extern int cap_lineflush;
+void cap_write(const char *s, size_t len);
+void cap_putc(int c);
+void cap_puts(const char *s);
+void cap_flush(void);
+void cap_close(void);
+
+/* Prototypes from file: evloop.c */
+#define EV_READ		1	/* fd is readable */
+#define EV_ERROR	2	/* fd had an error or hangup */
+#define EV_PERIODIC	1	/* timer: restart after expiry */
+#define EV_ALIGN	2	/* timer: expire on multiples of wall clock time */
+typedef void (*ev_io_func)(int fd, int events, void *data);
+typedef void (*ev_timer_func)(int id, void *data);
+struct iovec;
+int  ev_io_add(int fd, ev_io_func func, void *data);
+int  ev_io_add_read(int fd, ev_io_func func, void *data);
+ssize_t ev_readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t ev_read(int fd, void *buf, size_t len);
+size_t ev_io_buffered(int fd);
+void ev_io_del(int fd);
+int  ev_timer_add(long ms, int flags, ev_timer_func func, void *data);
+void ev_timer_del(int id);
+int  ev_run(int timeout);
+const char *ev_backend(void);
+
 /* Prototypes from file: file.c */
 char *filedir(int how_many, int downloading);
 void init_dir(char dir);
@@ -234,10 +263,16 @@ void sendstr(char *s);
 
 /* Prototypes from file: main.c */
 extern time_t old_online;
+extern int render_fps;
+extern double replay_speed;
+extern double replay_from;
+extern const char *replay_dump;
 void leave(const char *s) __attribute__((noreturn));
 char *esc_key(void);
 void term_socket_connect(void);
 void term_socket_close(void);
+void lockfile_name(const char *dev, char *buf, size_t len);
+int  lockfile_busy(const char *name);
 int  open_term(int doinit, int show_win_on_error, int no_msgs);
 void init_emul(int type, int do_init);
 void timer_update(void);
@@ -245,30 +280,128 @@ void show_status(void);
 void set_status_line_format(const char *s);
 void scriptname(const char *s);
 int  do_terminal(void);
+void ingest_start(void);
+void ingest_stop(void);
+void ingest_report(int on);
+void ingest_show(void);
+void do_headless(void);
+int  do_replay(const char *file, char *report, size_t len);
 void status_set_display(const char *text, int duration_s);
 
 /* Prototypes from file: minicom.c */
 void port_init(void);
+void port_init_fd(int fd, char *baudr, char *par, char *bits, char *stopb);
 void toggle_addlf(void);
 void toggle_local_echo(void);
 
-void drawhist_look(WIN *w, int y, int r, wchar_t *look, int case_matters);
+struct search;
+void drawhist_look(WIN *w, int y, int r, struct search *look);
 void searchhist(WIN *w_hist, wchar_t *str);
-int  find_next(WIN *w, WIN *w_hist, int hit_line, wchar_t *look,
-               int case_matters);
-const wchar_t *upcase(wchar_t *dest, wchar_t *src);
-wchar_t *StrStr(wchar_t *str1, wchar_t *str2, int case_matters);
+int  find_next(WIN *w, WIN *w_hist, int hit_line, struct search *look);
 
 void do_iconv(char **inbuf, size_t *inbytesleft,
               char **outbuf, size_t *outbytesleft);
 int  using_iconv(void);
 
+/* Prototypes from file: ports.c */
+extern int npanes;
+int  pane_add(const char *arg);
+void pane_open_all(void);
+void pane_port_init(void);
+void pane_close_all(void);
+int  pane_fits(int maxy);
+void pane_main(int maxy, int *x1, int *y1, int *x2, int *y2);
+void pane_wopen(int maxy);
+void pane_wclose(void);
+void pane_start(void);
+void pane_stop(void);
+void pane_io(void);
+void pane_tick(void);
+void pane_cursor(void);
+void pane_focus(int dir);
+int  pane_focused(void);
+void pane_send(int c);
+
 /* Prototypes from file: rwconf.c */
 int writepars(FILE *fp, int all);
 int writemacs(FILE *fp);
 int readpars(FILE *fp, enum config_type conftype);
 int readmacs(FILE *fp, int init); /* fmg */
 
+/* Prototypes from file: record.c */
+#define REC_RX		1	/* Read from the port */
+#define REC_TX		2	/* Written to the port */
+#define REC_CHUNK	65536	/* Most data in one record */
+extern const char *rec_file;
+int  rec_open(const char *name);
+void rec_close(void);
+void rec_flush(void);
+void rec_put(int type, const char *p, size_t len);
+int  rec_check(FILE *fp);
+int  rec_next(FILE *fp, int *type, unsigned long long *ns, char *buf,
+              size_t size);
+int  rec_seek(FILE *fp, const char *name, unsigned long long ns);
+
+/* Prototypes from file: rxbuf.c */
+struct rx_stats {
+  unsigned long reads;	/* read calls that returned data */
+  unsigned long bytes;	/* bytes received */
+  size_t size;		/* current size of the buffer */
+  size_t used;		/* bytes in the buffer */
+  size_t peak;		/* highest number of bytes in the buffer */
+  size_t ring_size;	/* reader thread ring: size */
+  size_t ring_used;	/*   bytes in it */
+  size_t ring_peak;	/*   highest number of bytes in it */
+  unsigned long dropped; /*  bytes dropped because it was full */
+};
+extern struct rx_stats rx_stats;
+int    rx_fill(int fd);
+void   rx_leftover(void);
+size_t rx_peek(char **p);
+void   rx_consume(size_t n);
+size_t rx_used(void);
+size_t rx_room(void);
+int    rx_full(void);
+void   rx_put(const char *p, size_t len);
+const struct timeval *rx_arrival(void);
+void   rx_idle(void);
+void   rx_capture(int fd);
+void   rx_hold(int on);
+
+/* Prototypes from file: rxthread.c */
+extern int rxt_enabled;
+extern size_t rxt_ring_kb;
+int  rxt_start(int fd);
+void rxt_stop(void);
+int  rxt_running(void);
+int  rxt_fd(void);
+int  rxt_pending(void);
+int  rxt_pull(struct timeval *tv);
+
+/* Prototypes from file: stats.c */
+struct mc_stats {
+  unsigned long long tx_bytes;	/* bytes written to the port */
+  unsigned long long tx_writes;	/* write calls for them */
+  unsigned long long vt_bytes;	/* bytes through the terminal emulation */
+  unsigned long long scr_bytes;	/* bytes written to the terminal */
+  unsigned long long scr_writes; /* write calls for them */
+  unsigned long long frames;	/* screen updates drawn */
+  unsigned long long cap_bytes;	/* bytes written to the capture file */
+  unsigned long long cap_writes; /* write calls for them */
+  unsigned long long parse_ns;	/* time spent in the emulation */
+  unsigned long long render_ns;	/* time spent updating the screen */
+  double rx_rate, tx_rate, vt_rate, scr_rate; /* bytes/s, see stats_tick */
+};
+extern struct mc_stats mc_stats;
+extern const char *stats_file;
+extern volatile int stats_dump_pending;
+unsigned long long stats_ns(void);
+void stats_tick(void);
+void stats_rate(char *buf, size_t len, double rate);
+void stats_show(void);
+void stats_dump(void);
+void stats_signal(int sig);
+
 /* Prototypes from file: sysdep1.c */
 void m_sethwf(int fd, int on);
 void m_dtrtoggle(int fd, int sec);
@@ -294,6 +427,10 @@ void getrowcols(int *rows, int *cols);
 int  setcbreak(int mode);
 void enab_sig(int onoff, int intrchar);
 
+/* Prototypes from file: txqueue.c */
+void   tx_put(const char *s, size_t len, int mark);
+void   tx_flush(void);
+
 /* Prototypes from file: updown.c */
 void updown(int what, int nr );
 int  mc_setenv(const char *, const char *);
@@ -301,6 +438,18 @@ void kermit(void);
 void runscript(int ask, const char *s, const char *l, const char *p);
 int  paste_file(void);
 
+/* Prototypes from file: utf8.c */
+#define UTF8_ACCEPT	0
+#define UTF8_REJECT	1
+int      utf8_locale(void);
+unsigned utf8_next(unsigned state, unsigned char c, unsigned *cp);
+int      utf8_wide(wchar_t wc);
+
+/* Prototypes from file: search.c */
+struct search *search_new(const wchar_t *pattern, int case_matters, int regex);
+void search_free(struct search *s);
+int  search_line(struct search *s, const char *text, int len);
+
 /* Prototypes from file: windiv.c */
 WIN *mc_tell(const char *, ...);
 void werror(const char *, ...);
@@ -319,6 +468,8 @@ void domacros(void);
 
 int lockfile_create(int no_msgs);
 void lockfile_remove(void);
+int lockfile_lock(const char *name, const char *dev, int no_msgs);
+void lockfile_unlock(const char *name, const char *dev);
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
@@ -0,0 +1,515 @@
+/*
+ * ports.c	More serial ports in one minicom.
+ *
+ *		Ports given with --pane are opened next to the main
+ *		port, each with its own lock file and optionally its own
+ *		speed, format and capture file, and shown in a tile of
+ *		the screen. They are read from the same event loop as
+ *		the main port while in terminal mode. C-A > and C-A <
+ *		move the keyboard between the tiles. Menus, file
+ *		transfers and scripts still work on the main port only.
+ *
+ *		Every pane has a terminal emulator of its own.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <poll.h>
+
+#include "port.h"
+#include "minicom.h"
+#include "intl.h"
+#include "vt100.h"
+
+#define PANE_MAX	15	/* Besides the main port */
+
+struct pane {
+  char *dev;			/* Device */
+  FILE *cap;			/* Capture file, or NULL */
+  char lock[270];		/* UUCP lock file */
+  char speed[8];		/* Own speed, "" for the main port's */
+  char bits[2], par[2], stopb[2];	/* Own format, likewise */
+  int fd;			/* -1 while the port is not open */
+  int ready;			/* The event loop saw something */
+  struct vt *vt;		/* Its terminal emulator */
+  WIN *title;
+  WIN *w;
+};
+
+static struct pane panes[PANE_MAX];
+int npanes;
+static int focus;		/* 0 is the main port, else panes[focus - 1] */
+static int watching;		/* The ports are in the event loop */
+static WIN *main_title;
+
+/*
+ * The "SPEED[:FORMAT]" after the device, FORMAT as in 8N1. Returns
+ * -1 if it is not.
+ */
+static int pane_line(struct pane *p, const char *s)
+{
+  size_t n = strspn(s, "0123456789");
+
+  if (n == 0 || n >= sizeof(p->speed))
+    return -1;
+  memcpy(p->speed, s, n);
+  p->speed[n] = 0;
+  s += n;
+  if (*s == 0)
+    return 0;
+  if (*s++ != ':' || *s < '5' || *s > '8' || s[1] == 0 ||
+      strchr("NEO", toupper(s[1])) == NULL || (s[2] != '1' && s[2] != '2') ||
+      s[3] != 0)
+    return -1;
+  p->bits[0] = s[0];
+  p->par[0] = toupper(s[1]);
+  p->stopb[0] = s[2];
+  return 0;
+}
+
+/*
+ * Add a port from "--pane DEVICE[@SPEED[:FORMAT]][,CAPTUREFILE]".
+ * Returns -1 if there are too many, the speed is not one, or the
+ * capture file can not be opened.
+ */
+int pane_add(const char *arg)
+{
+  struct pane *p;
+  char *s, *file;
+
+  if (npanes == PANE_MAX)
+    return -1;
+  p = &panes[npanes];
+  memset(p, 0, sizeof(*p));
+  if ((p->dev = strdup(arg)) == NULL)
+    return -1;
+  if ((file = strchr(p->dev, ',')) != NULL)
+    *file++ = 0;
+  if ((s = strrchr(p->dev, '@')) != NULL) {
+    *s++ = 0;
+    if (pane_line(p, s) < 0) {
+      free(p->dev);
+      return -1;
+    }
+  }
+  if (file && (p->cap = fopen(file, "a")) == NULL) {
+    free(p->dev);
+    return -1;
+  }
+  p->fd = -1;
+  npanes++;
+  return 0;
+}
+
+/*
+ * The main port's settings, with the pane's own speed and format if
+ * it has them.
+ */
+static void pane_setparms(struct pane *p)
+{
+  port_init_fd(p->fd, p->speed[0] ? p->speed : NULL,
+               p->par[0] ? p->par : NULL, p->bits[0] ? p->bits : NULL,
+               p->stopb[0] ? p->stopb : NULL);
+}
+
+static void pane_ready(int fd, int events, void *data)
+{
+  (void)fd;
+  (void)events;
+  ((struct pane *)data)->ready = 1;
+}
+
+/*
+ * What the emulator of a pane sends: answers to the remote side and
+ * keys. The port is non-blocking, so wait for it to take them as
+ * tx_write() does for the main port, and say so if it does not.
+ */
+static void pane_out(const char *s, int len, void *data)
+{
+  struct pane *p = data;
+  struct pollfd pfd;
+  char msg[80];
+  int done = 0, n;
+
+  if (len == 0)
+    len = strlen(s);
+  while (p->fd >= 0 && done < len) {
+    n = write(p->fd, s + done, len - done);
+    if (n > 0) {
+      done += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN) {
+      /* Output buffer full; give the line a second to drain. */
+      pfd.fd = p->fd;
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, 1000) > 0)
+        continue;
+    }
+    break;
+  }
+  if (done < len) {
+    snprintf(msg, sizeof(msg), _("%s: %d bytes not sent"), p->dev,
+             len - done);
+    status_set_display(msg, 5);
+  }
+}
+
+/*
+ * Lock and open the port of p. Returns 0 on success.
+ */
+static int pane_open(struct pane *p, int no_msgs)
+{
+  lockfile_name(p->dev, p->lock, sizeof(p->lock));
+  if (lockfile_busy(p->lock)) {
+    if (!no_msgs)
+      fprintf(stderr, _("Device %s is locked.\n"), p->dev);
+    return -1;
+  }
+  if (lockfile_lock(p->lock, p->dev, no_msgs) != 0)
+    return -1;
+  if ((p->fd = open(p->dev, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+    if (!no_msgs)
+      fprintf(stderr, _("minicom: cannot open %s: %s\n"),
+              p->dev, strerror(errno));
+    lockfile_unlock(p->lock, p->dev);
+    return -1;
+  }
+  fcntl(p->fd, F_SETFD, FD_CLOEXEC);
+  pane_setparms(p);
+  m_nohang(p->fd);
+  m_hupcl(p->fd, 1);
+  if (watching)
+    ev_io_add(p->fd, pane_ready, p);
+  return 0;
+}
+
+static void pane_close(struct pane *p)
+{
+  if (p->fd < 0)
+    return;
+  ev_io_del(p->fd);
+  close(p->fd);
+  p->fd = -1;
+  p->ready = 0;
+  lockfile_unlock(p->lock, p->dev);
+}
+
+/*
+ * The settings of the main port changed: set them on the ports too,
+ * but for a speed and format of their own.
+ */
+void pane_port_init(void)
+{
+  int i;
+
+  for (i = 0; i < npanes; i++)
+    if (panes[i].fd >= 0)
+      pane_setparms(&panes[i]);
+}
+
+/*
+ * Open all ports at startup. One that can not be opened now is tried
+ * again every second.
+ */
+void pane_open_all(void)
+{
+  int i;
+
+  for (i = 0; i < npanes; i++)
+    pane_open(&panes[i], 0);
+}
+
+/*
+ * Close the ports and capture files, on exit.
+ */
+void pane_close_all(void)
+{
+  int i;
+
+  for (i = 0; i < npanes; i++) {
+    pane_close(&panes[i]);
+    if (panes[i].cap) {
+      fclose(panes[i].cap);
+      panes[i].cap = NULL;
+    }
+    vt_destroy(panes[i].vt);
+    panes[i].vt = NULL;
+  }
+}
+
+/*
+ * Where tile i (0 is the main port) goes when the lines 0 to maxy
+ * are shared out: one above the other for two ports, in a grid for
+ * more. The first line of a tile is its title.
+ */
+static void pane_tile(int i, int maxy, int *x1, int *y1, int *x2, int *y2)
+{
+  int n = npanes + 1;
+  int c, r, w, h;
+
+  for (c = 1; c * c < n; c++)
+    ;
+  if (n == 2)
+    c = 1;
+  r = (n + c - 1) / c;
+  w = (COLS - (c - 1)) / c;
+  h = (maxy + 1) / r;
+
+  *x1 = (i % c) * (w + 1);
+  *x2 = i % c == c - 1 ? COLS - 1 : *x1 + w - 1;
+  *y1 = (i / c) * h;
+  *y2 = i / c == r - 1 ? maxy : *y1 + h - 1;
+}
+
+/*
+ * Is there room for the tiles? They need a title and two lines, and
+ * 20 columns.
+ */
+int pane_fits(int maxy)
+{
+  int x1, y1, x2, y2;
+
+  if (npanes == 0)
+    return 1;
+  pane_tile(0, maxy, &x1, &y1, &x2, &y2);
+  return y2 - y1 >= 2 && x2 - x1 >= 19;
+}
+
+/*
+ * Area of the main window. Without panes (or room for them) it has
+ * the lines 0 to maxy to itself.
+ */
+void pane_main(int maxy, int *x1, int *y1, int *x2, int *y2)
+{
+  *x1 = 0;
+  *y1 = 0;
+  *x2 = COLS - 1;
+  *y2 = maxy;
+  if (npanes && pane_fits(maxy)) {
+    pane_tile(0, maxy, x1, y1, x2, y2);
+    (*y1)++;
+  }
+}
+
+static void pane_title(WIN *t, int i)
+{
+  const char *dev = i ? panes[i - 1].dev : dial_tty;
+
+  if (t == NULL)
+    return;
+  mc_wsetattr(t, i == focus ? st_attr : XA_NORMAL);
+  mc_wlocate(t, 0, 0);
+  mc_wprintf(t, " %d %s", i, dev);
+  if (i && panes[i - 1].speed[0])
+    mc_wprintf(t, " %s", panes[i - 1].speed);
+  if (i && panes[i - 1].bits[0])
+    mc_wprintf(t, " %s%s%s", panes[i - 1].bits, panes[i - 1].par,
+               panes[i - 1].stopb);
+  if (i && panes[i - 1].fd < 0)
+    mc_wprintf(t, " %s", _("(not open)"));
+  mc_wclreol(t);
+  mc_wflush();
+}
+
+static void pane_titles(void)
+{
+  int i;
+
+  pane_title(main_title, 0);
+  for (i = 0; i < npanes; i++)
+    pane_title(panes[i].title, i + 1);
+}
+
+/*
+ * Close the windows of the panes.
+ */
+void pane_wclose(void)
+{
+  int i;
+
+  for (i = 0; i < npanes; i++) {
+    if (panes[i].w)
+      mc_wclose(panes[i].w, 0);
+    if (panes[i].title)
+      mc_wclose(panes[i].title, 0);
+    panes[i].w = panes[i].title = NULL;
+  }
+  if (main_title)
+    mc_wclose(main_title, 0);
+  main_title = NULL;
+}
+
+/*
+ * (Re)open the windows of the panes around the main window, which
+ * init_emul() has put where pane_main() said.
+ */
+void pane_wopen(int maxy)
+{
+  int i, x1, y1, x2, y2;
+
+  pane_wclose();
+  if (npanes == 0 || !pane_fits(maxy))
+    return;
+
+  pane_tile(0, maxy, &x1, &y1, &x2, &y2);
+  main_title = mc_wopen(x1, y1, x2, y1, BNONE, XA_NORMAL,
+                        sfcolor, sbcolor, 1, 0, 1);
+  for (i = 0; i < npanes; i++) {
+    pane_tile(i + 1, maxy, &x1, &y1, &x2, &y2);
+    panes[i].title = mc_wopen(x1, y1, x2, y1, BNONE, XA_NORMAL,
+                              sfcolor, sbcolor, 1, 0, 1);
+    panes[i].w = mc_wopen(x1, y1 + 1, x2, y2, BNONE, XA_NORMAL,
+                          tfcolor, tbcolor, 1, 0, 1);
+    panes[i].w->autocr = 0;
+    panes[i].w->wrap = 1;
+    if (panes[i].vt)
+      vt_resize(panes[i].vt, panes[i].w);
+    else
+      panes[i].vt = vt_create(panes[i].w, terminal, pane_out, &panes[i]);
+  }
+  pane_titles();
+}
+
+/*
+ * Entering terminal mode: have the event loop watch the ports.
+ */
+void pane_start(void)
+{
+  int i;
+
+  if (npanes == 0)
+    return;
+  watching = 1;
+  for (i = 0; i < npanes; i++)
+    if (panes[i].fd >= 0)
+      ev_io_add(panes[i].fd, pane_ready, &panes[i]);
+  pane_titles();
+}
+
+/*
+ * Leaving terminal mode: the ports wait until we are back.
+ */
+void pane_stop(void)
+{
+  int i;
+
+  watching = 0;
+  for (i = 0; i < npanes; i++) {
+    if (panes[i].fd >= 0)
+      ev_io_del(panes[i].fd);
+    panes[i].ready = 0;
+  }
+}
+
+/*
+ * Read the ports the event loop found ready, and put the cursor back
+ * in the window that has the keyboard.
+ */
+void pane_io(void)
+{
+  struct pane *p;
+  char buf[4096];
+  int i, n, todo;
+
+  for (i = 0; i < npanes; i++) {
+    p = &panes[i];
+    if (!p->ready || p->fd < 0)
+      continue;
+    p->ready = 0;
+    /* Don't let one busy port hold up the others. */
+    for (todo = 16; todo > 0; todo--) {
+      n = read(p->fd, buf, sizeof(buf));
+      if (n > 0) {
+        if (p->cap)
+          fwrite(buf, 1, n, p->cap);
+        if (p->w && p->vt)
+          vt_feed(p->vt, buf, n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        break;
+      /* Gone (unplugged?); pane_tick() tries to open it again. */
+      pane_close(p);
+      pane_title(p->title, i + 1);
+      break;
+    }
+  }
+}
+
+/*
+ * Once a second: try to open ports that are not, and write out the
+ * capture files.
+ */
+void pane_tick(void)
+{
+  struct pane *p;
+  int i;
+
+  for (i = 0; i < npanes; i++) {
+    p = &panes[i];
+    if (p->fd < 0 && pane_open(p, 1) == 0)
+      pane_title(p->title, i + 1);
+    if (p->cap)
+      fflush(p->cap);
+  }
+}
+
+/*
+ * Put the cursor in the window that has the keyboard.
+ */
+void pane_cursor(void)
+{
+  WIN *w;
+
+  if (npanes == 0)
+    return;
+  w = focus ? panes[focus - 1].w : us;
+  if (w)
+    mc_wlocate(w, w->curx, w->cury);
+}
+
+/*
+ * Give the keyboard to the next (dir 1) or previous (dir -1) tile.
+ */
+void pane_focus(int dir)
+{
+  if (npanes == 0 || main_title == NULL)
+    return;
+  focus = (focus + dir + npanes + 1) % (npanes + 1);
+  pane_titles();
+  pane_cursor();
+  mc_wflush();
+}
+
+/*
+ * Does a pane, rather than the main port, have the keyboard?
+ */
+int pane_focused(void)
+{
+  return focus && panes[focus - 1].w;
+}
+
+/*
+ * A key for the pane that has the keyboard.
+ */
+void pane_send(int c)
+{
+  struct pane *p = &panes[focus - 1];
+
+  if (p->vt)
+    vt_key(p->vt, c);
+}
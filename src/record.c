@@ -0,0 +1,373 @@
+/*
+ * record.c	Session recording (-O record=FILE) and reading it back.
+ *
+ *		Everything read from and written to the port is stored
+ *		as it went, each read or write with the time it
+ *		happened, so a session can be played back later with
+ *		--replay at the speed it came in. Line timestamps in the
+ *		capture file can not be told apart from the data; these
+ *		can.
+ *
+ *		The file starts with a header of 16 bytes: the magic
+ *		"MCREC01\n" and the wall clock time the recording began,
+ *		in nanoseconds since the epoch. Then come the records,
+ *		each a header of 16 bytes and the data:
+ *
+ *		  8 bytes  nanoseconds since the start (monotonic clock)
+ *		  4 bytes  length of the data, at most REC_CHUNK
+ *		  1 byte   REC_RX (from the port) or REC_TX (to it)
+ *		  3 bytes  zero
+ *
+ *		Numbers are little endian. FILE.idx has the magic
+ *		"MCIDX01\n", then an entry of 16 bytes, time and offset
+ *		of a record, for every REC_STEP bytes of recording, so
+ *		playback can start anywhere in a big file without
+ *		reading it all. It runs the data from the entry before
+ *		through the emulation first, to have the screen right.
+ *
+ *		Both files are only appended to, from a buffer that is
+ *		written out when it is full or a second after the first
+ *		byte went into it. If a write fails the recording stops:
+ *		a record cut short is where playback ends, and nothing
+ *		may come after it.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+
+#include "port.h"
+#include "minicom.h"
+#include "intl.h"
+
+#define REC_MAGIC	"MCREC01\n"
+#define IDX_MAGIC	"MCIDX01\n"
+#define REC_HDR		16
+#define REC_BUFSIZE	(REC_CHUNK * 2)
+#define REC_STEP	(256 * 1024)	/* Bytes between index entries */
+#define REC_LATENCY	1000		/* ms data waits in the buffer */
+#define IDX_MAX		64		/* Index entries held back */
+
+const char *rec_file;		/* -O record=FILE */
+
+static int rec_fd = -1;
+static int idx_fd = -1;
+static unsigned long long rec_t0;	/* stats_ns() at the start */
+static unsigned long long rec_off;	/* Size of the file, with the buffer */
+static unsigned long long idx_off;	/* Offset of the last index entry */
+static char *rec_buf;
+static size_t rec_len;
+static unsigned char idx_buf[IDX_MAX * 16];
+static int idx_len;
+static int rec_timer = -1;
+
+static void put64(unsigned char *p, unsigned long long v)
+{
+  int i;
+
+  for (i = 0; i < 8; i++)
+    p[i] = v >> (8 * i);
+}
+
+static unsigned long long get64(const unsigned char *p)
+{
+  unsigned long long v = 0;
+  int i;
+
+  for (i = 7; i >= 0; i--)
+    v = v << 8 | p[i];
+  return v;
+}
+
+/* Write all of it. Returns -1 if that failed, with errno set. */
+static int rec_out(int fd, const void *p, size_t len)
+{
+  const char *s = p;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, s, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      if (n == 0)
+        errno = ENOSPC;
+      return -1;
+    }
+    s += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * A write failed (disk full, say): stop recording and say so.
+ */
+static void rec_fail(void)
+{
+  char msg[128];
+  int err = errno;
+
+  rec_len = 0;
+  idx_len = 0;
+  rec_close();
+  snprintf(msg, sizeof(msg), _("Recording to %s stopped: %s"), rec_file,
+           strerror(err));
+  if (headless)
+    fprintf(stderr, "%s\n", msg);
+  else
+    status_set_display(msg, 5);
+}
+
+/*
+ * Write out the buffer, then the index entries for it: an entry
+ * never points past the end of the recording.
+ */
+void rec_flush(void)
+{
+  if (rec_len) {
+    if (rec_out(rec_fd, rec_buf, rec_len) < 0) {
+      rec_fail();
+      return;
+    }
+    rec_len = 0;
+  }
+  if (idx_len) {
+    if (rec_out(idx_fd, idx_buf, idx_len) < 0) {
+      rec_fail();
+      return;
+    }
+    idx_len = 0;
+  }
+}
+
+static void rec_due(int id, void *data)
+{
+  (void)id;
+  (void)data;
+  rec_timer = -1;
+  rec_flush();
+}
+
+/*
+ * Start a recording in file name, and its index in name.idx. Both
+ * are emptied first. Returns -1 if they can not be opened.
+ */
+int rec_open(const char *name)
+{
+  unsigned char hdr[REC_HDR];
+  char idx[PATH_MAX];
+  struct timespec ts;
+
+  snprintf(idx, sizeof(idx), "%s.idx", name);
+  if ((rec_buf = malloc(REC_BUFSIZE)) == NULL)
+    return -1;
+  if ((rec_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+      (idx_fd = open(idx, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    rec_close();
+    return -1;
+  }
+  clock_gettime(CLOCK_REALTIME, &ts);
+  memcpy(hdr, REC_MAGIC, 8);
+  put64(hdr + 8, (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+  if (rec_out(rec_fd, hdr, REC_HDR) < 0 || rec_out(idx_fd, IDX_MAGIC, 8) < 0) {
+    rec_close();
+    return -1;
+  }
+  rec_t0 = stats_ns();
+  rec_off = REC_HDR;
+  idx_off = 0;
+  return 0;
+}
+
+void rec_close(void)
+{
+  if (rec_timer >= 0) {
+    ev_timer_del(rec_timer);
+    rec_timer = -1;
+  }
+  if (rec_fd >= 0) {
+    rec_flush();
+    close(rec_fd);
+  }
+  if (idx_fd >= 0)
+    close(idx_fd);
+  rec_fd = idx_fd = -1;
+  free(rec_buf);
+  rec_buf = NULL;
+}
+
+/*
+ * Record len bytes that were read from (REC_RX) or written to
+ * (REC_TX) the port just now.
+ */
+void rec_put(int type, const char *p, size_t len)
+{
+  unsigned long long ns;
+  unsigned char *h;
+  size_t n;
+
+  if (rec_fd < 0 || len == 0)
+    return;
+  ns = stats_ns() - rec_t0;
+  while (len > 0) {
+    n = len > REC_CHUNK ? REC_CHUNK : len;
+    if (rec_len + REC_HDR + n > REC_BUFSIZE ||
+        (idx_off + REC_STEP <= rec_off && idx_len == sizeof(idx_buf))) {
+      rec_flush();
+      if (rec_fd < 0)
+        return;
+    }
+    if (idx_off == 0 || idx_off + REC_STEP <= rec_off) {
+      put64(idx_buf + idx_len, ns);
+      put64(idx_buf + idx_len + 8, rec_off);
+      idx_len += 16;
+      idx_off = rec_off;
+    }
+    h = (unsigned char *)rec_buf + rec_len;
+    put64(h, ns);
+    h[8] = n;
+    h[9] = n >> 8;
+    h[10] = n >> 16;
+    h[11] = n >> 24;
+    h[12] = type;
+    h[13] = h[14] = h[15] = 0;
+    memcpy(rec_buf + rec_len + REC_HDR, p, n);
+    rec_len += REC_HDR + n;
+    rec_off += REC_HDR + n;
+    p += n;
+    len -= n;
+  }
+  if (rec_timer < 0 &&
+      (rec_timer = ev_timer_add(REC_LATENCY, 0, rec_due, NULL)) < 0)
+    rec_flush();
+}
+
+/*
+ * Is fp a recording? If so, leave it at the first record, if not
+ * at the start.
+ */
+int rec_check(FILE *fp)
+{
+  char hdr[REC_HDR];
+
+  if (fread(hdr, 1, REC_HDR, fp) == REC_HDR && !memcmp(hdr, REC_MAGIC, 8))
+    return 1;
+  rewind(fp);
+  return 0;
+}
+
+/*
+ * The next record: its type and time, and up to size bytes of data
+ * in buf. Returns the length, 0 at the end, -1 if the file is bad.
+ */
+int rec_next(FILE *fp, int *type, unsigned long long *ns, char *buf,
+             size_t size)
+{
+  unsigned char h[REC_HDR];
+  size_t len;
+
+  if (fread(h, 1, REC_HDR, fp) != REC_HDR)
+    return 0;
+  len = h[8] | h[9] << 8 | h[10] << 16 | (size_t)h[11] << 24;
+  *ns = get64(h);
+  *type = h[12];
+  if (len > size)
+    return -1;
+  /* Cut off by a crash: the end. */
+  if (fread(buf, 1, len, fp) != len)
+    return 0;
+  return len;
+}
+
+/*
+ * Index entries for a recording without FILE.idx, from the record
+ * headers. Slow for big files, but it beats feeding them all to the
+ * emulation.
+ */
+static unsigned char *rec_scan(FILE *fp, size_t *count)
+{
+  unsigned char h[REC_HDR], *idx = NULL, *p;
+  unsigned long long off = REC_HDR, last = 0;
+  size_t n = 0, size = 0, len;
+
+  while (fseeko(fp, off, SEEK_SET) == 0 && fread(h, 1, REC_HDR, fp) == REC_HDR) {
+    if (n == 0 || last + REC_STEP <= off) {
+      if (n == size) {
+        size = size ? size * 2 : 256;
+        if ((p = realloc(idx, size * 16)) == NULL)
+          break;
+        idx = p;
+      }
+      memcpy(idx + n * 16, h, 8);
+      put64(idx + n * 16 + 8, off);
+      last = off;
+      n++;
+    }
+    len = h[8] | h[9] << 8 | h[10] << 16 | (size_t)h[11] << 24;
+    off += REC_HDR + len;
+  }
+  *count = n;
+  return idx;
+}
+
+/*
+ * Go to where playback has to start for the screen to be right at
+ * ns nanoseconds into recording name: the index entry before the
+ * last one that is not later than that. Returns -1 if that can not
+ * be found, and fp is at the first record.
+ */
+int rec_seek(FILE *fp, const char *name, unsigned long long ns)
+{
+  char path[PATH_MAX];
+  unsigned char *idx = NULL;
+  size_t n = 0, lo, hi, mid;
+  struct stat st;
+  FILE *ip;
+
+  snprintf(path, sizeof(path), "%s.idx", name);
+  if ((ip = fopen(path, "r")) != NULL) {
+    char magic[8];
+
+    if (fstat(fileno(ip), &st) == 0 && st.st_size >= 8 &&
+        fread(magic, 1, 8, ip) == 8 && !memcmp(magic, IDX_MAGIC, 8) &&
+        (idx = malloc(st.st_size - 8 + 1)) != NULL)
+      n = fread(idx, 1, st.st_size - 8, ip) / 16;
+    fclose(ip);
+  }
+  if (n == 0) {
+    free(idx);
+    idx = rec_scan(fp, &n);
+  }
+  if (n == 0) {
+    free(idx);
+    fseeko(fp, REC_HDR, SEEK_SET);
+    return -1;
+  }
+
+  /* The first entry later than ns. */
+  lo = 0;
+  hi = n;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (get64(idx + mid * 16) <= ns)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  lo = lo >= 2 ? lo - 2 : 0;
+  fseeko(fp, get64(idx + lo * 16 + 8), SEEK_SET);
+  free(idx);
+  return 0;
+}
@@ -0,0 +1,478 @@
+/*
+ * rxbuf.c	Receive buffer for data from the serial port.
+ *
+ *		A ring buffer that is filled with readv() and grows when
+ *		the line delivers more than fits, up to RX_MAX_SIZE, and
+ *		shrinks back when the line has been quiet for a while.
+ *		Each wakeup drains everything the kernel has buffered,
+ *		so at high line rates there are few, large reads instead
+ *		of many small ones.
+ *
+ *		While a menu is open the port is still read into the
+ *		buffer (see ingest_start() in main.c), which may then grow
+ *		up to RX_HOLD_SIZE.
+ *
+ *		Raw capture ("-O capture=raw") also happens here, on the
+ *		bytes exactly as they came from the port. Where the
+ *		kernel allows it the data goes to the capture file with
+ *		splice() and tee() and never passes through user space
+ *		for that; otherwise every read is written out in one go.
+ *		Each read also goes to the session recording, if there
+ *		is one (see record.c).
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+
+#include "port.h"
+#include "minicom.h"
+
+#define RX_MIN_SIZE	4096
+#define RX_MAX_SIZE	(256 * 1024)
+#define RX_HOLD_SIZE	(16 * 1024 * 1024)
+
+static char *rx_data;
+static size_t rx_size;		/* always a power of two */
+static size_t rx_head;		/* next byte to write */
+static size_t rx_tail;		/* next byte to read */
+static size_t rx_len;		/* bytes in the buffer */
+static size_t rx_recent_peak;	/* highest rx_len since the last rx_idle() */
+static size_t rx_max = RX_MAX_SIZE;	/* rx_fill() grows the ring up to this */
+static struct timeval rx_time;	/* when the reader thread got the data */
+static int rx_time_valid;
+
+static int cap_fd = -1;		/* raw capture file */
+#ifdef HAVE_SPLICE
+static int cap_splice = 1;	/* cleared when splicing does not work */
+static int cap_pipe[2] = { -1, -1 };	/* port -> us */
+static int cap_tee[2] = { -1, -1 };	/* copy of cap_pipe -> file */
+static size_t cap_pipe_size;
+#endif
+
+struct rx_stats rx_stats;
+
+/*
+ * Reallocate the ring to newsize bytes, moving the data to the start.
+ */
+static int rx_resize(size_t newsize)
+{
+  char *p;
+  size_t first;
+
+  if (newsize < rx_len)
+    return -1;
+  if ((p = malloc(newsize)) == NULL)
+    return -1;
+  if (rx_len) {
+    first = rx_size - rx_tail;
+    if (first > rx_len)
+      first = rx_len;
+    memcpy(p, rx_data + rx_tail, first);
+    memcpy(p + first, rx_data, rx_len - first);
+  }
+  free(rx_data);
+  rx_data = p;
+  rx_size = newsize;
+  rx_tail = 0;
+  rx_head = rx_len & (rx_size - 1);
+  rx_stats.size = rx_size;
+  return 0;
+}
+
+/*
+ * Write len bytes of the ring, starting at position start, to the
+ * raw capture file.
+ */
+static void cap_ring(size_t start, size_t len)
+{
+  struct iovec iov[2];
+  int iovcnt = 1;
+  ssize_t n;
+
+  iov[0].iov_base = rx_data + start;
+  iov[0].iov_len = len;
+  if (start + len > rx_size) {
+    iov[0].iov_len = rx_size - start;
+    iov[1].iov_base = rx_data;
+    iov[1].iov_len = len - iov[0].iov_len;
+    iovcnt = 2;
+  }
+  while (len > 0) {
+    n = writev(cap_fd, iov, iovcnt);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    mc_stats.cap_bytes += n;
+    mc_stats.cap_writes++;
+    len -= n;
+    if ((size_t)n >= iov[0].iov_len) {
+      n -= iov[0].iov_len;
+      iov[0] = iov[1];
+      iovcnt = 1;
+    }
+    iov[0].iov_base = (char *)iov[0].iov_base + n;
+    iov[0].iov_len -= n;
+  }
+}
+
+/*
+ * Record len bytes of the ring, starting at position start (-O record).
+ */
+static void rec_ring(size_t start, size_t len)
+{
+  size_t first = rx_size - start;
+
+  if (first > len)
+    first = len;
+  rec_put(REC_RX, rx_data + start, first);
+  if (len > first)
+    rec_put(REC_RX, rx_data, len - first);
+}
+
+#ifdef HAVE_SPLICE
+static int cap_pipes(void)
+{
+  int i;
+
+  if (pipe(cap_pipe) < 0)
+    return -1;
+  if (pipe(cap_tee) < 0) {
+    close(cap_pipe[0]);
+    close(cap_pipe[1]);
+    cap_pipe[0] = cap_pipe[1] = -1;
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    fcntl(cap_pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(cap_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(cap_tee[i], F_SETFL, O_NONBLOCK);
+    fcntl(cap_tee[i], F_SETFD, FD_CLOEXEC);
+  }
+  cap_pipe_size = 65536;
+#ifdef F_SETPIPE_SZ
+  if (fcntl(cap_pipe[1], F_SETPIPE_SZ, RX_MAX_SIZE) >= 0 &&
+      fcntl(cap_tee[1], F_SETPIPE_SZ, RX_MAX_SIZE) >= 0)
+    cap_pipe_size = RX_MAX_SIZE;
+#endif
+  return 0;
+}
+
+/*
+ * Read from the port for raw capture: splice the port into a pipe,
+ * tee() that into a second pipe which is spliced into the capture
+ * file, and read our own copy from the first pipe into iov. Returns
+ * what the read returned and sets *capped to the number of bytes
+ * that went to the file, or returns -2 if splicing can not be used
+ * and the caller should fall back to a plain read.
+ */
+static int cap_splice_read(int fd, struct iovec *iov, int iovcnt,
+                           size_t want, size_t *capped)
+{
+  char buf[4096];
+  ssize_t n, t, w;
+
+  *capped = 0;
+  if (cap_pipe[0] < 0 && cap_pipes() < 0) {
+    cap_splice = 0;
+    return -2;
+  }
+  if (want > cap_pipe_size)
+    want = cap_pipe_size;
+
+  n = splice(fd, NULL, cap_pipe[1], NULL, want, SPLICE_F_NONBLOCK);
+  if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+    /* This kernel can not splice from a tty (or the file is odd). */
+    cap_splice = 0;
+    return -2;
+  }
+  if (n <= 0)
+    return n;
+
+  t = tee(cap_pipe[0], cap_tee[1], n, SPLICE_F_NONBLOCK);
+  if (t > 0) {
+    *capped = t;
+    mc_stats.cap_bytes += t;
+    mc_stats.cap_writes++;
+    while (t > 0) {
+      w = splice(cap_tee[0], NULL, cap_fd, NULL, t, 0);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+        break;
+      t -= w;
+    }
+    if (t > 0) {
+      /* The file does not take spliced data: copy what is left. */
+      cap_splice = 0;
+      while ((w = read(cap_tee[0], buf, sizeof(buf))) > 0)
+        if (write(cap_fd, buf, w) != w)
+          break;
+    }
+  }
+  return readv(cap_pipe[0], iov, iovcnt);
+}
+#endif /* HAVE_SPLICE */
+
+/*
+ * Capture the raw port data to fd from now on, or stop if fd < 0.
+ */
+void rx_capture(int fd)
+{
+  int fl;
+
+  cap_fd = fd;
+  if (fd < 0)
+    return;
+  /* splice() refuses files opened for appending. We are the only
+   * writer, so start at the end and drop O_APPEND instead. */
+  fl = fcntl(fd, F_GETFL);
+  if (fl >= 0 && (fl & O_APPEND) && lseek(fd, 0, SEEK_END) >= 0)
+    fcntl(fd, F_SETFL, fl & ~O_APPEND);
+}
+
+/*
+ * Move what the reader thread has read into the buffer.
+ */
+static int rx_pull(void)
+{
+  int n;
+
+  n = rxt_pull(&rx_time);
+  if (n > 0) {
+    rx_time_valid = 1;
+    rx_stats.reads++;
+    rx_stats.bytes += n;
+    if (cap_fd >= 0)
+      cap_ring((rx_head - n) & (rx_size - 1), n);
+    rec_ring((rx_head - n) & (rx_size - 1), n);
+  }
+  return n;
+}
+
+/*
+ * Take what the reader thread read before it was stopped, so that it
+ * comes before anything that is read from the port from now on.
+ */
+void rx_leftover(void)
+{
+  while (rx_pull() > 0)
+    ;
+}
+
+/*
+ * Read everything that is available from fd into the buffer.
+ * Returns the number of bytes read, 0 on end of file, -1 on error,
+ * or -1 with errno EAGAIN if there is nothing to read or no room.
+ */
+int rx_fill(int fd)
+{
+  struct iovec iov[2];
+  int avail = 0, iovcnt, n;
+  size_t want, room, capped = 0;
+
+  if (!rx_data && rx_resize(RX_MIN_SIZE) < 0)
+    return -1;
+
+  if ((rxt_running() || rxt_pending()) && !ev_io_buffered(fd)) {
+    /* The reader thread has done the reading for us. What it read
+     * comes first, also when it has been stopped since. */
+    n = rx_pull();
+#ifdef USE_SOCKET
+    if (n <= 0 && !(n < 0 && errno == EAGAIN) && portfd_is_socket && portfd == fd)
+      term_socket_close();
+#endif /* USE_SOCKET */
+    return n;
+  }
+
+  /* Make room for what the driver has buffered, within reason, or
+   * for what the event loop has read for us. */
+  if ((avail = ev_io_buffered(fd)) == 0 &&
+      (ioctl(fd, FIONREAD, &avail) < 0 || avail < 1))
+    avail = 1;
+  want = avail;
+  while (rx_size - rx_len < want && rx_size < rx_max)
+    if (rx_resize(rx_size * 2) < 0)
+      break;
+
+  room = rx_size - rx_len;
+  if (room == 0) {
+    /* Full: the port is fine, the caller has to make room first. */
+    errno = EAGAIN;
+    return -1;
+  }
+  if (want > room)
+    want = room;
+
+  /* Free space is [head, end) followed by [0, tail). */
+  iov[0].iov_base = rx_data + rx_head;
+  if (rx_head >= rx_tail && rx_len < rx_size) {
+    iov[0].iov_len = rx_size - rx_head;
+    iov[1].iov_base = rx_data;
+    iov[1].iov_len = rx_tail;
+  } else {
+    iov[0].iov_len = rx_tail - rx_head;
+    iov[1].iov_base = rx_data;
+    iov[1].iov_len = 0;
+  }
+  if (iov[0].iov_len >= want) {
+    iov[0].iov_len = want;
+    iovcnt = 1;
+  } else {
+    iov[1].iov_len = want - iov[0].iov_len;
+    iovcnt = 2;
+  }
+
+  n = -2;
+#ifdef HAVE_SPLICE
+  if (cap_fd >= 0 && cap_splice && !ev_io_buffered(fd))
+    n = cap_splice_read(fd, iov, iovcnt, want, &capped);
+#endif
+  if (n == -2)
+    n = ev_readv(fd, iov, iovcnt);
+
+#ifdef USE_SOCKET
+  if (n < 1 && portfd_is_socket && portfd == fd) {
+    term_socket_close();
+    return 0;
+  }
+#endif /* USE_SOCKET */
+
+  if (n <= 0)
+    return n;
+
+  if (cap_fd >= 0 && capped < (size_t)n)
+    cap_ring((rx_head + capped) & (rx_size - 1), n - capped);
+  rec_ring(rx_head, n);
+  rx_head = (rx_head + n) & (rx_size - 1);
+  rx_len += n;
+  if (rx_len > rx_recent_peak)
+    rx_recent_peak = rx_len;
+  if (rx_len > rx_stats.peak)
+    rx_stats.peak = rx_len;
+  rx_stats.reads++;
+  rx_stats.bytes += n;
+  rx_stats.used = rx_len;
+  return n;
+}
+
+/*
+ * Return the number of buffered bytes and point *p at them.
+ * If the data wraps around the end of the ring it is moved so
+ * that the caller always sees all of it in one piece.
+ */
+size_t rx_peek(char **p)
+{
+  *p = rx_data + rx_tail;
+  if (rx_len && rx_tail + rx_len > rx_size) {
+    if (rx_resize(rx_size) < 0)
+      return rx_size - rx_tail;
+    *p = rx_data;
+  }
+  return rx_len;
+}
+
+/* Drop n bytes from the front of the buffer. */
+void rx_consume(size_t n)
+{
+  if (n > rx_len)
+    n = rx_len;
+  rx_len -= n;
+  rx_tail = (rx_tail + n) & (rx_size - 1);
+  /* Keep the data at the start so it rarely wraps. */
+  if (rx_len == 0) {
+    rx_head = rx_tail = 0;
+    rx_time_valid = 0;
+  }
+  rx_stats.used = rx_len;
+}
+
+size_t rx_used(void)
+{
+  return rx_len;
+}
+
+/* Is the buffer as big and as full as rx_fill() lets it get? */
+int rx_full(void)
+{
+  return rx_data && rx_len == rx_size && rx_size >= rx_max;
+}
+
+/* How much more rx_put() can take without growing past RX_MAX_SIZE. */
+size_t rx_room(void)
+{
+  return (rx_size > RX_MAX_SIZE ? rx_size : RX_MAX_SIZE) - rx_len;
+}
+
+/*
+ * Append len bytes to the buffer, growing it as needed.
+ */
+void rx_put(const char *p, size_t len)
+{
+  size_t n;
+
+  if (len == 0)
+    return;
+  if (!rx_data && rx_resize(RX_MIN_SIZE) < 0)
+    return;
+  while (rx_size - rx_len < len)
+    if (rx_resize(rx_size * 2) < 0)
+      return;
+
+  n = rx_size - rx_head;
+  if (n > len)
+    n = len;
+  memcpy(rx_data + rx_head, p, n);
+  memcpy(rx_data, p + n, len - n);
+  rx_head = (rx_head + len) & (rx_size - 1);
+  rx_len += len;
+  if (rx_len > rx_recent_peak)
+    rx_recent_peak = rx_len;
+  if (rx_len > rx_stats.peak)
+    rx_stats.peak = rx_len;
+  rx_stats.used = rx_len;
+}
+
+/*
+ * Nothing empties the buffer while a menu is open: let it grow
+ * further then, so that the port can still be read.
+ */
+void rx_hold(int on)
+{
+  rx_max = on ? RX_HOLD_SIZE : RX_MAX_SIZE;
+}
+
+/*
+ * Time the data now in the buffer was read by the reader thread,
+ * or NULL if it was read by the main loop itself.
+ */
+const struct timeval *rx_arrival(void)
+{
+  return rx_time_valid ? &rx_time : NULL;
+}
+
+/*
+ * Called once a second. If the buffer was mostly empty during that
+ * time, give memory back by halving it.
+ */
+void rx_idle(void)
+{
+  if (rx_size > RX_MIN_SIZE && rx_recent_peak < rx_size / 4 &&
+      rx_len <= rx_size / 2)
+    rx_resize(rx_size / 2);
+  rx_recent_peak = rx_len;
+}
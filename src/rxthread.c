@@ -0,0 +1,355 @@
+/*
+ * rxthread.c	Serial port reader thread.
+ *
+ *		With "-O reader=thread" a separate thread reads the serial
+ *		port while minicom is in terminal mode, and hands the data
+ *		to the main loop through a single-producer/single-consumer
+ *		ring buffer.  The reader never waits for the screen, so a
+ *		slow terminal (ssh, tmux) can not make the UART or the
+ *		kernel tty buffer overflow.  If the ring itself fills up
+ *		the reader keeps draining the port and counts what it has
+ *		to throw away.
+ *
+ *		Every chunk carries the time it was read, which is used
+ *		for the line timestamps.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "port.h"
+#include "minicom.h"
+
+int rxt_enabled;		/* -O reader=thread */
+size_t rxt_ring_kb = 1024;	/* -O readerbuf=KB */
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H)
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/uio.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#define RXT_CHUNKS	4096	/* must be a power of two */
+
+struct rxt_chunk {
+  uint32_t len;
+  struct timeval tv;		/* when it was read */
+};
+
+/*
+ * The reader owns data_head/chunk_head, the main loop owns
+ * data_tail/chunk_tail. Positions only ever increase; they are
+ * masked when used as an index.
+ */
+static char *data;
+static size_t data_size;
+static struct rxt_chunk chunks[RXT_CHUNKS];
+static atomic_size_t data_head, data_tail;
+static atomic_uint chunk_head, chunk_tail;
+
+static atomic_int done;		/* reader saw EOF or an error */
+static atomic_ulong dropped;	/* bytes thrown away, ring full */
+static atomic_size_t ring_peak;	/* highest ring occupancy */
+static int done_errno;
+static int running;
+static pthread_t reader;
+static int port;
+static int notify_fd[2] = { -1, -1 };	/* reader -> main loop */
+static int stop_fd[2] = { -1, -1 };	/* main loop -> reader */
+
+static void notify(int fd)
+{
+  uint64_t one = 1;
+
+  /* A full pipe is fine: the main loop is going to wake up anyway. */
+  if (write(fd, &one, notify_fd[0] == notify_fd[1] ? sizeof(one) : 1) < 0)
+    return;
+}
+
+static void drain_notify(void)
+{
+  char buf[64];
+
+  while (read(notify_fd[0], buf, sizeof(buf)) > 0)
+    if (notify_fd[0] == notify_fd[1])
+      break;
+}
+
+static void *reader_main(void *arg)
+{
+  struct pollfd pfd[2];
+  char scratch[4096];
+  struct iovec iov[2];
+  size_t head, tail, room, off;
+  unsigned ch, ct;
+  int n;
+
+  (void)arg;
+  pfd[0].fd = port;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = stop_fd[0];
+  pfd[1].events = POLLIN;
+
+  for (;;) {
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (pfd[1].revents)
+      break;
+
+    head = atomic_load_explicit(&data_head, memory_order_relaxed);
+    tail = atomic_load_explicit(&data_tail, memory_order_acquire);
+    ch = atomic_load_explicit(&chunk_head, memory_order_relaxed);
+    ct = atomic_load_explicit(&chunk_tail, memory_order_acquire);
+    room = data_size - (head - tail);
+
+    if (room == 0 || ch - ct == RXT_CHUNKS) {
+      /* No room: keep the port drained, throw the data away. */
+      n = read(port, scratch, sizeof(scratch));
+      if (n > 0) {
+        atomic_fetch_add_explicit(&dropped, n, memory_order_relaxed);
+        notify(notify_fd[1]);
+        continue;
+      }
+    } else {
+      off = head & (data_size - 1);
+      iov[0].iov_base = data + off;
+      iov[0].iov_len = data_size - off;
+      iov[1].iov_base = data;
+      iov[1].iov_len = 0;
+      if (iov[0].iov_len > room)
+        iov[0].iov_len = room;
+      else
+        iov[1].iov_len = room - iov[0].iov_len;
+      n = readv(port, iov, iov[1].iov_len ? 2 : 1);
+      if (n > 0) {
+        struct rxt_chunk *c = &chunks[ch & (RXT_CHUNKS - 1)];
+
+        c->len = n;
+        gettimeofday(&c->tv, NULL);
+        atomic_store_explicit(&data_head, head + n, memory_order_release);
+        atomic_store_explicit(&chunk_head, ch + 1, memory_order_release);
+        if (head + n - tail > atomic_load_explicit(&ring_peak,
+                                                   memory_order_relaxed))
+          atomic_store_explicit(&ring_peak, head + n - tail,
+                                memory_order_relaxed);
+        notify(notify_fd[1]);
+        continue;
+      }
+    }
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+
+    /* EOF or error: let the main loop find out what happened. */
+    done_errno = n < 0 ? errno : 0;
+    atomic_store_explicit(&done, 1, memory_order_release);
+    notify(notify_fd[1]);
+    break;
+  }
+  return NULL;
+}
+
+/*
+ * Start reading fd in the reader thread. Returns 0 on success.
+ */
+int rxt_start(int fd)
+{
+  sigset_t all, old;
+  size_t size;
+  int err;
+
+  if (running)
+    return 0;
+  if (fd < 0)
+    return -1;
+
+  if (!data) {
+    for (size = 4096; size < rxt_ring_kb * 1024 && size < ((size_t)1 << 30);
+         size <<= 1)
+      ;
+    if ((data = malloc(size)) == NULL)
+      return -1;
+    data_size = size;
+    rx_stats.ring_size = size;
+  }
+  if (notify_fd[0] < 0) {
+#ifdef HAVE_SYS_EVENTFD_H
+    notify_fd[0] = notify_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    if (notify_fd[0] < 0) {
+      if (pipe(notify_fd) < 0)
+        return -1;
+      fcntl(notify_fd[0], F_SETFL, O_NONBLOCK);
+      fcntl(notify_fd[1], F_SETFL, O_NONBLOCK);
+      fcntl(notify_fd[0], F_SETFD, FD_CLOEXEC);
+      fcntl(notify_fd[1], F_SETFD, FD_CLOEXEC);
+    }
+  }
+  if (pipe(stop_fd) < 0)
+    return -1;
+
+  port = fd;
+  atomic_store(&done, 0);
+
+  /* Signals are for the main thread. */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  err = pthread_create(&reader, NULL, reader_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    close(stop_fd[0]);
+    close(stop_fd[1]);
+    return -1;
+  }
+  running = 1;
+  return 0;
+}
+
+/*
+ * Stop the reader thread. Data it has read goes to the receive
+ * buffer, where it is ahead of anything the caller reads from the
+ * port itself.
+ */
+void rxt_stop(void)
+{
+  if (!running)
+    return;
+  if (write(stop_fd[1], "", 1) != 1)
+    pthread_cancel(reader);
+  pthread_join(reader, NULL);
+  close(stop_fd[0]);
+  close(stop_fd[1]);
+  running = 0;
+  rx_leftover();
+}
+
+int rxt_running(void)
+{
+  return running;
+}
+
+/* The fd the main loop waits on instead of the port. */
+int rxt_fd(void)
+{
+  return running ? notify_fd[0] : -1;
+}
+
+/* Is there data in the ring that has not been pulled yet? */
+int rxt_pending(void)
+{
+  return atomic_load_explicit(&chunk_head, memory_order_acquire) !=
+         atomic_load_explicit(&chunk_tail, memory_order_relaxed);
+}
+
+/*
+ * Move chunks from the ring into the receive buffer, as many as fit.
+ * *tv is set to the time the first one was read. Returns the number
+ * of bytes moved, 0 if the reader has seen EOF, -1 with errno set on
+ * error or EAGAIN if there is nothing yet.
+ */
+int rxt_pull(struct timeval *tv)
+{
+  size_t head, tail, off, n;
+  unsigned ch, ct;
+  int total = 0;
+
+  if (notify_fd[0] >= 0)
+    drain_notify();
+
+  ct = atomic_load_explicit(&chunk_tail, memory_order_relaxed);
+  ch = atomic_load_explicit(&chunk_head, memory_order_acquire);
+  tail = atomic_load_explicit(&data_tail, memory_order_relaxed);
+  head = atomic_load_explicit(&data_head, memory_order_acquire);
+
+  while (ct != ch) {
+    struct rxt_chunk *c = &chunks[ct & (RXT_CHUNKS - 1)];
+
+    if (total && rx_room() < c->len) {
+      /* Rest next time round; make sure there is a next time. */
+      notify(notify_fd[1]);
+      break;
+    }
+    if (total == 0 && tv)
+      *tv = c->tv;
+    off = tail & (data_size - 1);
+    n = data_size - off;
+    if (n > c->len)
+      n = c->len;
+    rx_put(data + off, n);
+    rx_put(data, c->len - n);
+    tail += c->len;
+    total += c->len;
+    ct++;
+  }
+  atomic_store_explicit(&data_tail, tail, memory_order_release);
+  atomic_store_explicit(&chunk_tail, ct, memory_order_release);
+  rx_stats.ring_used = head - tail;
+  rx_stats.ring_peak = atomic_load_explicit(&ring_peak, memory_order_relaxed);
+  rx_stats.dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+
+  if (total)
+    return total;
+  if (atomic_load_explicit(&done, memory_order_acquire)) {
+    int e = done_errno;
+
+    /* Thread has exited; reap it. */
+    rxt_stop();
+    errno = e;
+    return e ? -1 : 0;
+  }
+  errno = EAGAIN;
+  return -1;
+}
+
+#else /* HAVE_PTHREAD_H && HAVE_STDATOMIC_H */
+
+int rxt_start(int fd)
+{
+  (void)fd;
+  return -1;
+}
+
+void rxt_stop(void)
+{
+}
+
+int rxt_running(void)
+{
+  return 0;
+}
+
+int rxt_fd(void)
+{
+  return -1;
+}
+
+int rxt_pending(void)
+{
+  return 0;
+}
+
+int rxt_pull(struct timeval *tv)
+{
+  (void)tv;
+  errno = EAGAIN;
+  return -1;
+}
+
+#endif /* HAVE_PTHREAD_H && HAVE_STDATOMIC_H */
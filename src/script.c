@@ -34,6 +34,7 @@
 
 #include <sys/wait.h>
 #include <stdarg.h>
+#include <regex.h>
 
 #include "port.h"
 #include "minicom.h"
@@ -87,8 +88,6 @@ int laststatus = 0;		/* Status of last command */
 char homedir[256];		/* Home directory */
 char logfname[PARS_VAL_LEN];	/* Name of logfile */
 
-static char inbuf[65];		/* Input buffer. */
-
 /* Forward declarations */
 int s_exec(char *);
 int execscript(const char *);
@@ -385,50 +384,305 @@ static int readscript(const char *s)
   return 0;
 }
 
-/* Read one character, and store it in the buffer. */
-void readchar(void)
+/*
+ * Input from the modem is read a block at a time into inbuf. The
+ * patterns of an expect are compiled into one Aho-Corasick automaton,
+ * which looks at every byte once, however many patterns there are
+ * and however long they are. "regex" patterns are tried on the line
+ * as it comes in, at its end and whenever the input stops for a
+ * moment.
+ */
+#define INBUF_SIZE	4096
+#define TAIL_SIZE	256	/* Input kept for a new set of patterns */
+#define LINE_SIZE	4096	/* Longest line a regex sees */
+#define MAX_EXPECT	16
+
+static char inbuf[INBUF_SIZE];	/* Input buffer. */
+static int inpos, inlen;
+static char tail[TAIL_SIZE];	/* The last input looked at */
+static int taillen;
+
+struct matcher {
+  int npat;
+  char *text[MAX_EXPECT];	/* The pattern, after getword() */
+  int len[MAX_EXPECT];
+  int isre[MAX_EXPECT];
+  regex_t re[MAX_EXPECT];
+  int nre;			/* How many are regexes */
+  char *action[MAX_EXPECT];
+  unsigned char cls[256];	/* Bytes that are in no pattern are 0 */
+  int ncls;
+  int nstates;
+  int *next;			/* Next state, for every state and class */
+  int *out;			/* First pattern ending in a state, or -1 */
+  int state;
+  char line[LINE_SIZE];		/* This line so far, for the regexes */
+  int linelen;
+};
+
+static struct matcher *matcher;	/* That of the running expect */
+
+static void nomem(void)
 {
-  char c;
-  int n;
+  fprintf(stderr, _("script \"%s\": out of memory%s\n"),
+          curenv->scriptname, "\r");
+  exit(1);
+}
 
-  while ((n = read(0, &c, 1)) != 1)
-    if (errno != EINTR)
-      break;
+static void exp_free(struct matcher *m)
+{
+  int f;
 
-  if (n <= 0)
+  if (m == NULL)
     return;
+  for (f = 0; f < m->npat; f++) {
+    if (m->isre[f])
+      regfree(&m->re[f]);
+    free(m->text[f]);
+  }
+  free(m->next);
+  free(m->out);
+  free(m);
+}
 
-  /* Shift character into the buffer. */
-#ifdef _SYSV
-  memcpy(inbuf, inbuf + 1, 63);
-#else
-#  ifdef _BSD43
-  bcopy(inbuf + 1, inbuf, 63);
-#  else
-  /* This is Posix, I believe. */
-  memmove(inbuf, inbuf + 1, 63);
-#  endif
-#endif
-  if (curenv->verbose)
-    fputc(c, stderr);
-  inbuf[63] = c;
+/* Look at len bytes of input that came in before, without matching. */
+static void exp_warm(struct matcher *m, const char *s, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    m->state = m->next[m->state * m->ncls + m->cls[(unsigned char)s[i]]];
+    if (s[i] == '\n')
+      m->linelen = 0;
+    else if (s[i] != '\r' && m->linelen < LINE_SIZE - 1)
+      m->line[m->linelen++] = s[i];
+  }
 }
 
-/* See if a string just came in. */
-int expfound(const char *word)
+/*
+ * Compile the patterns of an expect. The first word of every line is
+ * a pattern, the rest the statement to execute; "regex" takes the
+ * next word as a regular expression.
+ */
+static struct matcher *exp_compile(struct line **seq)
 {
-  int len;
+  struct matcher *m;
+  struct line *here = thisline;
+  int *q, *fail, total = 1, f, i, c, s, u, v, head, qlen;
+  char *w, *t;
 
-  if (word == NULL) {
-    fprintf(stderr, _("NULL paramenter to %s!"), __func__);
-    exit(1);
+  if ((m = calloc(1, sizeof(struct matcher))) == NULL)
+    nomem();
+  for (f = 0; seq[f]; f++) {
+    thisline = seq[f];	/* For the line number of a syntax error */
+    t = seq[f]->line;
+    w = getword(&t);
+    if (w == NULL) {
+      fprintf(stderr, _("NULL paramenter to %s!"), __func__);
+      exit(1);
+    }
+    if (!strcmp(w, "regex")) {
+      if ((w = getword(&t)) == NULL)
+        syntaxerr(_("(argument expected)"));
+      if (regcomp(&m->re[f], w, REG_EXTENDED | REG_NOSUB) != 0)
+        syntaxerr(_("(bad regular expression)"));
+      m->isre[f] = 1;
+      m->nre++;
+    }
+    if ((m->text[f] = strdup(w)) == NULL)
+      nomem();
+    m->len[f] = m->isre[f] ? 0 : strlen(w);
+    m->action[f] = t;
+    m->npat = f + 1;
+    total += m->len[f];
+  }
+  thisline = here;
+
+  /* Bytes no pattern has all behave the same. */
+  m->ncls = 1;
+  for (f = 0; f < m->npat; f++)
+    for (i = 0; i < m->len[f]; i++)
+      if (m->cls[(unsigned char)m->text[f][i]] == 0)
+        m->cls[(unsigned char)m->text[f][i]] = m->ncls++;
+
+  m->next = malloc(total * m->ncls * sizeof(int));
+  m->out = malloc(total * sizeof(int));
+  fail = malloc(total * sizeof(int));
+  q = malloc(total * sizeof(int));
+  if (!m->next || !m->out || !fail || !q)
+    nomem();
+  for (i = 0; i < total * m->ncls; i++)
+    m->next[i] = -1;
+  for (i = 0; i < total; i++)
+    m->out[i] = -1;
+
+  /* The trie. */
+  m->nstates = 1;
+  for (f = 0; f < m->npat; f++) {
+    if (m->isre[f])
+      continue;
+    for (s = i = 0; i < m->len[f]; i++) {
+      c = m->cls[(unsigned char)m->text[f][i]];
+      if (m->next[s * m->ncls + c] < 0)
+        m->next[s * m->ncls + c] = m->nstates++;
+      s = m->next[s * m->ncls + c];
+    }
+    if (m->out[s] < 0)
+      m->out[s] = f;
   }
 
-  len = strlen(word);
-  if (len > 64)
-    len = 64;
+  /* Failure links, breadth first, turning the trie into a DFA. */
+  head = qlen = 0;
+  for (c = 0; c < m->ncls; c++) {
+    if ((v = m->next[c]) > 0) {
+      fail[v] = 0;
+      q[qlen++] = v;
+    } else
+      m->next[c] = 0;
+  }
+  while (head < qlen) {
+    u = q[head++];
+    if (m->out[fail[u]] >= 0 && (m->out[u] < 0 || m->out[fail[u]] < m->out[u]))
+      m->out[u] = m->out[fail[u]];
+    for (c = 0; c < m->ncls; c++) {
+      if ((v = m->next[u * m->ncls + c]) > 0) {
+        fail[v] = m->next[fail[u] * m->ncls + c];
+        q[qlen++] = v;
+      } else
+        m->next[u * m->ncls + c] = m->next[fail[u] * m->ncls + c];
+    }
+  }
+  free(fail);
+  free(q);
 
-  return !strcmp(inbuf + 64 - len, word);
+  exp_warm(m, tail, taillen);
+  return m;
+}
+
+/*
+ * Compile the patterns again after an action, which could have changed
+ * what they expand to, and go on with the input where m was.
+ */
+static struct matcher *exp_recompile(struct matcher *m, struct line **seq)
+{
+  struct matcher *n = exp_compile(seq);
+
+  memcpy(n->line, m->line, m->linelen);
+  n->linelen = m->linelen;
+  exp_free(m);
+  return n;
+}
+
+/* Remember the last input that was looked at. */
+static void exp_keep(const char *s, int len)
+{
+  if (len >= TAIL_SIZE) {
+    memcpy(tail, s + len - TAIL_SIZE, TAIL_SIZE);
+    taillen = TAIL_SIZE;
+    return;
+  }
+  if (taillen + len > TAIL_SIZE) {
+    memmove(tail, tail + taillen + len - TAIL_SIZE, TAIL_SIZE - len);
+    taillen = TAIL_SIZE - len;
+  }
+  memcpy(tail + taillen, s, len);
+  taillen += len;
+}
+
+/* The first regex that matches the line so far, or -1. */
+static int exp_regex(struct matcher *m)
+{
+  int f;
+
+  m->line[m->linelen] = 0;
+  for (f = 0; f < m->npat; f++)
+    if (m->isre[f] && regexec(&m->re[f], m->line, 0, NULL, 0) == 0)
+      return f;
+  return -1;
+}
+
+/*
+ * Run len bytes of input through the automaton. Stops after the byte
+ * where a pattern is found and sets *hit to it, else to -1. Returns
+ * the number of bytes looked at.
+ */
+static int exp_feed(struct matcher *m, const char *s, int len, int *hit)
+{
+  const int *next = m->next, *out = m->out;
+  const unsigned char *cls = m->cls;
+  int ncls = m->ncls, state = m->state, i, r;
+
+  *hit = -1;
+  if (m->nre == 0) {
+    for (i = 0; i < len; i++) {
+      state = next[state * ncls + cls[(unsigned char)s[i]]];
+      if (out[state] >= 0) {
+        *hit = out[state];
+        i++;
+        break;
+      }
+    }
+    m->state = state;
+    return i;
+  }
+
+  for (i = 0; i < len; i++) {
+    state = next[state * ncls + cls[(unsigned char)s[i]]];
+    *hit = out[state];
+    if (s[i] != '\n' && s[i] != '\r') {
+      if (m->linelen == LINE_SIZE - 1) {
+        memmove(m->line, m->line + LINE_SIZE / 2, LINE_SIZE / 2 - 1);
+        m->linelen = LINE_SIZE / 2 - 1;
+      }
+      m->line[m->linelen++] = s[i];
+    }
+    if (s[i] == '\n' || i == len - 1) {
+      if ((r = exp_regex(m)) >= 0) {
+        if (*hit < 0 || r < *hit)
+          *hit = r;
+        m->linelen = 0;
+      }
+      if (s[i] == '\n')
+        m->linelen = 0;
+    }
+    if (*hit >= 0) {
+      i++;
+      break;
+    }
+  }
+  m->state = state;
+  return i;
+}
+
+/*
+ * Forget the input so far, as when something is sent.
+ */
+static void exp_reset(void)
+{
+  inpos = inlen = 0;
+  taillen = 0;
+  if (matcher) {
+    matcher->state = 0;
+    matcher->linelen = 0;
+  }
+}
+
+/*
+ * Read what the modem has for us. At the end of the input, wait for
+ * the timeout.
+ */
+static void exp_fill(void)
+{
+  int n;
+
+  while ((n = read(0, inbuf, sizeof(inbuf))) < 0 && errno == EINTR)
+    ;
+  if (n <= 0) {
+    pause();
+    n = 0;
+  }
+  inpos = 0;
+  inlen = n;
 }
 
 /*
@@ -516,11 +770,11 @@ int getnum(char *text)
  */
 struct line **buildexpect(void)
 {
-  static struct line *seq[17];
+  static struct line *seq[MAX_EXPECT + 1];
   int f;
   char *w, *t;
 
-  for(f = 0; f < 16; f++) {
+  for(f = 0; f < MAX_EXPECT; f++) {
     if (thisline == NULL) {
       fprintf(stderr, _("script \"%s\": unexpected end of file%s\n"),
               curenv->scriptname, "\r");
@@ -537,7 +791,7 @@ struct line **buildexpect(void)
     seq[f] = thisline;
     thisline = thisline->next;
   }
-  if (f == 16)
+  if (f == MAX_EXPECT)
     syntaxerr(_("(too many arguments)"));
   return seq;
 }
@@ -553,7 +807,7 @@ int expect(char *text)
   struct line *dflseq[2];
   char *volatile toact = "exit 1";
   volatile int found = 0;
-  int f, val, c;
+  int f, n, val, c;
   char *action = NULL;
 
   if (inexpect) {
@@ -572,6 +826,7 @@ int expect(char *text)
     seq = buildexpect();
   } else {
     oneline.line = s;
+    oneline.lineno = thisline->lineno;
     oneline.next = NULL;
     dflseq[0] = &oneline;
     dflseq[1] = NULL;
@@ -600,32 +855,39 @@ int expect(char *text)
     }
   }
   if (sigsetjmp(ejmp, 1) != 0) {
+    exp_free(matcher);
+    matcher = NULL;
     f = s_exec(toact);
     inexpect = 0;
     return f;
   }
 
   /* Alright. Now do the expect. */
+  matcher = exp_compile(seq);
   c = OK;
   while (!found) {
-    action = NULL;
-    readchar();
-    for (f = 0; seq[f]; f++) {
-      s = seq[f]->line;
-      w = getword(&s);
-      if (expfound(w)) {
-        action = s;
-        found = 1;
-        break;
-      }
-    }
-    if (action != NULL && *action) {
+    if (inpos == inlen)
+      exp_fill();
+    n = exp_feed(matcher, inbuf + inpos, inlen - inpos, &f);
+    if (curenv->verbose)
+      fwrite(inbuf + inpos, 1, n, stderr);
+    exp_keep(inbuf + inpos, n);
+    inpos += n;
+    if (f < 0)
+      continue;
+    action = matcher->action[f];
+    found = 1;
+    if (*action) {
       found = 0;
       /* Maybe BREAK or RETURN */
       if ((c = s_exec(action)) != OK)
         found = 1;
+      else
+        matcher = exp_recompile(matcher, seq);
     }
   }
+  exp_free(matcher);
+  matcher = NULL;
   inexpect = 0;
   etimeout = 0;
   return c;
@@ -694,7 +956,7 @@ int dosend(char *text)
 
   /* Before we send anything, flush input buffer. */
   m_flush(0);
-  memset(inbuf, 0, sizeof(inbuf));
+  exp_reset();
 
   newline = "\r";
   return output(text, stdout);
@@ -1104,8 +1366,6 @@ int main(int argc, char **argv)
 
   do_args(argc, argv);
 
-  memset(inbuf, 0, sizeof(inbuf));
-
   if (argc > 2) {
     strncpy(logfname, argv[2], sizeof(logfname));
     logfname[sizeof(logfname) - 1] = '\0';
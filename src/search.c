@@ -0,0 +1,204 @@
+/*
+ * search.c	Searching the history buffer.
+ *
+ *		A pattern is prepared once by search_new(), and then
+ *		tried on the lines as history.c keeps them: UTF-8 text,
+ *		without turning them back into cells. A plain pattern is
+ *		looked for with memmem(), after folding the case of the
+ *		line if the case does not matter. A regular expression
+ *		is compiled with regcomp(), which works in the characters
+ *		of the locale: when that is not UTF-8, the line is
+ *		turned into them before regexec() looks at it.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+#include <regex.h>
+#include <wctype.h>
+
+#include "port.h"
+#include "minicom.h"
+
+struct search {
+  int regex;			/* A regular expression, in re */
+  int utf8;			/* The locale is UTF-8 */
+  int fold;			/* Case does not matter */
+  regex_t re;
+  char pat[MAX_SEARCH * 6 + 1];	/* Plain pattern, folded if fold */
+  int patlen;
+  char line[MAXCOLS * 6 + 1];	/* A folded line */
+  char mb[MAXCOLS * 4 * MB_LEN_MAX + 1]; /* A line for regexec() */
+};
+
+/* Code point c in UTF-8. */
+static char *put_utf8(char *p, unsigned c)
+{
+  if (c < 0x80)
+    *p++ = c;
+  else if (c < 0x800) {
+    *p++ = 0xc0 | c >> 6;
+    *p++ = 0x80 | (c & 0x3f);
+  } else if (c < 0x10000) {
+    *p++ = 0xe0 | c >> 12;
+    *p++ = 0x80 | (c >> 6 & 0x3f);
+    *p++ = 0x80 | (c & 0x3f);
+  } else {
+    *p++ = 0xf0 | c >> 18;
+    *p++ = 0x80 | (c >> 12 & 0x3f);
+    *p++ = 0x80 | (c >> 6 & 0x3f);
+    *p++ = 0x80 | (c & 0x3f);
+  }
+  return p;
+}
+
+/*
+ * Lower case UTF-8 text of len bytes into out. Lines are mostly
+ * ASCII, which needs no decoding. A lower case character can take
+ * up to half as many bytes more.
+ */
+static int fold(char *out, const char *s, int len)
+{
+  const unsigned char *p = (const unsigned char *)s;
+  const unsigned char *e = p + len;
+  unsigned state = UTF8_ACCEPT, prev, cp;
+  char *o = out;
+  wint_t lc;
+
+  while (p < e) {
+    if (*p < 0x80 && state == UTF8_ACCEPT) {
+      *o++ = *p >= 'A' && *p <= 'Z' ? *p + 'a' - 'A' : *p;
+      p++;
+      continue;
+    }
+    prev = state;
+    state = utf8_next(state, *p++, &cp);
+    if (state == UTF8_ACCEPT) {
+      lc = towlower(cp);
+      o = put_utf8(o, lc < 0x110000 ? lc : cp);
+    } else if (state == UTF8_REJECT) {
+      *o++ = '?';
+      state = UTF8_ACCEPT;
+      /* Try the byte again on its own. */
+      if (prev != UTF8_ACCEPT)
+        p--;
+    }
+  }
+  *o = 0;
+  return o - out;
+}
+
+/*
+ * UTF-8 text of len bytes into out, in the characters of the locale.
+ * What the locale does not have becomes '?'.
+ */
+static void to_locale(char *out, const char *s, int len)
+{
+  const unsigned char *p = (const unsigned char *)s;
+  const unsigned char *e = p + len;
+  unsigned state = UTF8_ACCEPT, prev, cp;
+  char *o = out;
+  int n;
+
+  wctomb(NULL, 0);		/* Back to the initial shift state */
+  while (p < e) {
+    if (*p < 0x80 && state == UTF8_ACCEPT) {
+      *o++ = *p++;
+      continue;
+    }
+    prev = state;
+    state = utf8_next(state, *p++, &cp);
+    if (state == UTF8_ACCEPT) {
+      if (cp >= 0x110000 || (n = wctomb(o, cp)) <= 0)
+        *o++ = '?';
+      else
+        o += n;
+    } else if (state == UTF8_REJECT) {
+      *o++ = '?';
+      state = UTF8_ACCEPT;
+      if (prev != UTF8_ACCEPT)
+        p--;
+    }
+  }
+  *o = 0;
+}
+
+/*
+ * Prepare to look for pattern. NULL if it is not a good regular
+ * expression, or there is no memory.
+ */
+struct search *search_new(const wchar_t *pattern, int case_matters, int regex)
+{
+  struct search *s;
+  char mb[MAX_SEARCH * MB_LEN_MAX + 1];
+  char utf[MAX_SEARCH * 4 + 1];
+  char *p;
+  int i;
+
+  if ((s = calloc(1, sizeof(struct search))) == NULL)
+    return NULL;
+  s->utf8 = utf8_locale();
+  s->regex = regex;
+  s->fold = !case_matters;
+  if (regex) {
+    /* regcomp() wants the characters of the locale, so does
+     * REG_ICASE; search_line() hands it lines in them too. */
+    if (wcstombs(mb, pattern, sizeof(mb)) == (size_t)-1 ||
+        regcomp(&s->re, mb, REG_EXTENDED | REG_NOSUB |
+                (s->fold ? REG_ICASE : 0)) != 0) {
+      free(s);
+      return NULL;
+    }
+    return s;
+  }
+  p = utf;
+  for (i = 0; pattern[i] && i < MAX_SEARCH; i++)
+    p = put_utf8(p, (unsigned)pattern[i] < 0x110000 ? pattern[i] : '?');
+  *p = 0;
+  if (s->fold)
+    s->patlen = fold(s->pat, utf, p - utf);
+  else {
+    s->patlen = p - utf;
+    memcpy(s->pat, utf, s->patlen + 1);
+  }
+  return s;
+}
+
+void search_free(struct search *s)
+{
+  if (s == NULL)
+    return;
+  if (s->regex)
+    regfree(&s->re);
+  free(s);
+}
+
+/*
+ * Is the pattern in the text of a line, as from hist_text()?
+ */
+int search_line(struct search *s, const char *text, int len)
+{
+  if (s->regex) {
+    if (!s->utf8) {
+      to_locale(s->mb, text, len < MAXCOLS * 4 ? len : MAXCOLS * 4);
+      text = s->mb;
+    }
+    return regexec(&s->re, text, 0, NULL, 0) == 0;
+  }
+  if (s->fold) {
+    len = fold(s->line, text, len < MAXCOLS * 4 ? len : MAXCOLS * 4);
+    text = s->line;
+  }
+  return len >= s->patlen && memmem(text, len, s->pat, s->patlen) != NULL;
+}
@@ -0,0 +1,183 @@
+/*
+ * stats.c	Counters for the data going through minicom.
+ *
+ *		The receive buffer, the transmit queue, the terminal
+ *		emulation, the window layer and the capture file count
+ *		what they do in mc_stats. From that we compute rates
+ *		once a second, which can be shown in the status line
+ *		(%R, %E, %O), in a window (Ctrl-A V), or written to a
+ *		file when minicom gets SIGUSR1. Together they tell if
+ *		the port, the emulation or the terminal is the slow part.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+
+#include "port.h"
+#include "minicom.h"
+#include "intl.h"
+
+struct mc_stats mc_stats;
+const char *stats_file;			/* -O statsfile=FILE */
+volatile int stats_dump_pending;
+
+/* Totals at the last stats_tick(), for the rates. */
+static unsigned long long last_ns;
+static unsigned long long last_rx, last_tx, last_vt, last_scr;
+
+unsigned long long stats_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Update the rates. Called once a second; calls that come sooner
+ * than half a second after the last one are ignored.
+ */
+void stats_tick(void)
+{
+  unsigned long long now = stats_ns();
+  double secs;
+
+  if (last_ns && now - last_ns < 500000000ULL)
+    return;
+  if (last_ns) {
+    secs = (now - last_ns) / 1e9;
+    mc_stats.rx_rate = (rx_stats.bytes - last_rx) / secs;
+    mc_stats.tx_rate = (mc_stats.tx_bytes - last_tx) / secs;
+    mc_stats.vt_rate = (mc_stats.vt_bytes - last_vt) / secs;
+    mc_stats.scr_rate = (mc_stats.scr_bytes - last_scr) / secs;
+  }
+  last_ns = now;
+  last_rx = rx_stats.bytes;
+  last_tx = mc_stats.tx_bytes;
+  last_vt = mc_stats.vt_bytes;
+  last_scr = mc_stats.scr_bytes;
+}
+
+/*
+ * Print a rate in bytes per second, made short for the status line.
+ */
+void stats_rate(char *buf, size_t len, double rate)
+{
+  if (rate >= 10e6)
+    snprintf(buf, len, "%.0fMB/s", rate / 1e6);
+  else if (rate >= 1e6)
+    snprintf(buf, len, "%.1fMB/s", rate / 1e6);
+  else if (rate >= 10e3)
+    snprintf(buf, len, "%.0fkB/s", rate / 1e3);
+  else if (rate >= 1e3)
+    snprintf(buf, len, "%.1fkB/s", rate / 1e3);
+  else
+    snprintf(buf, len, "%.0fB/s", rate);
+}
+
+/*
+ * The statistics as text, one item per line, at most 50 columns.
+ */
+static void stats_text(char *buf, size_t len)
+{
+  char r[4][16];
+  size_t n = 0;
+
+  stats_rate(r[0], sizeof(r[0]), mc_stats.rx_rate);
+  stats_rate(r[1], sizeof(r[1]), mc_stats.tx_rate);
+  stats_rate(r[2], sizeof(r[2]), mc_stats.vt_rate);
+  stats_rate(r[3], sizeof(r[3]), mc_stats.scr_rate);
+
+#define ADD(...) \
+  do { \
+    if (n < len) \
+      n += snprintf(buf + n, len - n, __VA_ARGS__); \
+  } while (0)
+
+  ADD(_("Received  %14llu bytes %10s\n"),
+      (unsigned long long)rx_stats.bytes, r[0]);
+  ADD(_("          %14lu reads %7lu B/read\n"),
+      rx_stats.reads, rx_stats.reads ? rx_stats.bytes / rx_stats.reads : 0);
+  ADD(_("          %14lu dropped\n"), rx_stats.dropped);
+  ADD(_("Sent      %14llu bytes %10s\n"), mc_stats.tx_bytes, r[1]);
+  ADD(_("          %14llu writes\n"), mc_stats.tx_writes);
+  ADD(_("Emulation %14llu bytes %10s\n"), mc_stats.vt_bytes, r[2]);
+  ADD(_("Screen    %14llu bytes %10s\n"), mc_stats.scr_bytes, r[3]);
+  ADD(_("          %14llu writes %8llu frames\n"),
+      mc_stats.scr_writes, mc_stats.frames);
+  ADD(_("Capture   %14llu bytes %8llu writes\n"),
+      mc_stats.cap_bytes, mc_stats.cap_writes);
+  ADD(_("Time      %10.3f s parse %8.3f s draw\n"),
+      mc_stats.parse_ns / 1e9, mc_stats.render_ns / 1e9);
+  ADD(_("Event loop %s\n"), ev_backend());
+#undef ADD
+}
+
+/*
+ * Show the statistics in a window until a key is pressed. The port
+ * is not read while we are here, so the rates are those of the last
+ * second in terminal mode.
+ */
+void stats_show(void)
+{
+  WIN *w;
+  char buf[1024];
+  int x1, x2;
+
+  x1 = (COLS / 2) - 26;
+  x2 = (COLS / 2) + 26;
+  w = mc_wopen(x1, 4, x2, 17, BDOUBLE, stdattr, mfcolor, mbcolor, 0, 0, 1);
+  mc_wtitle(w, TMID, _("Statistics"));
+  mc_wcursor(w, CNONE);
+
+  stats_text(buf, sizeof(buf));
+  mc_wlocate(w, 0, 0);
+  mc_wputs(w, buf);
+  mc_wlocate(w, 0, 12);
+  mc_wputs(w, _("Press any key to continue"));
+  mc_wredraw(w, 1);
+
+  wxgetch();
+  mc_wclose(w, 1);
+}
+
+/*
+ * Append the statistics to stats_file. Done from the main loop after
+ * a SIGUSR1, not from the signal handler.
+ */
+void stats_dump(void)
+{
+  char buf[1024];
+  const char *name;
+  FILE *fp;
+  time_t now;
+
+  stats_dump_pending = 0;
+  name = stats_file ? stats_file : pfix_home("minicom.stats");
+  if ((fp = fopen(name, "a")) == NULL)
+    return;
+  stats_tick();
+  stats_text(buf, sizeof(buf));
+  time(&now);
+  fprintf(fp, "minicom %d statistics %s%s\n", (int)getpid(), ctime(&now), buf);
+  fclose(fp);
+}
+
+void stats_signal(int sig)
+{
+  (void)sig;
+  stats_dump_pending = 1;
+  signal(SIGUSR1, stats_signal);
+}
@@ -0,0 +1,131 @@
+/*
+ * txqueue.c	Transmit queue for data going to the serial port.
+ *
+ *		Keys, macros, citations and script output used to be
+ *		written to the port a character at a time. Now they are
+ *		collected here and sent with as few write() calls as
+ *		possible once the main loop has finished handling the
+ *		current event, or when the caller has to wait for the
+ *		data to be out (character and line delays, '~' pauses).
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <poll.h>
+
+#include "port.h"
+#include "minicom.h"
+
+#define TX_MIN_SIZE	256
+
+static char *tx_data;
+static size_t tx_len;
+static size_t tx_size;
+
+/*
+ * Queue len bytes for the port. With mark set the eighth bit of
+ * every byte is set (mark parity done in software).
+ */
+void tx_put(const char *s, size_t len, int mark)
+{
+  size_t i, newsize;
+  char *p;
+
+  if (tx_len + len > tx_size) {
+    for (newsize = tx_size ? tx_size : TX_MIN_SIZE; newsize < tx_len + len;
+         newsize *= 2)
+      ;
+    if ((p = realloc(tx_data, newsize)) == NULL) {
+      /* Out of memory: send what we have, then try to make it fit. */
+      tx_flush();
+      if (tx_len + len > tx_size)
+        return;
+    } else {
+      tx_data = p;
+      tx_size = newsize;
+    }
+  }
+  if (mark)
+    for (i = 0; i < len; i++)
+      tx_data[tx_len + i] = s[i] | 0x80;
+  else
+    memcpy(tx_data + tx_len, s, len);
+  tx_len += len;
+}
+
+/*
+ * Write len bytes to the port, waiting for it to take them.
+ * Returns the number of bytes written.
+ */
+static size_t tx_write(const char *s, size_t len)
+{
+  struct pollfd pfd;
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len) {
+    n = write(portfd, s + done, len - done);
+    if (n > 0) {
+      rec_put(REC_TX, s + done, n);
+      mc_stats.tx_bytes += n;
+      mc_stats.tx_writes++;
+      done += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN) {
+      /* Output buffer full; give the line a second to drain. */
+      pfd.fd = portfd;
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, 1000) > 0)
+        continue;
+    }
+    break;
+  }
+  return done;
+}
+
+/*
+ * Send everything that is queued. With a character delay set
+ * (vt_ch_delay) the bytes go out one at a time with the delay in
+ * between, as before.
+ */
+void tx_flush(void)
+{
+  size_t i;
+
+  if (tx_len == 0)
+    return;
+  if (portfd < 0) {
+    tx_len = 0;
+    return;
+  }
+  if (vt_ch_delay) {
+    for (i = 0; i < tx_len; i++) {
+      if (tx_write(tx_data + i, 1) != 1)
+        break;
+      usleep(vt_ch_delay * 1000);
+    }
+  } else
+    tx_write(tx_data, tx_len);
+  tx_len = 0;
+
+  /* Don't hold on to the memory of a big paste. */
+  if (tx_size > 64 * 1024) {
+    free(tx_data);
+    tx_data = NULL;
+    tx_size = 0;
+  }
+}
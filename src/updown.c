@@ -23,7 +23,6 @@
  * js&jl 04.98	the better filename selection window
  */
 
-#include <poll.h>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -307,6 +306,8 @@ void updown(int what, int nr)
   } else
     mc_wleave();
 
+  /* The protocol gets the port, see ingest_start(). */
+  ingest_stop();
   m_flush(portfd);
 
   switch (udpid = fork()) {
@@ -451,30 +452,47 @@ void lockfile_remove(void)
 {
   if (portfd_is_socket)
     return;
+  lockfile_unlock(lockfile, dial_tty);
+}
+
+int lockfile_create(int no_msgs)
+{
+  if (portfd_is_socket)
+    return 0;
+  return lockfile_lock(lockfile, dial_tty, no_msgs);
+}
 
+/*
+ * Remove lock file name of device dev.
+ */
+void lockfile_unlock(const char *name, const char *dev)
+{
 #if !HAVE_LOCKDEV
-  if (lockfile[0])
-    unlink(lockfile);
+  (void)dev;
+  if (name[0])
+    unlink(name);
 #else
-  ttyunlock(dial_tty);
+  (void)name;
+  ttyunlock(dev);
 #endif
 }
 
-int lockfile_create(int no_msgs)
+/*
+ * Create lock file name for device dev.
+ */
+int lockfile_lock(const char *name, const char *dev, int no_msgs)
 {
   int n;
 
-  if (portfd_is_socket)
-    return 0;
-
 #if !HAVE_LOCKDEV
-  if (!lockfile[0])
+  (void)dev;
+  if (!name[0])
     return 0;
 
   int fd;
   n = umask(022);
   /* Create lockfile compatible with UUCP-1.2 */
-  if ((fd = open(lockfile, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0) {
+  if ((fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0) {
     if (!no_msgs)
       werror(_("Cannot create lockfile!"));
   } else {
@@ -484,19 +502,20 @@ int lockfile_create(int no_msgs)
     buf[sizeof(buf) - 1] = 0;
     if (write(fd, buf, strlen(buf)) < (ssize_t)strlen(buf))
       if (!no_msgs)
-        fprintf(stderr, _("Failed to write lockfile %s\n"), lockfile);
+        fprintf(stderr, _("Failed to write lockfile %s\n"), name);
     close(fd);
   }
   umask(n);
   return 0;
 #else
-  n = ttylock(dial_tty);
+  (void)name;
+  n = ttylock(dev);
   if (!no_msgs)
     {
       if (n < 0)
-        fprintf(stderr, _("Cannot create lockfile for %s: %s\n"), dial_tty, strerror(-n));
+        fprintf(stderr, _("Cannot create lockfile for %s: %s\n"), dev, strerror(-n));
       else if (n > 0)
-        fprintf(stderr, _("Device %s is locked.\n"), dial_tty);
+        fprintf(stderr, _("Device %s is locked.\n"), dev);
     }
   return n;
 #endif
@@ -623,6 +642,38 @@ int mc_setenv(const char *name, const char *value)
 
 /* ============ This is the end of the setenv function ============= */
 
+/*
+ * Data from the script (to the screen) or the keyboard (to the port).
+ */
+static void script_io(int fd, int events, void *data)
+{
+  char buf[81];
+  char *ptr = buf;
+  int n;
+
+  (void)data;
+  n = read(fd, buf, sizeof(buf) - 1);
+  if (n <= 0) {
+    /* EOF on the pipe: the script has ended. */
+    if (n == 0 || (events & EV_ERROR) || errno != EINTR)
+      script_running = 0;
+    return;
+  }
+  if (headless) {
+    /* No screen: pass the script's messages on. */
+    n = write(STDERR_FILENO, buf, n);
+    return;
+  }
+  while (n--)
+    if (fd == STDIN_FILENO)
+      vt_send(*ptr++);
+    else
+      vt_out(*ptr++, 0);
+  tx_flush();
+  timer_update();
+  mc_wflush();
+}
+
 /*
  * Run an external script.
  * ask = 1 if first ask for confirmation.
@@ -631,14 +682,11 @@ int mc_setenv(const char *name, const char *value)
 void runscript(int ask, const char *s, const char *l, const char *p)
 {
   int status;
-  int n, i;
+  int n;
   int pipefd[2];
-  char buf[81];
   char scr_lines[7];
   char cmdline[160];
-  struct pollfd fds[2];
   char *translated_cmdline;
-  char *ptr;
   WIN *w;
   int done = 0;
   char *msg = _("Same as last");
@@ -754,39 +802,31 @@ void runscript(int ask, const char *s, const char *l, const char *p)
     default: /* Parent */
       break;
   }
-  setcbreak(1); /* Cbreak, no echo */
-  enab_sig(1, 0);	       /* But enable SIGINT */
+  if (!headless) {
+    setcbreak(1); /* Cbreak, no echo */
+    enab_sig(1, 0);	       /* But enable SIGINT */
+  }
   signal(SIGINT, udcatch);
   close(pipefd[1]);
 
   /* pipe output from "runscript" program to terminal emulator */
-  fds[0].fd     = pipefd[0]; /* runscript */
-  fds[0].events = POLLIN;
-  fds[1].fd     = STDIN_FILENO; /* stdin */
-  fds[1].events = POLLIN;
+  ev_io_del(portfd);	/* the script reads the port itself */
+  ev_io_add(pipefd[0], script_io, NULL);
+  if (!headless)
+    ev_io_add(STDIN_FILENO, script_io, NULL);
   script_running = 1;
-  while (script_running && poll(fds, 2, -1) > 0)
-    for (i = 0; i < 2; i++) {
-      if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
-        script_running = 0;
-      else if ((fds[i].revents & POLLIN)
-               && (n = read(fds[i].fd, buf, sizeof(buf)-1)) > 0) {
-        ptr = buf;
-        while (n--)
-          if (i)
-            vt_send(*ptr++);
-          else
-            vt_out(*ptr++, 0);
-        timer_update();
-        mc_wflush();
-      }
-    }
+  while (script_running && (ev_run(-1) >= 0 || errno == EINTR))
+    ;
+  ev_io_del(pipefd[0]);
+  ev_io_del(STDIN_FILENO);
 
   /* Collect status, and clean up. */
   m_wait(&status);
-  enab_sig(0, 0);
   signal(SIGINT, SIG_IGN);
-  setcbreak(2); /* Raw, no echo */
+  if (!headless) {
+    enab_sig(0, 0);
+    setcbreak(2); /* Raw, no echo */
+  }
   close(pipefd[0]);
   scriptname("");
   mcd("");
@@ -851,6 +891,7 @@ int paste_file(void)
 	vt_send(*s);
       bdone += strlen(s);
     }
+    tx_flush();
     if (ldelay) {
 #ifdef HAVE_USLEEP
       usleep(ldelay * 1000);
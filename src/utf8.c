@@ -0,0 +1,177 @@
+/*
+ * utf8.c	UTF-8 decoding for the data from the port.
+ *
+ *		The port is read in whatever pieces the driver hands us,
+ *		so a character can start in one read and end in the next.
+ *		utf8_next() is a small state machine that takes one byte
+ *		at a time and keeps what it has seen of a character in its
+ *		state, and so does not care where the reads end. It also
+ *		saves a call to mbtowc() for every byte.
+ *
+ *		utf8_wide() says if a character takes two columns on the
+ *		screen, remembering the answers of wcwidth().
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <wchar.h>
+
+#include "port.h"
+#include "minicom.h"
+
+/* Classes of bytes. */
+enum {
+  C_ASCII,			/* 00..7f */
+  C_CONT1,			/* 80..8f */
+  C_CONT2,			/* 90..9f */
+  C_CONT3,			/* a0..bf */
+  C_LEAD2,			/* c2..df */
+  C_E0,				/* e0: the next byte is a0..bf */
+  C_LEAD3,			/* e1..ec, ee, ef */
+  C_ED,				/* ed: the next byte is 80..9f */
+  C_F0,				/* f0: the next byte is 90..bf */
+  C_LEAD4,			/* f1..f3 */
+  C_F4,				/* f4: the next byte is 80..8f */
+  C_BAD,			/* c0, c1, f5..ff */
+  C_NCLASSES
+};
+
+/*
+ * States, after UTF8_ACCEPT and UTF8_REJECT: how many more bytes are
+ * needed, and which the next one may be.
+ */
+enum {
+  S_1 = 2,			/* Any continuation byte */
+  S_2,
+  S_2_E0,
+  S_2_ED,
+  S_3,
+  S_3_F0,
+  S_3_F4,
+  S_NSTATES
+};
+
+static unsigned char utf8_class[256];
+
+#define R UTF8_REJECT
+static const unsigned char utf8_trans[S_NSTATES][C_NCLASSES] = {
+  /* ASCII CONT1 CONT2 CONT3 LEAD2 E0     LEAD3 ED     F0     LEAD4 F4     BAD */
+  { 0,     R,    R,    R,    S_1,  S_2_E0, S_2, S_2_ED, S_3_F0, S_3, S_3_F4, R },
+  { R,     R,    R,    R,    R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     0,    0,    0,    R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     S_1,  S_1,  S_1,  R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     R,    R,    S_1,  R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     S_1,  S_1,  R,    R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     S_2,  S_2,  S_2,  R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     R,    S_2,  S_2,  R,    R,      R,   R,      R,      R,   R,      R },
+  { R,     S_2,  R,    R,    R,    R,      R,   R,      R,      R,   R,      R },
+};
+#undef R
+
+/* The bits of a first byte that are part of the character. */
+static const unsigned char utf8_mask[C_NCLASSES] = {
+  0x7f, 0, 0, 0, 0x1f, 0x0f, 0x0f, 0x0f, 0x07, 0x07, 0x07, 0
+};
+
+static void utf8_classes(void)
+{
+  int c;
+
+  for (c = 0; c < 256; c++) {
+    if (c < 0x80)
+      utf8_class[c] = C_ASCII;
+    else if (c < 0x90)
+      utf8_class[c] = C_CONT1;
+    else if (c < 0xa0)
+      utf8_class[c] = C_CONT2;
+    else if (c < 0xc0)
+      utf8_class[c] = C_CONT3;
+    else if (c < 0xc2)
+      utf8_class[c] = C_BAD;
+    else if (c < 0xe0)
+      utf8_class[c] = C_LEAD2;
+    else if (c == 0xe0)
+      utf8_class[c] = C_E0;
+    else if (c == 0xed)
+      utf8_class[c] = C_ED;
+    else if (c < 0xf0)
+      utf8_class[c] = C_LEAD3;
+    else if (c == 0xf0)
+      utf8_class[c] = C_F0;
+    else if (c < 0xf4)
+      utf8_class[c] = C_LEAD4;
+    else if (c == 0xf4)
+      utf8_class[c] = C_F4;
+    else
+      utf8_class[c] = C_BAD;
+  }
+}
+
+/*
+ * Does the locale use UTF-8? Only then is utf8_next() of any use;
+ * other character sets go through mbtowc().
+ */
+int utf8_locale(void)
+{
+  static int done, yes;
+  wchar_t wc;
+
+  if (!done) {
+    done = 1;
+    mbtowc(NULL, NULL, 0);
+    yes = mbtowc(&wc, "\342\202\254", 3) == 3 && wc == 0x20ac;
+    mbtowc(NULL, NULL, 0);
+    utf8_classes();
+  }
+  return yes;
+}
+
+/*
+ * Take byte c in state (UTF8_ACCEPT to begin with). Returns the new
+ * state: UTF8_ACCEPT when *cp is a whole character, UTF8_REJECT when
+ * c does not fit what came before, anything else when more bytes are
+ * needed. utf8_locale() must have been called.
+ */
+unsigned utf8_next(unsigned state, unsigned char c, unsigned *cp)
+{
+  int class = utf8_class[c];
+
+  if (state == UTF8_ACCEPT)
+    *cp = c & utf8_mask[class];
+  else
+    *cp = *cp << 6 | (c & 0x3f);
+  return utf8_trans[state][class];
+}
+
+/*
+ * Is wc two columns wide? wcwidth() is asked once for every
+ * character below U+40000 and the answer kept, two bits each.
+ */
+int utf8_wide(wchar_t wc)
+{
+  static unsigned char known[0x40000 / 4];
+  unsigned i = (unsigned)wc;
+  int k;
+
+  if (i < 0x1100)
+    return 0;			/* Nothing is wide below Hangul Jamo */
+  if (i >= 0x40000)
+    return i < 0x110000 && wcwidth(wc) == 2;
+  k = known[i / 4] >> (i % 4 * 2) & 3;
+  if (k == 0) {
+    k = wcwidth(wc) == 2 ? 2 : 1;
+    known[i / 4] |= k << (i % 4 * 2);
+  }
+  return k == 2;
+}
@@ -29,24 +29,14 @@
 
 #include <time.h>
 #include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "port.h"
 #include "minicom.h"
 #include "vt100.h"
 #include "config.h"
 
-/*
- * The global variable esc_s holds the escape sequence status:
- * 0 - normal
- * 1 - ESC
- * 2 - ESC [
- * 3 - ESC [ ?
- * 4 - ESC (
- * 5 - ESC )
- * 6 - ESC #
- * 7 - ESC P
- */
-static int esc_s = 0;
-
 #define ESC 27
 
 /* Structure to hold escape sequences. */
@@ -96,149 +86,383 @@ unsigned char vt_outmap[256] = {
 #include "defmap.h"
 };
 
+/* Does vt_inmap[] leave ' ' to '~' as they are? See vt_inmap_changed(). */
+static int inmap_plain = 1;
+
 #if TRANSLATE
-/* Taken from the Linux kernel source: linux/drivers/char/console.c */
-static char * vt_map[] = {
-/* 8-bit Latin-1 mapped to the PC character set: '.' means non-printable */
-  "................"
-  "................"
-  " !\"#$%&'()*+,-./0123456789:;<=>?"
-  "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_"
-  "`abcdefghijklmnopqrstuvwxyz{|}~."
-  "................"
-  "................"
-  "\377\255\233\234\376\235\174\025\376\376\246\256\252\055\376\376"
-  "\370\361\375\376\376\346\024\371\376\376\247\257\254\253\376\250"
-  "\376\376\376\376\216\217\222\200\376\220\376\376\376\376\376\376"
-  "\376\245\376\376\376\376\231\376\350\376\376\376\232\376\376\341"
-  "\205\240\203\376\204\206\221\207\212\202\210\211\215\241\214\213"
-  "\376\244\225\242\223\376\224\366\355\227\243\226\201\376\376\230",
-/* vt100 graphics */
-  "................"
-  "\0\0\0\0\0\0\0\0\0\0\376\0\0\0\0\0"
-  " !\"#$%&'()*+,-./0123456789:;<=>?"
-  "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^ "
-  "\004\261\007\007\007\007\370\361\007\007\331\277\332\300\305\304"
-  "\304\304\137\137\303\264\301\302\263\363\362\343\330\234\007\0"
-  "................"
-  "................"
-  "\377\255\233\234\376\235\174\025\376\376\246\256\252\055\376\376"
-  "\370\361\375\376\376\346\024\371\376\376\247\257\254\253\376\250"
-  "\376\376\376\376\216\217\222\200\376\220\376\376\376\376\376\376"
-  "\376\245\376\376\376\376\231\376\376\376\376\376\232\376\376\341"
-  "\205\240\203\376\204\206\221\207\212\202\210\211\215\241\214\213"
-  "\376\244\225\242\223\376\224\366\376\227\243\226\201\376\376\230"
+/*
+ * The DEC special graphics set (ESC ( 0), '_' to '~', in Unicode: the
+ * line drawing shows with the box characters of the terminal's font.
+ */
+static const wchar_t vt_graphics[32] = {
+  0x0020, 0x25c6, 0x2592, 0x2409, 0x240c, 0x240d, 0x240a, 0x00b0,
+  0x00b1, 0x2424, 0x240b, 0x2518, 0x2510, 0x250c, 0x2514, 0x253c,
+  0x23ba, 0x23bb, 0x2500, 0x23bc, 0x23bd, 0x251c, 0x2524, 0x2534,
+  0x252c, 0x2502, 0x2264, 0x2265, 0x03c0, 0x2260, 0x00a3, 0x00b7
 };
-static char *vt_trans[2];
-static int vt_charset;          /* Character set. */
 #endif
 
-static int vt_echo;		/* Local echo on/off. */
 int vt_nl_delay;		/* Delay after CR key */
 int vt_ch_delay;		/* Delay between characters */
-static int vt_type = ANSI;	/* Terminal type. */
-static int vt_wrap;             /* Line wrap on/off */
-static int vt_addlf;            /* Add linefeed on/off */
-static int vt_addcr;            /* Add carriagereturn on/off */
-static int vt_fg;		/* Standard foreground color. */
-static int vt_bg;		/* Standard background color. */
-static int vt_keypad;		/* Keypad mode. */
-static int vt_cursor;		/* cursor key mode. */
-static int vt_asis;		/* 8bit clean mode. */
-static int vt_line_timestamp;	/* Timestamp each line. */
-static int vt_bs = 8;		/* Code that backspace key sends. */
-static int vt_insert;           /* Insert mode */
-static int vt_crlf;		/* Return sends CR/LF */
-static int vt_om;		/* Origin mode. */
-WIN *vt_win;                    /* Output window. */
-static int vt_docap;		/* Capture on/off. */
-static void (*vt_keyb)(int, int);/* Gets called for NORMAL/APPL switch. */
-static void (*termout)(const char *, int);/* Gets called to output a string. */
-
-static int escparms[8];		/* Accumulated escape sequence. */
-static int ptr;                 /* Index into escparms array. */
-static unsigned vt_tabs[5];	/* Tab stops for max. 32*5 = 160 columns. */
-
-static short newy1 = 0;		/* Current size of scrolling region. */
-static short newy2 = 23;
-
-/* Saved color and positions */
-static short savex, savey, saveattr = XA_NORMAL, savecol = 112;
 
+/*
+ * Everything one emulator needs to know. The main session has one,
+ * set up with vt_install() and vt_init(); vt_create() makes more.
+ */
+struct vt {
+  WIN *win;                     /* Output window. */
+  WIN *main;                    /* Window we were given. */
+  WIN *alt;                     /* Alternate screen, if it is on. */
+  void (*out)(const char *, int, void *); /* Output to the remote side. */
+  void *data;                   /* For out(). */
+  void (*keyb)(int, int);       /* Gets called for NORMAL/APPL switch. */
+
+  int type;                     /* Terminal type. */
+  int echo;                     /* Local echo on/off. */
+  int wrap;                     /* Line wrap on/off */
+  int addlf;                    /* Add linefeed on/off */
+  int addcr;                    /* Add carriagereturn on/off */
+  int fg;                       /* Standard foreground color. */
+  int bg;                       /* Standard background color. */
+  int keypad;                   /* Keypad mode. */
+  int cursor;                   /* cursor key mode. */
+  int asis;                     /* 8bit clean mode. */
+  int line_timestamp;           /* Timestamp each line. */
+  const struct timeval *rx_tv;  /* When the data was received. */
+  int bs;                       /* Code that backspace key sends. */
+  int insert;                   /* Insert mode */
+  int crlf;                     /* Return sends CR/LF */
+  int om;                       /* Origin mode. */
+  int docap;                    /* Capture on/off. */
+
+  /* The escape sequence parser. */
+  int state;
+  char inter[2];                /* Private marker and intermediates. */
+  int ninter;
+  int escparms[8];              /* Accumulated escape sequence. */
+  int ptr;                      /* Index into escparms array. */
+  unsigned tabs[5];             /* Tab stops for max. 32*5 = 160 columns. */
+
+  short newy1;                  /* Current size of scrolling region. */
+  short newy2;
+
+  /* Saved color and positions */
+  short savex, savey, saveattr, savecol;
+
+#if TRANSLATE
+  const wchar_t *trans[2];      /* G0 and G1: vt_graphics or NULL */
+  int charset;                  /* Character set. */
+  short savecharset;
+  const wchar_t *savetrans[2];
+#endif
+
+  /* ESC P string being collected. */
+  char dcs[17];
+  int dcs_pos;
+
+  /* For the line timestamps. */
+  unsigned char last_ch;
+  struct timeval ts_last;
+
+  /* UTF-8 character being received. */
+  int utf8;                     /* Decode here, not with mbtowc() */
+  unsigned u8state;
+  unsigned u8cp;
+  unsigned char u8seq[3];       /* Its bytes so far */
+  int u8len;
+};
+
+#define VT_INITIAL { .type = ANSI, .bs = 8, .newy2 = 23, \
+                     .saveattr = XA_NORMAL, .savecol = 112 }
+
+/* The main session. */
+static void (*termout)(const char *, int);
+static struct vt main_vt = VT_INITIAL;
+struct vt *vt_main = &main_vt;
+
+static void vt_putc(struct vt *vt, int ch, wchar_t wc);
+
+/*
+ * The escape sequence parser follows the state machine of the DEC
+ * VT500 series as described by Paul Williams ("A parser for DEC's
+ * ANSI-compatible video terminals"). For every state there is a table
+ * saying, for each byte, what to do with it and which state comes
+ * next.
+ */
+enum {
+  VT_GROUND,
+  VT_ESC,			/* ESC */
+  VT_ESC_INT,			/* ESC and intermediates */
+  VT_CSI_ENTRY,			/* ESC [ */
+  VT_CSI_PARAM,			/* ESC [ and parameters */
+  VT_CSI_INT,			/* ESC [ ... and intermediates */
+  VT_CSI_IGNORE,		/* Malformed ESC [, up to its final byte */
+  VT_DCS_ENTRY,			/* ESC P */
+  VT_DCS_PARAM,
+  VT_DCS_INT,
+  VT_DCS_PASS,			/* The string of ESC P */
+  VT_DCS_IGNORE,
+  VT_OSC,			/* ESC ], up to BEL or ST */
+  VT_SOS,			/* ESC X, ESC ^ and ESC _, up to ST */
+  VT_NSTATES,
+  VT_STAY = 15			/* No state change */
+};
+
+/* What to do with a byte. */
+enum {
+  A_NONE,
+  A_PRINT,			/* Show it */
+  A_EXECUTE,			/* Control character */
+  A_COLLECT,			/* Private marker or intermediate */
+  A_PARAM,			/* Digit or ';' */
+  A_ESC_DISPATCH,
+  A_CSI_DISPATCH,
+  A_PUT,			/* Part of an ESC P string */
+  A_CLEAR,			/* Start of a new sequence */
+};
+
+/* Action in the low four bits, next state in the high four bits. */
+#define T(a, s)	((a) | (s) << 4)
+
+static unsigned char vt_table[VT_NSTATES][256];
+
+static void vt_range(int state, int from, int to, int action, int next)
+{
+  for (; from <= to; from++)
+    vt_table[state][from] = T(action, next);
+}
+
+/*
+ * Fill in the parser tables, once.
+ */
+static void vt_tables(void)
+{
+  static int done;
+  int s;
+
+  if (done)
+    return;
+  done = 1;
+
+  for (s = 0; s < VT_NSTATES; s++) {
+    if (s < VT_DCS_ENTRY) {
+      /* Control characters work in escape sequences too, but an
+       * eight bit character ends one. */
+      vt_range(s, 0x00, 0x1f, A_EXECUTE, VT_STAY);
+      vt_range(s, 0x20, 0x7f, A_NONE, VT_STAY);
+      vt_range(s, 0x80, 0xff, A_NONE, VT_GROUND);
+    } else
+      vt_range(s, 0x00, 0xff, A_NONE, VT_STAY);
+  }
+
+  vt_range(VT_GROUND, 0x20, 0xff, A_PRINT, VT_STAY);
+
+  vt_range(VT_ESC, 0x20, 0x2f, A_COLLECT, VT_ESC_INT);
+  vt_range(VT_ESC, 0x30, 0x7e, A_ESC_DISPATCH, VT_GROUND);
+  vt_range(VT_ESC, '[', '[', A_CLEAR, VT_CSI_ENTRY);
+  vt_range(VT_ESC, ']', ']', A_NONE, VT_OSC);
+  vt_range(VT_ESC, 'P', 'P', A_CLEAR, VT_DCS_ENTRY);
+  vt_range(VT_ESC, 'X', 'X', A_NONE, VT_SOS);
+  vt_range(VT_ESC, '^', '_', A_NONE, VT_SOS);
+
+  vt_range(VT_ESC_INT, 0x20, 0x2f, A_COLLECT, VT_STAY);
+  vt_range(VT_ESC_INT, 0x30, 0x7e, A_ESC_DISPATCH, VT_GROUND);
+
+  vt_range(VT_CSI_ENTRY, 0x20, 0x2f, A_COLLECT, VT_CSI_INT);
+  vt_range(VT_CSI_ENTRY, 0x30, 0x39, A_PARAM, VT_CSI_PARAM);
+  vt_range(VT_CSI_ENTRY, ':', ':', A_NONE, VT_CSI_IGNORE);
+  vt_range(VT_CSI_ENTRY, ';', ';', A_PARAM, VT_CSI_PARAM);
+  vt_range(VT_CSI_ENTRY, 0x3c, 0x3f, A_COLLECT, VT_CSI_PARAM);
+  vt_range(VT_CSI_ENTRY, 0x40, 0x7e, A_CSI_DISPATCH, VT_GROUND);
+
+  vt_range(VT_CSI_PARAM, 0x20, 0x2f, A_COLLECT, VT_CSI_INT);
+  vt_range(VT_CSI_PARAM, 0x30, 0x3b, A_PARAM, VT_STAY);
+  vt_range(VT_CSI_PARAM, ':', ':', A_NONE, VT_CSI_IGNORE);
+  vt_range(VT_CSI_PARAM, 0x3c, 0x3f, A_NONE, VT_CSI_IGNORE);
+  vt_range(VT_CSI_PARAM, 0x40, 0x7e, A_CSI_DISPATCH, VT_GROUND);
+
+  vt_range(VT_CSI_INT, 0x20, 0x2f, A_COLLECT, VT_STAY);
+  vt_range(VT_CSI_INT, 0x30, 0x3f, A_NONE, VT_CSI_IGNORE);
+  vt_range(VT_CSI_INT, 0x40, 0x7e, A_CSI_DISPATCH, VT_GROUND);
+
+  vt_range(VT_CSI_IGNORE, 0x40, 0x7e, A_NONE, VT_GROUND);
+
+  /* The final byte of ESC P ... starts the string. */
+  vt_range(VT_DCS_ENTRY, 0x20, 0x2f, A_COLLECT, VT_DCS_INT);
+  vt_range(VT_DCS_ENTRY, 0x30, 0x39, A_PARAM, VT_DCS_PARAM);
+  vt_range(VT_DCS_ENTRY, ':', ':', A_NONE, VT_DCS_IGNORE);
+  vt_range(VT_DCS_ENTRY, ';', ';', A_PARAM, VT_DCS_PARAM);
+  vt_range(VT_DCS_ENTRY, 0x3c, 0x3f, A_COLLECT, VT_DCS_PARAM);
+  vt_range(VT_DCS_ENTRY, 0x40, 0x7e, A_PUT, VT_DCS_PASS);
+
+  vt_range(VT_DCS_PARAM, 0x20, 0x2f, A_COLLECT, VT_DCS_INT);
+  vt_range(VT_DCS_PARAM, 0x30, 0x3b, A_PARAM, VT_STAY);
+  vt_range(VT_DCS_PARAM, ':', ':', A_NONE, VT_DCS_IGNORE);
+  vt_range(VT_DCS_PARAM, 0x3c, 0x3f, A_NONE, VT_DCS_IGNORE);
+  vt_range(VT_DCS_PARAM, 0x40, 0x7e, A_PUT, VT_DCS_PASS);
+
+  vt_range(VT_DCS_INT, 0x20, 0x2f, A_COLLECT, VT_STAY);
+  vt_range(VT_DCS_INT, 0x30, 0x3f, A_NONE, VT_DCS_IGNORE);
+  vt_range(VT_DCS_INT, 0x40, 0x7e, A_PUT, VT_DCS_PASS);
+
+  vt_range(VT_DCS_PASS, 0x00, 0x7e, A_PUT, VT_STAY);
+  vt_range(VT_DCS_PASS, 0x80, 0xff, A_PUT, VT_STAY);
+
+  /* xterm ends an OSC with BEL as well as with ST. */
+  vt_range(VT_OSC, 7, 7, A_NONE, VT_GROUND);
+
+  /* From anywhere: CAN and SUB cancel, ESC starts over, and the eight
+   * bit CSI is ESC [. */
+  for (s = 0; s < VT_NSTATES; s++) {
+    vt_range(s, 0x18, 0x18, A_EXECUTE, VT_GROUND);
+    vt_range(s, 0x1a, 0x1a, A_EXECUTE, VT_GROUND);
+    vt_range(s, ESC, ESC, A_CLEAR, VT_ESC);
+    vt_range(s, 128 + ESC, 128 + ESC, A_CLEAR, VT_CSI_ENTRY);
+  }
+}
+
+
+/* Set characteristics of an emulator. */
+static void vt_reset(struct vt *vt, int type, int fg, int bg, int wrap,
+                     int add_lf, int add_cr)
+{
+  vt->type = type;
+  if (vt->type == ANSI) {
+	vt->fg = WHITE;
+	vt->bg = BLACK;
+  } else {
+	vt->fg = fg;
+	vt->bg = bg;
+  }
+  if (wrap >= 0)
+    vt->win->wrap = vt->wrap = wrap;
+  vt->addlf = add_lf;
+  vt->addcr = add_cr;
+  vt->insert = 0;
+  vt->crlf = 0;
+  vt->om = 0;
+
+  vt->newy1 = 0;
+  vt->newy2 = vt->win->ys - 1;
+  mc_wresetregion(vt->win);
+  vt->keypad = NORMAL;
+  vt->cursor = NORMAL;
+  vt->tabs[0] = 0x01010100;
+  vt->tabs[1] =
+  vt->tabs[2] =
+  vt->tabs[3] =
+  vt->tabs[4] = 0x01010101;
 #if TRANSLATE
-static short savecharset;
-static char *savetrans[2];
+  vt->charset = 0;
+  vt->trans[0] = vt->savetrans[0] = NULL;
+  vt->trans[1] = vt->savetrans[1] = vt_graphics;
 #endif
+  vt->ptr = 0;
+  memset(vt->escparms, 0, sizeof(vt->escparms));
+  vt->state = VT_GROUND;
+  vt->ninter = 0;
+
+  if (vt->keyb)
+    (*vt->keyb)(vt->keypad, vt->cursor);
+  mc_wsetfgcol(vt->win, vt->fg);
+  mc_wsetbgcol(vt->win, vt->bg);
+}
+
+static void main_out(const char *s, int len, void *data)
+{
+  (void)data;
+  (*termout)(s, len);
+}
 
 /*
- * Initialize the emulator once.
+ * Initialize the emulator of the main session once.
  */
 void vt_install(void (*fun1)(const char *, int), void (*fun2)(int, int),
                 WIN *win)
 {
+  vt_tables();
+  main_vt.utf8 = utf8_locale();
   termout = fun1;
-  vt_keyb = fun2;
-  vt_win = win;
+  main_vt.out = main_out;
+  main_vt.keyb = fun2;
+  main_vt.win = main_vt.main = win;
+}
+
+/*
+ * Use another window, after a screen resize.
+ */
+void vt_resize(struct vt *vt, WIN *win)
+{
+  if (vt->alt) {
+    mc_wclose(vt->alt, 0);
+    vt->alt = NULL;
+  }
+  vt->win = vt->main = win;
+  vt->newy1 = 0;
+  vt->newy2 = vt->win->ys - 1;
+  mc_wresetregion(vt->win);
+  mc_wsetfgcol(vt->win, vt->fg);
+  mc_wsetbgcol(vt->win, vt->bg);
+}
+
+/*
+ * The window output goes to now: the one we were given, or the
+ * alternate screen.
+ */
+WIN *vt_window(struct vt *vt)
+{
+  return vt->win;
 }
 
 /* Partial init (after screen resize) */
 void vt_pinit(WIN *win, int fg, int bg)
 {
-  vt_win = win;
-  newy1 = 0;
-  newy2 = vt_win->ys - 1;
-  mc_wresetregion(vt_win);
   if (fg >= 0)
-    vt_fg = fg;
+    main_vt.fg = fg;
   if (bg >= 0)
-    vt_bg = bg;
-  mc_wsetfgcol(vt_win, vt_fg);
-  mc_wsetbgcol(vt_win, vt_bg);
+    main_vt.bg = bg;
+  vt_resize(&main_vt, win);
 }
 
-/* Set characteristics of emulator. */
+/* Set characteristics of the main emulator. */
 void vt_init(int type, int fg, int bg, int wrap, int add_lf, int add_cr)
 {
-  vt_type = type;
-  if (vt_type == ANSI) {
-	vt_fg = WHITE;
-	vt_bg = BLACK;
-  } else {
-	vt_fg = fg;
-	vt_bg = bg;
-  }
-  if (wrap >= 0)
-    vt_win->wrap = vt_wrap = wrap;
-  vt_addlf = add_lf;
-  vt_addcr = add_cr;
-  vt_insert = 0;
-  vt_crlf = 0;
-  vt_om = 0;
-
-  newy1 = 0;
-  newy2 = vt_win->ys - 1;
-  mc_wresetregion(vt_win);
-  vt_keypad = NORMAL;
-  vt_cursor = NORMAL;
-  vt_echo = local_echo;
-  vt_tabs[0] = 0x01010100;
-  vt_tabs[1] =
-  vt_tabs[2] =
-  vt_tabs[3] =
-  vt_tabs[4] = 0x01010101;
-#if TRANSLATE
-  vt_charset = 0;
-  vt_trans[0] = savetrans[0] = vt_map[0];
-  vt_trans[1] = savetrans[1] = vt_map[1];
-#endif
-  ptr = 0;
-  memset(escparms, 0, sizeof(escparms));
-  esc_s = 0;
-
-  if (vt_keyb)
-    (*vt_keyb)(vt_keypad, vt_cursor);
-  mc_wsetfgcol(vt_win, vt_fg);
-  mc_wsetbgcol(vt_win, vt_bg);
+  main_vt.echo = local_echo;
+  vt_reset(&main_vt, type, fg, bg, wrap, add_lf, add_cr);
+}
+
+/*
+ * An emulator of its own, writing to win. What it has to send back
+ * (answers to requests, keys) goes to out.
+ */
+struct vt *vt_create(WIN *win, int type,
+                     void (*out)(const char *, int, void *), void *data)
+{
+  static const struct vt initial = VT_INITIAL;
+  struct vt *vt;
+
+  vt_tables();
+  if ((vt = malloc(sizeof(*vt))) == NULL)
+    return NULL;
+  *vt = initial;
+  vt->utf8 = utf8_locale();
+  vt->win = vt->main = win;
+  vt->out = out;
+  vt->data = data;
+  vt_reset(vt, type, tfcolor, tbcolor, win->wrap, 0, 0);
+  return vt;
+}
+
+/*
+ * Free an emulator from vt_create(). Its window is left alone.
+ */
+void vt_destroy(struct vt *vt)
+{
+  if (vt == NULL || vt == &main_vt)
+    return;
+  if (vt->alt)
+    mc_wclose(vt->alt, 0);
+  free(vt);
 }
 
 /* Change some things on the fly. */
@@ -247,40 +471,40 @@ void vt_set(int addlf, int wrap, int docap, int bscode,
             int addcr)
 {
   if (addlf >= 0)
-    vt_addlf = addlf;
+    main_vt.addlf = addlf;
   if (wrap >= 0)
-    vt_win->wrap = vt_wrap = wrap;
+    main_vt.win->wrap = main_vt.wrap = wrap;
   if (docap >= 0)
-    vt_docap = docap;
+    main_vt.docap = docap;
   if (bscode >= 0)
-    vt_bs = bscode;
+    main_vt.bs = bscode;
   if (echo >= 0)
-    vt_echo = echo;
+    main_vt.echo = echo;
   if (cursor >= 0)
-    vt_cursor = cursor;
+    main_vt.cursor = cursor;
   if (asis >=0)
-    vt_asis = asis;
+    main_vt.asis = asis;
   if (timestamp >= 0)
-    vt_line_timestamp = timestamp;
+    main_vt.line_timestamp = timestamp;
   if (addcr >= 0)
-    vt_addcr = addcr;
+    main_vt.addcr = addcr;
 }
 
 /* Output a string to the modem. */
-static void v_termout(const char *s, int len)
+static void v_termout(struct vt *vt, const char *s, int len)
 {
   const char *p;
 
-  if (vt_echo) {
+  if (vt->echo) {
     for (p = s; *p; p++) {
-      vt_out(*p, 0);
-      if (!vt_addlf && *p == '\r')
-        vt_out('\n', 0);
+      vt_putc(vt, *p, 0);
+      if (!vt->addlf && *p == '\r')
+        vt_putc(vt, '\n', 0);
     }
     mc_wflush();
   }
 
-  (*termout)(s, len);
+  (*vt->out)(s, len, vt->data);
 }
 
 /*
@@ -288,103 +512,123 @@ static void v_termout(const char *s, int len)
  */
 
 /*
- * ESC was seen the last time. Process the next character.
+ * ESC, maybe intermediates, and the final character c.
  */
-static void state1(int c)
+static void esc_dispatch(struct vt *vt, int c)
 {
   short x, y, f;
+  WIN *w = vt->win;
+
+  if (vt->ninter == 1) {
+    switch (vt->inter[0]) {
+#if TRANSLATE
+      case '(': /* Switch Character Sets. */
+      case ')':
+        f = vt->inter[0] == ')';
+        if (c == 'A' || c == 'B')
+          vt->trans[f] = NULL;
+        if (c == '0' || c == 'O')
+          vt->trans[f] = vt_graphics;
+        break;
+#endif
+      case '#': /* Double height, double width and selftests. */
+        if (c != '8')
+          break;
+        /* Selftest: fill screen with E's */
+        w->doscroll = 0;
+        w->direct = 0;
+        mc_wlocate(w, 0, 0);
+        for (y = 0; y < w->ys; y++) {
+          mc_wlocate(w, 0, y);
+          for (x = 0; x < w->xs; x++)
+            mc_wputc(w, 'E');
+        }
+        mc_wlocate(w, 0, 0);
+        w->doscroll = 1;
+        mc_wredraw(w, 1);
+        break;
+    }
+    return;
+  }
+  if (vt->ninter)
+    return;
 
   switch(c) {
-    case '[': /* ESC [ */
-      esc_s = 2;
-      return;
-    case '(': /* ESC ( */
-      esc_s = 4;
-      return;
-    case ')': /* ESC ) */
-      esc_s = 5;
-      return;
-    case '#': /* ESC # */
-      esc_s = 6;
-      return;
-    case 'P': /* ESC P (DCS, Device Control String) */
-      esc_s = 7;
-      return;
     case 'D': /* Cursor down */
     case 'M': /* Cursor up */
-      x = vt_win->curx;
+      x = w->curx;
       if (c == 'D') { /* Down. */
-        y = vt_win->cury + 1;
-        if (y == newy2 + 1)
-          mc_wscroll(vt_win, S_UP);
-        else if (vt_win->cury < vt_win->ys)
-          mc_wlocate(vt_win, x, y);
+        y = w->cury + 1;
+        if (y == vt->newy2 + 1)
+          mc_wscroll(w, S_UP);
+        else if (w->cury < w->ys)
+          mc_wlocate(w, x, y);
       }
       if (c == 'M')  { /* Up. */
-        y = vt_win->cury - 1;
-        if (y == newy1 - 1)
-          mc_wscroll(vt_win, S_DOWN);
+        y = w->cury - 1;
+        if (y == vt->newy1 - 1)
+          mc_wscroll(w, S_DOWN);
         else if (y >= 0)
-          mc_wlocate(vt_win, x, y);
+          mc_wlocate(w, x, y);
       }
       break;
     case 'E': /* CR + NL */
-      mc_wputs(vt_win, "\r\n");
+      mc_wputs(w, "\r\n");
       break;
     case '7': /* Save attributes and cursor position */
     case 's':
-      savex = vt_win->curx;
-      savey = vt_win->cury;
-      saveattr = vt_win->attr;
-      savecol = vt_win->color;
+      vt->savex = w->curx;
+      vt->savey = w->cury;
+      vt->saveattr = w->attr;
+      vt->savecol = w->color;
 #if TRANSLATE
-      savecharset = vt_charset;
-      savetrans[0] = vt_trans[0];
-      savetrans[1] = vt_trans[1];
+      vt->savecharset = vt->charset;
+      vt->savetrans[0] = vt->trans[0];
+      vt->savetrans[1] = vt->trans[1];
 #endif
       break;
     case '8': /* Restore them */
     case 'u':
 #if TRANSLATE
-      vt_charset = savecharset;
-      vt_trans[0] = savetrans[0];
-      vt_trans[1] = savetrans[1];
+      vt->charset = vt->savecharset;
+      vt->trans[0] = vt->savetrans[0];
+      vt->trans[1] = vt->savetrans[1];
 #endif
-      vt_win->color = savecol; /* HACK should use mc_wsetfgcol etc */
-      mc_wsetattr(vt_win, saveattr);
-      mc_wlocate(vt_win, savex, savey);
+      w->color = vt->savecol; /* HACK should use mc_wsetfgcol etc */
+      mc_wsetattr(w, vt->saveattr);
+      mc_wlocate(w, vt->savex, vt->savey);
       break;
     case '=': /* Keypad into applications mode */
-      vt_keypad = APPL;
-      if (vt_keyb)
-        (*vt_keyb)(vt_keypad, vt_cursor);
+      vt->keypad = APPL;
+      if (vt->keyb)
+        (*vt->keyb)(vt->keypad, vt->cursor);
       break;
     case '>': /* Keypad into numeric mode */
-      vt_keypad = NORMAL;
-      if (vt_keyb)
-        (*vt_keyb)(vt_keypad, vt_cursor);
+      vt->keypad = NORMAL;
+      if (vt->keyb)
+        (*vt->keyb)(vt->keypad, vt->cursor);
       break;
     case 'Z': /* Report terminal type */
-      if (vt_type == VT100)
-        v_termout("\033[?1;0c", 0);
+      if (vt->type == VT100)
+        v_termout(vt, "\033[?1;0c", 0);
       else
-        v_termout("\033[?c", 0);
+        v_termout(vt, "\033[?c", 0);
       break;
     case 'c': /* Reset to initial state */
       f = XA_NORMAL;
-      mc_wsetattr(vt_win, f);
-      vt_win->wrap = (vt_type != VT100);
-      if (vt_wrap != -1)
-        vt_win->wrap = vt_wrap;
-      vt_crlf = vt_insert = 0;
-      vt_init(vt_type, vt_fg, vt_bg, vt_win->wrap, 0, 0);
-      mc_wlocate(vt_win, 0, 0);
+      mc_wsetattr(w, f);
+      w->wrap = (vt->type != VT100);
+      if (vt->wrap != -1)
+        w->wrap = vt->wrap;
+      vt->crlf = vt->insert = 0;
+      vt_reset(vt, vt->type, vt->fg, vt->bg, w->wrap, 0, 0);
+      mc_wlocate(w, 0, 0);
       break;
     case 'H': /* Set tab in current position */
-      x = vt_win->curx;
+      x = w->curx;
       if (x > 159)
         x = 159;
-      vt_tabs[x / 32] |= 1 << (x % 32);
+      vt->tabs[x / 32] |= 1 << (x % 32);
       break;
     case 'N': /* G2 character set for next character only*/
     case 'O': /* G3 "				"    */
@@ -393,51 +637,116 @@ static void state1(int c)
       /* ALL IGNORED */
       break;
   }
-  esc_s = 0;
 }
 
 /* ESC [ ... [hl] seen. */
-static void ansi_mode(int on_off)
+static void ansi_mode(struct vt *vt, int on_off)
 {
   int i;
 
-  for (i = 0; i <= ptr; i++) {
-    switch (escparms[i]) {
+  for (i = 0; i <= vt->ptr; i++) {
+    switch (vt->escparms[i]) {
       case 4: /* Insert mode  */
-        vt_insert = on_off;
+        vt->insert = on_off;
         break;
       case 20: /* Return key mode */
-        vt_crlf = on_off;
+        vt->crlf = on_off;
+        break;
+    }
+  }
+}
+
+/* ESC [? ... [hl] seen. */
+static void dec_mode(struct vt *vt, int on_off)
+{
+  int i;
+
+  for (i = 0; i <= vt->ptr; i++) {
+    switch (vt->escparms[i]) {
+      case 1: /* Cursor keys in cursor/appl mode */
+        vt->cursor = on_off ? APPL : NORMAL;
+        if (vt->keyb)
+          (*vt->keyb)(vt->keypad, vt->cursor);
+        break;
+      case 6: /* Origin mode. */
+        vt->om = on_off;
+        mc_wlocate(vt->win, 0, vt->newy1);
+        break;
+      case 7: /* Auto wrap */
+        vt->win->wrap = on_off;
+        break;
+      case 25: /* Cursor on/off */
+        mc_wcursor(vt->win, on_off ? CNORMAL : CNONE);
+        break;
+      case 67: /* Backspace key sends. (FIXME: vt420) */
+        /* setbackspace(on_off ? 8 : 127); */
+        break;
+
+      case 47: /* Alternate screen */
+      case 1047:
+      case 1049:
+
+        if (vt->alt)
+          {
+            vt->win = vt->main;
+
+            mc_clear_window_simple(vt->alt);
+            mc_wclose(vt->alt, 1);
+            vt->alt = NULL;
+          }
+
+        if (on_off)
+          {
+            vt->alt = mc_wopen(vt->main->x1, vt->main->y1,
+                               vt->main->x2, vt->main->y2, BNONE, XA_NORMAL,
+                               tfcolor, tbcolor,  1, 0, 0);
+            vt->win = vt->alt;
+          }
+
+        /* Only the main session owns the terminal. */
+        if (vt == &main_vt)
+          {
+            char b[10];
+
+            snprintf(b, sizeof(b),
+                     "\e[?%d%c", vt->escparms[i], on_off ? 'h' : 'l');
+            b[sizeof(b) - 1] = 0;
+
+            mc_wputs(stdwin, b);
+          }
+
+        if (on_off)
+          mc_clear_window_simple(vt->alt);
+
+        break;
+      default: /* Mostly set up functions */
+        /* IGNORED */
         break;
     }
   }
 }
 
 /*
- * ESC [ ... was seen the last time. Process next character.
+ * ESC [, parameters and the final character c.
  */
-static void state2(int c)
+static void csi_dispatch(struct vt *vt, int c)
 {
   short x, y, attr, f;
   char temp[32];
+  WIN *w = vt->win;
+  int *escparms = vt->escparms;
 
-  /* See if a number follows */
-  if (c >= '0' && c <= '9') {
-    escparms[ptr] = 10*escparms[ptr] + c - '0';
+  /* ESC [ ? sequence */
+  if (vt->ninter == 1 && vt->inter[0] == '?') {
+    if (c == 'h')
+      dec_mode(vt, 1);
+    if (c == 'l')
+      dec_mode(vt, 0);
     return;
   }
-  /* Separation between numbers ? */
-  if (c == ';') {
-    if (ptr < (int)ARRAY_SIZE(escparms) - 1)
-      ptr++;
+  /* Other private modes and intermediates are not supported. */
+  if (vt->ninter)
     return;
-  }
-  /* ESC [ ? sequence */
-  if (escparms[0] == 0 && ptr == 0 && c == '?')
-    {
-      esc_s = 3;
-      return;
-    }
 
   /* Process functions with zero, one, two or more arguments */
   switch (c) {
@@ -447,120 +756,120 @@ static void state2(int c)
     case 'D': /* Cursor motion */
       if ((f = escparms[0]) == 0)
         f = 1;
-      x = vt_win->curx;
-      y = vt_win->cury;
+      x = w->curx;
+      y = w->cury;
       x += f * ((c == 'C') - (c == 'D'));
       if (x < 0)
         x = 0;
-      if (x >= vt_win->xs)
-        x = vt_win->xs - 1;
+      if (x >= w->xs)
+        x = w->xs - 1;
       if (c == 'B') { /* Down. */
         y += f;
-        if (y >= vt_win->ys)
-          y = vt_win->ys - 1;
-        if (y >= newy2 + 1)
-          y = newy2;
+        if (y >= w->ys)
+          y = w->ys - 1;
+        if (y >= vt->newy2 + 1)
+          y = vt->newy2;
       }
       if (c == 'A') { /* Up. */
         y -= f;
         if (y < 0)
           y = 0;
-        if (y <= newy1 - 1)
-          y = newy1;
+        if (y <= vt->newy1 - 1)
+          y = vt->newy1;
       }
-      mc_wlocate(vt_win, x, y);
+      mc_wlocate(w, x, y);
       break;
     case 'X': /* Character erasing (ECH) */
       if ((f = escparms[0]) == 0)
         f = 1;
-      mc_wclrch(vt_win, f);
+      mc_wclrch(w, f);
       break;
     case 'K': /* Line erasing */
       switch (escparms[0]) {
         case 0:
-          mc_wclreol(vt_win);
+          mc_wclreol(w);
           break;
         case 1:
-          mc_wclrbol(vt_win);
+          mc_wclrbol(w);
           break;
         case 2:
-          mc_wclrel(vt_win);
+          mc_wclrel(w);
           break;
       }
       break;
     case 'J': /* Screen erasing */
-      x = vt_win->color;
-      y = vt_win->attr;
-      if (vt_type == ANSI) {
-        mc_wsetattr(vt_win, XA_NORMAL);
-        mc_wsetfgcol(vt_win, WHITE);
-        mc_wsetbgcol(vt_win, BLACK);
+      x = w->color;
+      y = w->attr;
+      if (vt->type == ANSI) {
+        mc_wsetattr(w, XA_NORMAL);
+        mc_wsetfgcol(w, WHITE);
+        mc_wsetbgcol(w, BLACK);
       }
       switch (escparms[0]) {
         case 0:
-          mc_wclreos(vt_win);
+          mc_wclreos(w);
           break;
         case 1:
-          mc_wclrbos(vt_win);
+          mc_wclrbos(w);
           break;
         case 2:
-          mc_winclr(vt_win);
+          mc_winclr(w);
           break;
       }
-      if (vt_type == ANSI) {
-        vt_win->color = x;
-        vt_win->attr = y;
+      if (vt->type == ANSI) {
+        w->color = x;
+        w->attr = y;
       }
       break;
     case 'n': /* Requests / Reports */
       switch(escparms[0]) {
         case 5: /* Status */
-          v_termout("\033[0n", 0);
+          v_termout(vt, "\033[0n", 0);
           break;
         case 6:	/* Cursor Position */
-          sprintf(temp, "\033[%d;%dR", vt_win->cury + 1, vt_win->curx + 1);
-          v_termout(temp, 0);
+          sprintf(temp, "\033[%d;%dR", w->cury + 1, w->curx + 1);
+          v_termout(vt, temp, 0);
           break;
       }
       break;
     case 'c': /* Identify Terminal Type */
-      if (vt_type == VT100) {
-        v_termout("\033[?1;2c", 0);
+      if (vt->type == VT100) {
+        v_termout(vt, "\033[?1;2c", 0);
         break;
       }
-      v_termout("\033[?c", 0);
+      v_termout(vt, "\033[?c", 0);
       break;
     case 'x': /* Request terminal parameters. */
       /* Always answers 19200-8N1 no options. */
       sprintf(temp, "\033[%c;1;1;120;120;1;0x", escparms[0] == 1 ? '3' : '2');
-      v_termout(temp, 0);
+      v_termout(vt, temp, 0);
       break;
     case 's': /* Save attributes and cursor position */
-      savex = vt_win->curx;
-      savey = vt_win->cury;
-      saveattr = vt_win->attr;
-      savecol = vt_win->color;
+      vt->savex = w->curx;
+      vt->savey = w->cury;
+      vt->saveattr = w->attr;
+      vt->savecol = w->color;
 #if TRANSLATE
-      savecharset = vt_charset;
-      savetrans[0] = vt_trans[0];
-      savetrans[1] = vt_trans[1];
+      vt->savecharset = vt->charset;
+      vt->savetrans[0] = vt->trans[0];
+      vt->savetrans[1] = vt->trans[1];
 #endif
       break;
     case 'u': /* Restore them */
 #if TRANSLATE
-      vt_charset = savecharset;
-      vt_trans[0] = savetrans[0];
-      vt_trans[1] = savetrans[1];
+      vt->charset = vt->savecharset;
+      vt->trans[0] = vt->savetrans[0];
+      vt->trans[1] = vt->savetrans[1];
 #endif
-      vt_win->color = savecol; /* HACK should use mc_wsetfgcol etc */
-      mc_wsetattr(vt_win, saveattr);
-      mc_wlocate(vt_win, savex, savey);
+      w->color = vt->savecol; /* HACK should use mc_wsetfgcol etc */
+      mc_wsetattr(w, vt->saveattr);
+      mc_wlocate(w, vt->savex, vt->savey);
       break;
     case 'h':
-      ansi_mode(1);
+      ansi_mode(vt, 1);
       break;
     case 'l':
-      ansi_mode(0);
+      ansi_mode(vt, 0);
       break;
     case 'H':
     case 'f': /* Set cursor position */
@@ -568,39 +877,39 @@ static void state2(int c)
         y = 1;
       if ((x = escparms[1]) == 0)
         x = 1;
-      if (vt_om)
-        y += newy1;
-      mc_wlocate(vt_win, x - 1, y - 1);
+      if (vt->om)
+        y += vt->newy1;
+      mc_wlocate(w, x - 1, y - 1);
       break;
     case 'G': /* HPA: Cursor to column x */
     case '`':
       if ((x = escparms[1]) == 0)
         x = 1;
-      mc_wlocate(vt_win, x - 1, vt_win->cury);
+      mc_wlocate(w, x - 1, w->cury);
       break;
     case 'g': /* Clear tab stop(s) */
       if (escparms[0] == 0) {
-        x = vt_win->curx;
+        x = w->curx;
         if (x > 159)
           x = 159;
-        vt_tabs[x / 32] &= ~(1 << x % 32);
+        vt->tabs[x / 32] &= ~(1 << x % 32);
       }
       if (escparms[0] == 3)
         for(x = 0; x < 5; x++)
-          vt_tabs[x] = 0;
+          vt->tabs[x] = 0;
       break;
     case 'm': /* Set attributes */
-      attr = mc_wgetattr((vt_win));
-      for (f = 0; f <= ptr; f++) {
+      attr = mc_wgetattr((w));
+      for (f = 0; f <= vt->ptr; f++) {
         if (escparms[f] >= 30 && escparms[f] <= 37)
-          mc_wsetfgcol(vt_win, escparms[f] - 30);
+          mc_wsetfgcol(w, escparms[f] - 30);
         if (escparms[f] >= 40 && escparms[f] <= 47)
-          mc_wsetbgcol(vt_win, escparms[f] - 40);
+          mc_wsetbgcol(w, escparms[f] - 40);
         switch (escparms[f]) {
           case 0:
             attr = XA_NORMAL;
-            mc_wsetfgcol(vt_win, vt_fg);
-            mc_wsetbgcol(vt_win, vt_bg);
+            mc_wsetfgcol(w, vt->fg);
+            mc_wsetbgcol(w, vt->bg);
             break;
           case 1:
             attr |= XA_BOLD;
@@ -627,59 +936,59 @@ static void state2(int c)
             attr &= ~XA_REVERSE;
             break;
           case 39: /* Default fg color */
-            mc_wsetfgcol(vt_win, vt_fg);
+            mc_wsetfgcol(w, vt->fg);
             break;
           case 49: /* Default bg color */
-            mc_wsetbgcol(vt_win, vt_bg);
+            mc_wsetbgcol(w, vt->bg);
             break;
         }
       }
-      mc_wsetattr(vt_win, attr);
+      mc_wsetattr(w, attr);
       break;
     case 'L': /* Insert lines */
       if ((x = escparms[0]) == 0)
         x = 1;
       for (f = 0; f < x; f++)
-        mc_winsline(vt_win);
+        mc_winsline(w);
       break;
     case 'M': /* Delete lines */
       if ((x = escparms[0]) == 0)
         x = 1;
       for (f = 0; f < x; f++)
-        mc_wdelline(vt_win);
+        mc_wdelline(w);
       break;
     case 'P': /* Delete Characters */
       if ((x = escparms[0]) == 0)
         x = 1;
       for (f = 0; f < x; f++)
-        mc_wdelchar(vt_win);
+        mc_wdelchar(w);
       break;
     case '@': /* Insert Characters */
       if ((x = escparms[0]) == 0)
         x = 1;
       for (f = 0; f < x; f++)
-        mc_winschar(vt_win);
+        mc_winschar(w);
       break;
     case 'r': /* Set scroll region */
-      if ((newy1 = escparms[0]) == 0)
-        newy1 = 1;
-      if ((newy2 = escparms[1]) == 0)
-        newy2 = vt_win->ys;
-      newy1-- ; newy2--;
-      if (newy1 < 0)
-        newy1 = 0;
-      if (newy2 < 0)
-        newy2 = 0;
-      if (newy1 >= vt_win->ys)
-        newy1 = vt_win->ys - 1;
-      if (newy2 >= vt_win->ys)
-        newy2 = vt_win->ys - 1;
-      if (newy1 >= newy2) {
-        newy1 = 0;
-        newy2 = vt_win->ys - 1;
+      if ((vt->newy1 = escparms[0]) == 0)
+        vt->newy1 = 1;
+      if ((vt->newy2 = escparms[1]) == 0)
+        vt->newy2 = w->ys;
+      vt->newy1-- ; vt->newy2--;
+      if (vt->newy1 < 0)
+        vt->newy1 = 0;
+      if (vt->newy2 < 0)
+        vt->newy2 = 0;
+      if (vt->newy1 >= w->ys)
+        vt->newy1 = w->ys - 1;
+      if (vt->newy2 >= w->ys)
+        vt->newy2 = w->ys - 1;
+      if (vt->newy1 >= vt->newy2) {
+        vt->newy1 = 0;
+        vt->newy2 = w->ys - 1;
       }
-      mc_wsetregion(vt_win, newy1, newy2);
-      mc_wlocate(vt_win, 0, newy1);
+      mc_wsetregion(w, vt->newy1, vt->newy2);
+      mc_wlocate(w, 0, vt->newy1);
       break;
     case 'i': /* Printing */
     case 'y': /* Self test modes */
@@ -691,433 +1000,406 @@ static void state2(int c)
         }
       break;
   }
-  /* Ok, our escape sequence is all done */
-  esc_s = 0;
-  ptr = 0;
-  memset(escparms, 0, sizeof(escparms));
-  return;
-}
-
-/* ESC [? ... [hl] seen. */
-static void dec_mode(int on_off)
-{
-  int i;
-
-  for (i = 0; i <= ptr; i++) {
-    switch (escparms[i]) {
-      case 1: /* Cursor keys in cursor/appl mode */
-        vt_cursor = on_off ? APPL : NORMAL;
-        if (vt_keyb)
-          (*vt_keyb)(vt_keypad, vt_cursor);
-        break;
-      case 6: /* Origin mode. */
-        vt_om = on_off;
-        mc_wlocate(vt_win, 0, newy1);
-        break;
-      case 7: /* Auto wrap */
-        vt_win->wrap = on_off;
-        break;
-      case 25: /* Cursor on/off */
-        mc_wcursor(vt_win, on_off ? CNORMAL : CNONE);
-        break;
-      case 67: /* Backspace key sends. (FIXME: vt420) */
-        /* setbackspace(on_off ? 8 : 127); */
-        break;
-
-      case 47: /* Alternate screen */
-      case 1047:
-      case 1049:
-
-        if ((us_alternate && on_off) || !on_off)
-          {
-            vt_win = us;
-
-            mc_clear_window_simple(us_alternate);
-            mc_wclose(us_alternate, 1);
-            us_alternate = NULL;
-          }
-
-        if (on_off)
-          {
-            us_alternate = mc_wopen(0, 0, COLS - 1, us->y2, BNONE, XA_NORMAL,
-                                    tfcolor, tbcolor,  1, 0, 0);
-            vt_win = us_alternate;
-          }
-
-          {
-            char b[10];
-
-            snprintf(b, sizeof(b),
-                     "\e[?%d%c", escparms[i], on_off ? 'h' : 'l');
-            b[sizeof(b) - 1] = 0;
-
-            mc_wputs(stdwin, b);
-          }
-
-        if (on_off)
-          mc_clear_window_simple(us_alternate);
-
-        break;
-      default: /* Mostly set up functions */
-        /* IGNORED */
-        break;
-    }
-  }
 }
 
 /*
- * ESC [ ? ... seen.
+ * End of an ESC P string.
  */
-static void state3(int c)
+static void dcs_unhook(struct vt *vt)
 {
-  /* See if a number follows */
-  if (c >= '0' && c <= '9') {
-    escparms[ptr] = 10*escparms[ptr] + c - '0';
-    return;
+  /*
+   * Device dependent control strings. The Minix virtual console package
+   * uses these sequences. We can only turn cursor on or off, because
+   * that's the only one supported in termcap. The rest is ignored.
+   */
+  vt->dcs[vt->dcs_pos] = 0;
+  if (!strcmp(vt->dcs, "cursor.on"))
+    mc_wcursor(vt->win, CNORMAL);
+  if (!strcmp(vt->dcs, "cursor.off"))
+    mc_wcursor(vt->win, CNONE);
+  if (!strcmp(vt->dcs, "linewrap.on")) {
+    vt->wrap = -1;
+    vt->win->wrap = 1;
   }
-  switch (c) {
-    case 'h':
-      dec_mode(1);
-      break;
-    case 'l':
-      dec_mode(0);
-      break;
-    case 'i': /* Printing */
-    case 'n': /* Request printer status */
-    default:
-      /* IGNORED */
-      break;
+  if (!strcmp(vt->dcs, "linewrap.off")) {
+    vt->wrap = -1;
+    vt->win->wrap = 0;
   }
-  esc_s = 0;
-  ptr = 0;
-  memset(escparms, 0, sizeof(escparms));
-  return;
+}
+
+static void output_s(struct vt *vt, const char *s)
+{
+  mc_wputs(vt->win, s);
+  if (vt->docap == 1)
+    cap_puts(s);
+}
+
+static void output_c(struct vt *vt, const char c)
+{
+  mc_wputc(vt->win, c);
+  if (vt->docap == 1)
+    cap_putc(c);
 }
 
 /*
- * ESC ( Seen.
+ * Set the time the data passed to vt_out() was received, for the line
+ * timestamps. NULL means "now".
  */
-static void state4(int c)
+void vt_rxtime(const struct timeval *tv)
 {
-  /* Switch Character Sets. */
-#if !TRANSLATE
-  /* IGNORED */
-  (void)c;
-#else
-  switch (c) {
-    case 'A':
-    case 'B':
-      vt_trans[0] = vt_map[0];
-      break;
-    case '0':
-    case 'O':
-      vt_trans[0] = vt_map[1];
-      break;
-  }
-#endif
-  esc_s = 0;
+  main_vt.rx_tv = tv;
 }
 
 /*
- * ESC ) Seen.
+ * A character to show.
  */
-static void state5(int c)
+static void vt_print(struct vt *vt, unsigned char c, wchar_t wc)
 {
-  /* Switch Character Sets. */
-#if !TRANSLATE
-  /* IGNORED */
-  (void)c;
-#else
-  switch (c) {
-    case 'A':
-    case 'B':
-      vt_trans[1] = vt_map[0];
-      break;
-    case 'O':
-    case '0':
-      vt_trans[1] = vt_map[1];
-      break;
-  }
+  if (vt->docap == 1)
+    cap_putc(P_CONVCAP[0] == 'Y' ? vt_inmap[c] : c);
+  if (!using_iconv()) {
+    /* conversion 04.09.97 / jl, for characters of one byte. */
+    if (vt_inmap[c] != c && (wc == 0 || wc == c || wc == (wchar_t)(char)c)) {
+      c = vt_inmap[c];
+      wc = 0;
+    }
+#if TRANSLATE
+    /* If the locale can show it. */
+    if (vt->type == VT100 && vt->trans[vt->charset] && c >= '_' && c <= '~'
+        && wcwidth(vt->trans[vt->charset][c - '_']) > 0)
+      wc = vt->trans[vt->charset][c - '_'];
 #endif
-  esc_s = 0;
+  }
+  if (wc == 0)
+    one_mbtowc (&wc, (char *)&c, 1); /* returns 1 */
+  if (vt->insert)
+    mc_winschar2(vt->win, wc, 1);
+  else
+    mc_wputc(vt->win, wc);
 }
 
 /*
- * ESC # Seen.
+ * A control character.
  */
-static void state6(int c)
+static void vt_execute(struct vt *vt, unsigned char c, wchar_t wc)
 {
-  int x, y;
+  int f;
 
-  /* Double height, double width and selftests. */
   switch (c) {
-    case '8':
-      /* Selftest: fill screen with E's */
-      vt_win->doscroll = 0;
-      vt_win->direct = 0;
-      mc_wlocate(vt_win, 0, 0);
-      for (y = 0; y < vt_win->ys; y++) {
-        mc_wlocate(vt_win, 0, y);
-        for (x = 0; x < vt_win->xs; x++)
-          mc_wputc(vt_win, 'E');
+    case 5: /* AnswerBack for vt100's */
+      if (vt->type != VT100) {
+        if (vt->state == VT_GROUND)
+          vt_print(vt, c, wc);
+        break;
       }
-      mc_wlocate(vt_win, 0, 0);
-      vt_win->doscroll = 1;
-      mc_wredraw(vt_win, 1);
+      v_termout(vt, P_ANSWERBACK, 0);
+      break;
+    case '\r': /* Carriage return */
+      mc_wputc(vt->win, c);
+      if (vt->addlf)
+        output_c(vt, '\n');
+      break;
+    case '\t': /* Non - destructive TAB */
+      /* Find next tab stop. */
+      for (f = vt->win->curx + 1; f < 160; f++)
+        if (vt->tabs[f / 32] & (1u << f % 32))
+          break;
+      if (f >= vt->win->xs)
+        f = vt->win->xs - 1;
+      mc_wlocate(vt->win, f, vt->win->cury);
+      if (vt->docap == 1)
+        cap_putc(c);
+      break;
+    case 013: /* Old Minix: CTRL-K = up */
+      mc_wlocate(vt->win, vt->win->curx, vt->win->cury - 1);
+      break;
+    case '\f': /* Form feed: clear screen. */
+      mc_winclr(vt->win);
+      mc_wlocate(vt->win, 0, 0);
+      break;
+#if !TRANSLATE
+    case 14:
+    case 15:  /* Change character set. Not supported. */
+      break;
+#else
+    case 14:
+      vt->charset = 1;
+      break;
+    case 15:
+      vt->charset = 0;
+      break;
+#endif
+    case 24:
+    case 26:  /* Cancel escape sequence. */
+      break;
+    case '\n':
+      if(vt->addcr)
+        mc_wputc(vt->win, '\r');
+      output_c(vt, c);
+	  break;
+    case '\b':
+    case 7: /* Bell */
+      output_c(vt, c);
       break;
     default:
-      /* IGNORED */
+      /* The others are shown, unless in an escape sequence. */
+      if (vt->state == VT_GROUND)
+        vt_print(vt, c, wc);
       break;
   }
-  esc_s = 0;
-}
-
-/*
- * ESC P Seen.
- */
-static void state7(int c)
-{
-  /*
-   * Device dependent control strings. The Minix virtual console package
-   * uses these sequences. We can only turn cursor on or off, because
-   * that's the only one supported in termcap. The rest is ignored.
-   */
-  static char buf[17];
-  static int pos = 0;
-  static int state = 0;
-
-  if (c == ESC) {
-    state = 1;
-    return;
-  }
-  if (state == 1) {
-    buf[pos] = 0;
-    pos = 0;
-    state = 0;
-    esc_s = 0;
-    if (c != '\\')
-      return;
-    /* Process string here! */
-    if (!strcmp(buf, "cursor.on"))
-      mc_wcursor(vt_win, CNORMAL);
-    if (!strcmp(buf, "cursor.off"))
-      mc_wcursor(vt_win, CNONE);
-    if (!strcmp(buf, "linewrap.on")) {
-      vt_wrap = -1;
-      vt_win->wrap = 1;
-    }
-    if (!strcmp(buf, "linewrap.off")) {
-      vt_wrap = -1;
-      vt_win->wrap = 0;
-    }
-    return;
-  }
-  if (pos > 15)
-    return;
-  buf[pos++] = c;
 }
 
-static void output_s(const char *s)
+static void vt_putc(struct vt *vt, int ch, wchar_t wc)
 {
-  mc_wputs(vt_win, s);
-  if (vt_docap == 1)
-    fputs(s, capfp);
-}
-
-static void output_c(const char c)
-{
-  mc_wputc(vt_win, c);
-  if (vt_docap == 1)
-    fputc(c, capfp);
-}
-
-void vt_out(int ch, wchar_t wc)
-{
-  static unsigned char last_ch;
-  int f;
   unsigned char c;
-  int go_on = 0;
+  int t, next;
 
   if (!ch)
     return;
 
-  if (last_ch == '\n'
-      && vt_line_timestamp != TIMESTAMP_LINE_OFF)
+  if (vt->last_ch == '\n'
+      && vt->line_timestamp != TIMESTAMP_LINE_OFF)
     {
       struct timeval tmstmp_now;
-      static struct timeval tmstmp_last;
       char s[36];
       struct tm tmstmp_tm;
 
-      gettimeofday(&tmstmp_now, NULL);
-      if ((   vt_line_timestamp == TIMESTAMP_LINE_PER_SECOND
-           && tmstmp_now.tv_sec != tmstmp_last.tv_sec)
-          || vt_line_timestamp == TIMESTAMP_LINE_SIMPLE
-          || vt_line_timestamp == TIMESTAMP_LINE_EXTENDED)
+      if (vt->rx_tv)
+        tmstmp_now = *vt->rx_tv;
+      else
+        gettimeofday(&tmstmp_now, NULL);
+      if ((   vt->line_timestamp == TIMESTAMP_LINE_PER_SECOND
+           && tmstmp_now.tv_sec != vt->ts_last.tv_sec)
+          || vt->line_timestamp == TIMESTAMP_LINE_SIMPLE
+          || vt->line_timestamp == TIMESTAMP_LINE_EXTENDED)
         {
-          if (   tmstmp_last.tv_sec
+          if (   vt->ts_last.tv_sec
               && localtime_r(&tmstmp_now.tv_sec, &tmstmp_tm)
               && strftime(s, sizeof(s), "[%F %T", &tmstmp_tm))
             {
-              output_s(s);
-              switch (vt_line_timestamp)
+              output_s(vt, s);
+              switch (vt->line_timestamp)
                 {
                 case TIMESTAMP_LINE_SIMPLE:
-                  output_s("] ");
+                  output_s(vt, "] ");
                   break;
                 case TIMESTAMP_LINE_EXTENDED:
                   snprintf(s, sizeof(s), ".%03ld] ", tmstmp_now.tv_usec / 1000);
-                  output_s(s);
+                  output_s(vt, s);
                   break;
                 case TIMESTAMP_LINE_PER_SECOND:
-                  output_s("\r\n");
+                  output_s(vt, "\r\n");
                   break;
                 };
             }
-          tmstmp_last = tmstmp_now;
+          vt->ts_last = tmstmp_now;
         }
-      else if (vt_line_timestamp == TIMESTAMP_LINE_DELTA)
+      else if (vt->line_timestamp == TIMESTAMP_LINE_DELTA)
         {
-          if (tmstmp_last.tv_sec)
+          if (vt->ts_last.tv_sec)
             {
               unsigned long long d;
               d =   (tmstmp_now.tv_sec * 1000000 + tmstmp_now.tv_usec)
-                  - (tmstmp_last.tv_sec * 1000000 + tmstmp_last.tv_usec);
+                  - (vt->ts_last.tv_sec * 1000000 + vt->ts_last.tv_usec);
               snprintf(s, sizeof(s), "[%lld.%03lld] ",
                        d / 1000000, (d % 1000000) / 1000);
               s[sizeof(s) - 1] = 0;
-              output_s(s);
+              output_s(vt, s);
             }
-          tmstmp_last = tmstmp_now;
+          vt->ts_last = tmstmp_now;
         }
     }
 
   c = (unsigned char)ch;
-  last_ch = c;
+  vt->last_ch = c;
 
-  if (vt_docap == 2) /* Literal. */
-    fputc(c, capfp);
+  /* Literal capture (docap == 2) is done by rx_capture(). */
 
-  /* Process <31 chars first, even in an escape sequence. */
-  switch (c) {
-    case 5: /* AnswerBack for vt100's */
-      if (vt_type != VT100) {
-        go_on = 1;
-        break;
-      }
-      v_termout(P_ANSWERBACK, 0);
+  /* Most bytes are text; leave the table out of it. */
+  if (vt->state == VT_GROUND && c >= ' ' && c < 127) {
+    vt_print(vt, c, wc);
+    return;
+  }
+
+  t = vt_table[vt->state][c];
+  next = t >> 4;
+  if (vt->state == VT_DCS_PASS && next != VT_STAY)
+    dcs_unhook(vt);
+
+  switch (t & 15) {
+    case A_PRINT:
+      vt_print(vt, c, wc);
       break;
-    case '\r': /* Carriage return */
-      mc_wputc(vt_win, c);
-      if (vt_addlf)
-        output_c('\n');
+    case A_EXECUTE:
+      vt_execute(vt, c, wc);
       break;
-    case '\t': /* Non - destructive TAB */
-      /* Find next tab stop. */
-      for (f = vt_win->curx + 1; f < 160; f++)
-        if (vt_tabs[f / 32] & (1u << f % 32))
-          break;
-      if (f >= vt_win->xs)
-        f = vt_win->xs - 1;
-      mc_wlocate(vt_win, f, vt_win->cury);
-      if (vt_docap == 1)
-        fputc(c, capfp);
+    case A_COLLECT:
+      if (vt->ninter < (int)sizeof(vt->inter))
+        vt->inter[vt->ninter++] = c;
+      else
+        vt->ninter = sizeof(vt->inter) + 1;	/* Too many: matches nothing */
       break;
-    case 013: /* Old Minix: CTRL-K = up */
-      mc_wlocate(vt_win, vt_win->curx, vt_win->cury - 1);
+    case A_PARAM:
+      if (c == ';') {
+        if (vt->ptr < (int)ARRAY_SIZE(vt->escparms) - 1)
+          vt->ptr++;
+      } else if (vt->escparms[vt->ptr] < 10000)
+        vt->escparms[vt->ptr] = 10 * vt->escparms[vt->ptr] + c - '0';
       break;
-    case '\f': /* Form feed: clear screen. */
-      mc_winclr(vt_win);
-      mc_wlocate(vt_win, 0, 0);
+    case A_ESC_DISPATCH:
+      esc_dispatch(vt, c);
       break;
-#if !TRANSLATE
-    case 14:
-    case 15:  /* Change character set. Not supported. */
+    case A_CSI_DISPATCH:
+      csi_dispatch(vt, c);
       break;
-#else
-    case 14:
-      vt_charset = 1;
+    case A_PUT:
+      if (vt->dcs_pos < (int)sizeof(vt->dcs) - 1)
+        vt->dcs[vt->dcs_pos++] = c;
       break;
-    case 15:
-      vt_charset = 0;
+    case A_CLEAR:
+      vt->ninter = 0;
+      vt->ptr = 0;
+      memset(vt->escparms, 0, sizeof(vt->escparms));
+      vt->dcs_pos = 0;
       break;
+  }
+
+  if (next != VT_STAY)
+    vt->state = next;
+}
+
+/* One character (ch, or wc if not 0) for the main session. */
+void vt_out(int ch, wchar_t wc)
+{
+  vt_putc(&main_vt, ch, wc);
+}
+
+/*
+ * How many bytes at the start of s are plain ASCII text, ' ' to '~'.
+ */
+static size_t vt_plain(const char *s, size_t len)
+{
+  size_t n = 0;
+
+#ifdef __SSE2__
+  /* Sixteen at a time. As signed bytes, controls and eight bit
+   * characters are both less than ' '. */
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i del = _mm_set1_epi8(127);
+  __m128i v;
+  int m;
+
+  for (; n + 16 <= len; n += 16) {
+    v = _mm_loadu_si128((const __m128i *)(s + n));
+    m = _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, sp),
+                                       _mm_cmpeq_epi8(v, del)));
+    if (m)
+      return n + __builtin_ctz(m);
+  }
 #endif
-    case 24:
-    case 26:  /* Cancel escape sequence. */
-      esc_s = 0;
-      break;
-    case ESC: /* Begin escape sequence */
-      esc_s = 1;
-      break;
-    case 128+ESC: /* Begin ESC [ sequence. */
-      esc_s = 2;
-      break;
-    case '\n':
-      if(vt_addcr)
-        mc_wputc(vt_win, '\r');
-      output_c(c);
-	  break;
-    case '\b':
-    case 7: /* Bell */
-      output_c(c);
+  for (; n < len; n++)
+    if ((unsigned char)s[n] < ' ' || (unsigned char)s[n] >= 127)
       break;
-    default:
-      go_on = 1;
-      break;
-  }
-  if (!go_on)
-    return;
+  return n;
+}
+
+/* Call after changing vt_inmap[]. */
+void vt_inmap_changed(void)
+{
+  int c;
 
-  /* Now see which state we are in. */
-  switch (esc_s) {
-    case 0: /* Normal character */
-      if (vt_docap == 1)
-        fputc(P_CONVCAP[0] == 'Y' ? vt_inmap[c] : c, capfp);
-      if (!using_iconv()) {
-        c = vt_inmap[c];    /* conversion 04.09.97 / jl */
+  inmap_plain = 1;
+  for (c = ' '; c <= '~'; c++)
+    if (vt_inmap[c] != c)
+      inmap_plain = 0;
+}
+
+/*
+ * Does plain text show as the bytes it is? Not with the graphics set
+ * or a conversion table that changes it: vt_print() maps it then.
+ */
+static int vt_asis(struct vt *vt)
+{
 #if TRANSLATE
-        if (vt_type == VT100 && vt_trans[vt_charset] && vt_asis == 0)
-          c = vt_trans[vt_charset][c];
+  if (vt->type == VT100 && vt->trans[vt->charset])
+    return 0;
 #endif
-      }
-      if (wc == 0)
-        one_mbtowc (&wc, (char *)&c, 1); /* returns 1 */
-      if (vt_insert)
-        mc_winschar2(vt_win, wc, 1);
-      else
-        mc_wputc(vt_win, wc);
-      break;
-    case 1: /* ESC seen */
-      state1(c);
-      break;
-    case 2: /* ESC [ ... seen */
-      state2(c);
-      break;
-    case 3:
-      state3(c);
-      break;
-    case 4:
-      state4(c);
-      break;
-    case 5:
-      state5(c);
-      break;
-    case 6:
-      state6(c);
-      break;
-    case 7:
-      state7(c);
-      break;
+  return inmap_plain || using_iconv();
+}
+
+/*
+ * n bytes of plain text, in the ground state: what vt_putc() would do
+ * with each of them, in one go.
+ */
+static void vt_text(struct vt *vt, const char *s, size_t n)
+{
+  size_t i;
+
+  if (vt->docap == 1) {
+    if (P_CONVCAP[0] == 'Y')
+      for (i = 0; i < n; i++)
+        cap_putc(vt_inmap[(unsigned char)s[i]]);
+    else
+      cap_write(s, n);
   }
+  mc_wputn(vt->win, s, (int)n);
+  vt->last_ch = s[n - 1];
+}
 
-  /* Flush output to capture file so that all output is visible there
-   * immediately. Causes a write syscall for every call though. */
-  if (capfp)
-    fflush(capfp);
+/*
+ * Run len bytes received from the remote side through the emulator.
+ * A UTF-8 character may be split over two calls.
+ */
+void vt_feed(struct vt *vt, const char *buf, size_t len)
+{
+  wchar_t wc;
+  size_t n;
+  unsigned char c;
+  int i;
+
+  while (len > 0) {
+    /* Runs of text skip the parser and go to the window whole. */
+    if (vt->state == VT_GROUND && !vt->insert && vt->u8len == 0
+        && (vt->last_ch != '\n' || vt->line_timestamp == TIMESTAMP_LINE_OFF)
+        && vt_asis(vt) && (n = vt_plain(buf, len)) > 0) {
+      vt_text(vt, buf, n);
+      buf += n;
+      len -= n;
+      continue;
+    }
+    if (!vt->utf8) {
+      n = one_mbtowc(&wc, buf, len);
+      vt_putc(vt, *buf, wc);
+      buf += n;
+      len -= n;
+      continue;
+    }
+
+    c = *buf;
+    vt->u8state = utf8_next(vt->u8state, c, &vt->u8cp);
+    if (vt->u8state == UTF8_REJECT) {
+      /* Not UTF-8: the bytes go as they are, as with mbtowc(). */
+      vt->u8state = UTF8_ACCEPT;
+      for (i = 0; i < vt->u8len; i++)
+        vt_putc(vt, vt->u8seq[i], (char)vt->u8seq[i]);
+      if (vt->u8len) {
+        /* c may start something new. */
+        vt->u8len = 0;
+        continue;
+      }
+      vt_putc(vt, c, (char)c);
+    } else if (vt->u8state == UTF8_ACCEPT) {
+      vt_putc(vt, vt->u8len ? vt->u8seq[0] : c, vt->u8cp);
+      vt->u8len = 0;
+    } else
+      vt->u8seq[vt->u8len++] = c;
+    buf++;
+    len--;
+  }
 }
 
 /* Translate keycode to escape sequence. */
-void vt_send(int c)
+void vt_key(struct vt *vt, int c)
 {
   char s[3];
   int f;
@@ -1127,18 +1409,20 @@ void vt_send(int c)
   if (c < 256) {
     /* Translate backspace key? */
     if (c == K_ERA)
-      c = vt_bs;
+      c = vt->bs;
     s[0] = vt_outmap[c];  /* conversion 04.09.97 / jl */
     s[1] = 0;
     /* CR/LF mode? */
-    if (c == '\r' && vt_crlf) {
+    if (c == '\r' && vt->crlf) {
       s[1] = '\n';
       s[2] = 0;
       len = 2;
     }
-    v_termout(s, len);
-    if (vt_nl_delay > 0 && c == '\r')
+    v_termout(vt, s, len);
+    if (vt_nl_delay > 0 && c == '\r' && vt == &main_vt) {
+      tx_flush();
       usleep(1000 * vt_nl_delay);
+    }
     return;
   }
 
@@ -1150,12 +1434,18 @@ void vt_send(int c)
     return;
 
   /* Now send appropriate escape code. */
-  v_termout("\033", 0);
-  if (vt_type == VT100) {
-    if (vt_cursor == NORMAL)
-      v_termout(vt_keys[f].vt100_st, 0);
+  v_termout(vt, "\033", 0);
+  if (vt->type == VT100) {
+    if (vt->cursor == NORMAL)
+      v_termout(vt, vt_keys[f].vt100_st, 0);
     else
-      v_termout(vt_keys[f].vt100_app, 0);
+      v_termout(vt, vt_keys[f].vt100_app, 0);
   } else
-    v_termout(vt_keys[f].ansi, 0);
+    v_termout(vt, vt_keys[f].ansi, 0);
+}
+
+/* A key typed in the main session. */
+void vt_send(int c)
+{
+  vt_key(&main_vt, c);
 }
@@ -31,12 +31,30 @@
 extern int vt_nl_delay;		/* Delay after CR key */
 extern int vt_ch_delay;		/* Delay after each character */
 
+/*
+ * An emulator. The main session has one (vt_main), which the vt_*
+ * functions without a struct vt argument work on; vt_create() makes
+ * more, each with its own window and state.
+ */
+struct vt;
+extern struct vt *vt_main;
+
 /* Prototypes from vt100.c */
+struct vt *vt_create(WIN *win, int type,
+                     void (*out)(const char *, int, void *), void *data);
+void vt_destroy(struct vt *vt);
+void vt_resize(struct vt *vt, WIN *win);
+WIN *vt_window(struct vt *vt);
+void vt_feed(struct vt *vt, const char *buf, size_t len);
+void vt_key(struct vt *vt, int ch);
 void vt_install(void(*)(const char *, int), void (*)(int, int), WIN *);
 void vt_init(int, int, int, int, int, int);
 void vt_pinit(WIN *, int, int);
 void vt_set(int, int, int, int, int, int, int, int, int);
 void vt_out(int, wchar_t);
+void vt_inmap_changed(void);
+struct timeval;
+void vt_rxtime(const struct timeval *tv);
 void vt_send(int ch);
 
 #endif /* ! __MINICOM__SRC__VT100_H__ */
@@ -67,6 +67,7 @@ static const char *CS, *SF, *SR, *VB, *BL;
 static const char *VE, *VI, *KS, *KE;
 static const char *CD, *CL, *IC, *DC;
 static const char *CR, *NL;
+static const char *CUU, *CUD, *CUB, *CUF, *HPA, *VPA, *CUU1, *CUF1;
 #ifdef ST_LINE
 static const char *TS, *FS, *DS;
 #endif
@@ -102,6 +103,56 @@ static int _mv_standout = 0;
 static ELM oldc;
 static int sflag = 0;
 
+/*
+ * Deferred output (see mc_wdefer). While _defer is set nothing is sent
+ * to the terminal; gmap is kept up to date and the columns that changed
+ * in each row are marked in _dirty, to be sent by mc_wframe().
+ *
+ * _pmap is what the terminal shows, as far as we know: rows with
+ * _pvalid set hold what mc_wframe() last sent there. Only the cells
+ * where gmap differs from it are sent again. Scrolls of screen wide
+ * windows are remembered in _scrolls and done on the terminal too, so
+ * the rows they move need not be sent again.
+ */
+struct damage {
+  short x1, x2;			/* Nothing when x1 > x2 */
+};
+
+#define NSCROLLS	16
+
+static int _defer = 0;
+static struct damage *_dirty;
+static int _ndirty;
+static ELM *_pmap;
+static char *_pvalid;
+static struct {
+  short y1, y2;			/* The scroll region */
+  short n;			/* Lines up, or down if negative */
+} _scrolls[NSCROLLS];
+static int _nscrolls;		/* -1 when there were too many */
+static int _defer_pending;
+static int _defer_x, _defer_y;	/* Where the cursor should end up */
+static int _in_frame;		/* Inside mc_wframe(), for the statistics */
+
+/* Where _write() put the last character, so the next one in the same
+ * place on the screen can go without moving the cursor. */
+static int _wx0 = -1, _wy0 = -1, _wc0;
+static char _wattr0, _wcolor0;
+
+/*
+ * Columns x1 to x2 of row y changed while deferred.
+ */
+static void _damage(int y, int x1, int x2)
+{
+  struct damage *d = &_dirty[y];
+
+  if (x1 < d->x1)
+    d->x1 = x1;
+  if (x2 > d->x2)
+    d->x2 = x2;
+  _defer_pending = 1;
+}
+
 int useattr = 1;
 int dirflush = 1;
 int LINES, COLS;
@@ -147,20 +198,29 @@ int debug(char *s, ...)
 void mc_wflush(void)
 {
   int todo, done;
+  unsigned long long t0;
 
   todo = _bufpos - _bufstart;
   _bufpos = _bufstart;
+  if (todo <= 0)
+    return;
 
+  t0 = _in_frame ? 0 : stats_ns();
   while (todo > 0) {
     done = write(1, _bufpos, todo);
     if (done > 0) {
       todo -= done;
       _bufpos += done;
+      mc_stats.scr_bytes += done;
+      mc_stats.scr_writes++;
     }
     if (done < 0 && errno != EINTR)
       break;
   }
   _bufpos = _bufstart;
+  /* mc_wframe() accounts for its own time. */
+  if (!_in_frame)
+    mc_stats.render_ns += stats_ns() - t0;
 }
 
 /*
@@ -168,6 +228,8 @@ void mc_wflush(void)
  */
 static int outchar(int c)
 {
+  if (_defer)
+    return 0;
   *_bufpos++ = c;
   if (_bufpos >= _buffend)
     mc_wflush();
@@ -229,13 +291,121 @@ static void _colson(char color)
   outstr(buf);
 }
 
+/*
+ * Most terminals take ANSI SGR for all of the attributes. Then one
+ * sequence can do what _attroff(), _colson() and _attron() do with up
+ * to eight. _sgrcode[] has the SGR parameter for each attribute bit,
+ * worked out from the termcap strings by _sgrinit().
+ */
+#define SGR_BITS (XA_BLINK | XA_BOLD | XA_REVERSE | XA_STANDOUT | XA_UNDERLINE)
+static char _sgrcode[SGR_BITS + 1][4];
+static int _sgr_ok;
+
+/* The parameter of "\033[<n>m", or -1. */
+static int _sgrnum(const char *s, int zero)
+{
+  int n = 0;
+
+  if (s == NULL || s[0] != '\033' || s[1] != '[')
+    return -1;
+  for (s += 2; *s >= '0' && *s <= '9'; s++)
+    n = n * 10 + *s - '0';
+  if (*s != 'm' || s[1] != 0 || (s[-1] == '[' && !zero))
+    return -1;
+  return n;
+}
+
+static void _sgrinit(void)
+{
+  const char *caps[SGR_BITS + 1];
+  int bit, n;
+
+  _sgr_ok = 0;
+  /* xterm's me also switches back to the normal character set. */
+  if (ME == NULL || (_sgrnum(ME, 1) != 0 &&
+      (AE == NULL || strncmp(ME, AE, strlen(AE)) != 0 ||
+       _sgrnum(ME + strlen(AE), 1) != 0)))
+    return;
+  memset(caps, 0, sizeof(caps));
+  caps[XA_BLINK] = MB;
+  caps[XA_BOLD] = MD;
+  caps[XA_REVERSE] = MR;
+  caps[XA_STANDOUT] = SO;
+  caps[XA_UNDERLINE] = US;
+  for (bit = 1; bit <= SGR_BITS; bit <<= 1) {
+    _sgrcode[bit][0] = 0;
+    if (caps[bit] == NULL)
+      continue;
+    if ((n = _sgrnum(caps[bit], 0)) < 0 || n > 99)
+      return;
+    sprintf(_sgrcode[bit], ";%d", n);
+  }
+  _sgr_ok = 1;
+}
+
+/*
+ * _setattr() in one SGR sequence: only the new attributes when none
+ * go off and the color stays, else a reset and all of them.
+ */
+static void _sgrset(char attr, char color)
+{
+  char par[48], *p;
+  const char *q;
+  int bit, add, full, n;
+
+  full = curattr == -1 || (curattr & ~attr & SGR_BITS) ||
+         (usecolor && color != curcolor);
+  add = full ? attr : attr & ~curattr;
+  p = par;
+  if (full)
+    *p++ = '0';
+  for (bit = 1; bit <= SGR_BITS; bit <<= 1)
+    if (add & bit)
+      for (q = _sgrcode[bit]; *q; q++)
+        *p++ = *q;
+  if (usecolor && full) {
+    n = COLFG(color) + 30;
+    *p++ = ';';
+    *p++ = '0' + n / 10;
+    *p++ = '0' + n % 10;
+    n = COLBG(color) + 40;
+    *p++ = ';';
+    *p++ = '0' + n / 10;
+    *p++ = '0' + n % 10;
+  }
+  *p = 0;
+  if (*par) {
+    outchar('\033');
+    outchar('[');
+    for (p = par[0] == ';' ? par + 1 : par; *p; p++)
+      outchar(*p);
+    outchar('m');
+  }
+  if (curattr == -1 || ((attr ^ curattr) & XA_ALTCHARSET)) {
+    if (attr & XA_ALTCHARSET) {
+      if (AS)
+        outstr(AS);
+    } else if (AE)
+      outstr(AE);
+  }
+  curattr = attr;
+  curcolor = color;
+}
+
 /*
  * Set global attributes, if different.
  */
 static void _setattr(char attr, char color)
 {
-  if (!useattr)
+  if (!useattr || _defer)
+    return;
+
+  if (_sgr_ok) {
+    if (attr != curattr || (usecolor && color != curcolor))
+      _sgrset(attr, color);
+    curcolor = color;
     return;
+  }
 
   if (!usecolor) {
     curcolor = color;
@@ -255,6 +425,194 @@ static void _setattr(char attr, char color)
   curcolor = color;
 }
 
+/*
+ * Cursor motion. A move can be done in many ways; _gotoxy() works out
+ * how many bytes each takes and sends the shortest. The lengths of the
+ * capabilities with a count are remembered for small counts.
+ */
+enum { MV_UP, MV_DO, MV_LE, MV_RI, MV_CH, MV_CV, MV_NCAPS };
+#define MV_INF	10000
+#define MV_KEEP	256
+static const char **_mvcap[MV_NCAPS] = { &CUU, &CUD, &CUB, &CUF, &HPA, &VPA };
+static unsigned char _mvlen[MV_NCAPS][MV_KEEP];
+static int _uplen, _ndlen, _bclen, _crlen, _nllen;
+
+/* Length of a capability with count n. */
+static int _mvcost(int cap, int n)
+{
+  const char *s = *_mvcap[cap];
+  int len;
+
+  if (s == NULL)
+    return MV_INF;
+  if (n < MV_KEEP && _mvlen[cap][n])
+    return _mvlen[cap][n];
+  len = strlen(tgoto(s, n, n));
+  if (n < MV_KEEP && len < 256)
+    _mvlen[cap][n] = len;
+  return len;
+}
+
+static void _mvout(int cap, int n)
+{
+  outstr(tgoto(*_mvcap[cap], n, n));
+}
+
+static int _mvsteps(int len, int n)
+{
+  return len ? n * len : MV_INF;
+}
+
+/*
+ * Can we get from x1 to x2 on row y by sending again what is there?
+ * Only in a frame, where _pmap says what the terminal shows, and
+ * only over plain characters in the current attributes.
+ */
+static int _mvreprint(int y, int x1, int x2)
+{
+  ELM *p;
+
+  if (!_in_frame || _pmap == NULL || y >= LINES || !_pvalid[y])
+    return 0;
+  for (p = _pmap + y * COLS + x1; x1 < x2; x1++, p++) {
+    if (p->value < ' ' || p->value > '~')
+      return 0;
+    if (useattr && (p->attr != curattr ||
+                    (usecolor && p->color != curcolor)))
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Cost of moving from column x1 to x2 on row y; sends it if doit.
+ */
+static int _mvcol(int y, int x1, int x2, int doit)
+{
+  int c, best, how, n = x2 > x1 ? x2 - x1 : x1 - x2;
+
+  if (n == 0)
+    return 0;
+  best = _mvcost(MV_CH, x2);
+  how = 0;
+  if (x2 > x1) {
+    if ((c = _mvcost(MV_RI, n)) < best) {
+      best = c;
+      how = 1;
+    }
+    if ((c = _mvsteps(_ndlen, n)) < best) {
+      best = c;
+      how = 2;
+    }
+    if (n < best && _mvreprint(y, x1, x2)) {
+      best = n;
+      how = 3;
+    }
+  } else {
+    if ((c = _mvcost(MV_LE, n)) < best) {
+      best = c;
+      how = 1;
+    }
+    if ((c = _mvsteps(_bclen, n)) < best) {
+      best = c;
+      how = 2;
+    }
+  }
+  if (!doit || best >= MV_INF)
+    return best;
+  switch (how) {
+    case 0:
+      _mvout(MV_CH, x2);
+      break;
+    case 1:
+      _mvout(x2 > x1 ? MV_RI : MV_LE, n);
+      break;
+    case 2:
+      while (n--)
+        outstr(x2 > x1 ? CUF1 : BC);
+      break;
+    case 3:
+      for (; x1 < x2; x1++)
+        outchar(_pmap[y * COLS + x1].value);
+      break;
+  }
+  return best;
+}
+
+/*
+ * Cost of moving from row y1 to y2; sends it if doit. NL only
+ * from the first column to the first column (see below).
+ */
+static int _mvrow(int y1, int y2, int x, int doit)
+{
+  int c, best, how, n = y2 > y1 ? y2 - y1 : y1 - y2;
+
+  if (n == 0)
+    return 0;
+  best = _mvcost(MV_CV, y2);
+  how = 0;
+  if (y2 > y1) {
+    if ((c = _mvcost(MV_DO, n)) < best) {
+      best = c;
+      how = 1;
+    }
+    if (x == 0 && (c = _mvsteps(_nllen, n)) < best) {
+      best = c;
+      how = 2;
+    }
+  } else {
+    if ((c = _mvcost(MV_UP, n)) < best) {
+      best = c;
+      how = 1;
+    }
+    if ((c = _mvsteps(_uplen, n)) < best) {
+      best = c;
+      how = 2;
+    }
+  }
+  if (!doit || best >= MV_INF)
+    return best;
+  switch (how) {
+    case 0:
+      _mvout(MV_CV, y2);
+      break;
+    case 1:
+      _mvout(y2 > y1 ? MV_DO : MV_UP, n);
+      break;
+    case 2:
+      while (n--)
+        outstr(y2 > y1 ? NL : CUU1);
+      break;
+  }
+  return best;
+}
+
+/*
+ * Move the cursor from (curx, cury) to (x, y) the cheapest way:
+ * absolute, relative, or back to the first column and then relative.
+ */
+static void _move(int x, int y)
+{
+  int abs, rel = MV_INF, cr = MV_INF;
+
+  abs = strlen(tgoto(CM, x, y));
+  if (cury >= 0 && cury < LINES && y < LINES) {
+    if (curx >= 0 && curx < COLS)
+      rel = _mvrow(cury, y, x == 0 && curx == 0, 0) + _mvcol(y, curx, x, 0);
+    if (CR != NULL)
+      cr = _crlen + _mvrow(cury, y, x == 0, 0) + _mvcol(y, 0, x, 0);
+  }
+  if (rel <= cr && rel <= abs) {
+    _mvrow(cury, y, x == 0 && curx == 0, 1);
+    _mvcol(y, curx, x, 1);
+  } else if (cr <= abs) {
+    outstr(CR);
+    _mvrow(cury, y, x == 0, 1);
+    _mvcol(y, 0, x, 1);
+  } else
+    outstr(tgoto(CM, x, y));
+}
+
 /*
  * Goto (x, y) in stdwin
  */
@@ -262,6 +620,13 @@ static void _gotoxy(int x, int y)
 {
   int oldattr = -1;
 
+  if (_defer) {
+    _defer_x = x;
+    _defer_y = y;
+    _defer_pending = 1;
+    return;
+  }
+
 #ifdef ST_LINE
   int tmp;
 
@@ -312,19 +677,8 @@ static void _gotoxy(int x, int y)
     oldattr = curattr;
     _setattr(XA_NORMAL, curcolor);
   }
-  if (CR != NULL && y == cury && x == 0)
-    outstr(CR);
-#if 0 /* Hmm, sometimes NL only works in the first column */
-  else if (NL != NULL && x == curx && y == cury + 1)
-    outstr(NL);
-#else
-  else if (NL != NULL && x == 0 && x == curx && y == cury + 1)
-    outstr(NL);
-#endif
-  else if (BC != NULL && y == cury && x == curx - 1)
-    outstr(BC);
-  else
-    outstr(tgoto(CM, x, y));
+  /* Hmm, sometimes NL only works in the first column, _move() knows. */
+  _move(x, y);
   curx = x;
   cury = y;
   if (oldattr != -1)
@@ -340,6 +694,20 @@ static void _gotoxy(int x, int y)
 static void _write(wchar_t c, int doit, int x, int y, char attr, char color)
 {
   ELM *e;
+  int wide = utf8_wide(c);
+
+  /* Deferred: only update the memory image and remember the row. */
+  if (_defer && y >= 0 && y < _ndirty) {
+    /* A wide character and its right half go together. */
+    _damage(y, c == WIDE_PAD && x > 0 ? x - 1 : x, x + wide);
+    if (doit != 0 && x < COLS && c != WIDE_PAD) {
+      _defer_x = x + 1 + wide < COLS ? x + 1 + wide : COLS - 1;
+      _defer_y = y;
+    }
+    if (doit < 0)
+      return;
+    doit = 0;
+  }
 
   /* If the terminal has automatic margins, we can't write to the
    * last line, last character. After scrolling, this "invisible"
@@ -358,14 +726,14 @@ static void _write(wchar_t c, int doit, int x, int y, char attr, char color)
   if (x < COLS && y < LINES)
 #endif
   {
-    if (doit != 0) {
-      static int x0 = -1, y0 = -1, c0 = 0;
-      static char attr0, color0;
-      if (x!=x0+1 || y!=y0 || attr!=attr0 || color!=color0 || !(c0&128)) {
+    /* The right half of a wide character is drawn with the left. */
+    if (doit != 0 && c != WIDE_PAD) {
+      if (x != _wx0 + 1 || y != _wy0 || attr != _wattr0 || color != _wcolor0
+          || !(_wc0 & 128)) {
         _gotoxy(x, y);
         _setattr(attr, color);
       }
-      x0 = x; y0 = y; attr0 = attr; color0 = color; c0 = c;
+      _wx0 = x; _wy0 = y; _wattr0 = attr; _wcolor0 = color; _wc0 = c;
       if ((attr & XA_ALTCHARSET) != 0)
         outchar((char)c);
       else {
@@ -377,7 +745,7 @@ static void _write(wchar_t c, int doit, int x, int y, char attr, char color)
           outchar(buf[i]);
       }
 
-      curx++;
+      curx += 1 + wide;
     }
     if (doit >= 0) {
       e = &gmap[x + y * COLS];
@@ -388,6 +756,67 @@ static void _write(wchar_t c, int doit, int x, int y, char attr, char color)
   }
 }
 
+/*
+ * Write n plain ASCII characters in stdwin from x, y on, all on one
+ * line, like n calls of _write() but with one cursor motion and one
+ * copy into the output buffer.
+ */
+static void _writen(const char *s, int n, int doit, int x, int y,
+                    char attr, char color)
+{
+  ELM *e;
+  int i, k;
+
+#ifdef ST_LINE
+  if (y < 0 || y > LINES || x < 0 || x >= COLS)
+#else
+  if (y < 0 || y >= LINES || x < 0 || x >= COLS)
+#endif
+    return;
+  if (n > COLS - x)
+    n = COLS - x;
+
+  /* The last character on the screen is special, see _write(). */
+  if (_has_am && y >= LINES - 1 && x + n >= COLS) {
+    if (n > 1)
+      _writen(s, n - 1, doit, x, y, attr, color);
+    _write((unsigned char)s[n - 1], doit, COLS - 1, y, attr, color);
+    return;
+  }
+
+  if (_defer && y < _ndirty) {
+    _damage(y, x, x + n - 1);
+    if (doit != 0) {
+      _defer_x = x + n < COLS ? x + n : COLS - 1;
+      _defer_y = y;
+    }
+    doit = 0;
+  }
+
+  e = &gmap[x + y * COLS];
+  for (i = 0; i < n; i++, e++) {
+    e->value = (unsigned char)s[i];
+    e->attr = attr;
+    e->color = color;
+  }
+
+  if (doit == 0)
+    return;
+  _gotoxy(x, y);
+  _setattr(attr, color);
+  for (i = 0; i < n; i += k) {
+    k = _buffend - _bufpos;
+    if (k > n - i)
+      k = n - i;
+    memcpy(_bufpos, s + i, k);
+    _bufpos += k;
+    if (_bufpos >= _buffend)
+      mc_wflush();
+  }
+  curx += n;
+  _wx0 = -1;
+}
+
 /*
  * Set cursor type.
  */
@@ -402,6 +831,230 @@ static void _cursor(int type)
 }
 
 
+/*
+ * Start (on = 1) or stop (on = 0) deferring screen output. While
+ * deferred, the windows only update the screen image in memory and
+ * mc_wframe() sends whatever changed in one go. This lets a fast
+ * stream of data be drawn at a fixed frame rate instead of showing
+ * every intermediate state. Stopping sends the last frame.
+ */
+void mc_wdefer(int on)
+{
+  int y;
+
+  if (on && !_defer) {
+    free(_dirty);
+    free(_pmap);
+    free(_pvalid);
+    _ndirty = LINES + 1;
+    _dirty = malloc(_ndirty * sizeof(struct damage));
+    _pmap = malloc(_ndirty * COLS * sizeof(ELM));
+    /* We don't know yet what the terminal shows. */
+    _pvalid = calloc(_ndirty, 1);
+    if (_dirty == NULL || _pmap == NULL || _pvalid == NULL) {
+      free(_dirty);
+      free(_pmap);
+      free(_pvalid);
+      _dirty = NULL;
+      _pmap = NULL;
+      _pvalid = NULL;
+      _ndirty = 0;
+      return;
+    }
+    for (y = 0; y < _ndirty; y++) {
+      _dirty[y].x1 = COLS;
+      _dirty[y].x2 = -1;
+    }
+    _nscrolls = 0;
+    mc_wflush();
+    _defer_x = curx;
+    _defer_y = cury;
+    _defer_pending = 0;
+    _defer = 1;
+  } else if (!on && _defer) {
+    mc_wframe();
+    _defer = 0;
+  }
+}
+
+/*
+ * Is there something for mc_wframe() to send?
+ */
+int mc_wpending(void)
+{
+  return _defer && _defer_pending;
+}
+
+/*
+ * A screen wide window scrolled n lines (up, or down if negative)
+ * within y1 to y2 while deferred.
+ */
+static void _scroll_note(int y1, int y2, int n)
+{
+  if (_nscrolls < 0)
+    return;
+  if (_nscrolls > 0 && _scrolls[_nscrolls - 1].y1 == y1 &&
+      _scrolls[_nscrolls - 1].y2 == y2 &&
+      (_scrolls[_nscrolls - 1].n > 0) == (n > 0)) {
+    _scrolls[_nscrolls - 1].n += n;
+    return;
+  }
+  if (_nscrolls == NSCROLLS) {
+    /* Just send the rows, then. */
+    _nscrolls = -1;
+    return;
+  }
+  _scrolls[_nscrolls].y1 = y1;
+  _scrolls[_nscrolls].y2 = y2;
+  _scrolls[_nscrolls].n = n;
+  _nscrolls++;
+}
+
+/*
+ * Do the scrolls of the last frame on the terminal, and on _pmap.
+ * Any of them can be left out: the rows they moved are all in _dirty.
+ */
+static void _scroll_out(void)
+{
+  int i, j, k, n, y1, y2, full;
+
+  for (i = 0; i < _nscrolls; i++) {
+    y1 = _scrolls[i].y1;
+    y2 = _scrolls[i].y2;
+    n = _scrolls[i].n;
+    k = n < 0 ? -n : n;
+    full = y1 == 0 && y2 == LINES - 1;
+    if (k == 0 || k > y2 - y1)
+      continue;
+
+    if (full && SF != NULL && n > 0) {
+      _gotoxy(0, y2);
+      while (k--)
+        outstr(SF);
+    } else if (CS != NULL && SF != NULL && SR != NULL) {
+      if (!full) {
+        outstr(tgoto(CS, y2, y1));
+        curx = cury = -1;
+      }
+      _gotoxy(0, n > 0 ? y2 : y1);
+      while (k--)
+        outstr(n > 0 ? SF : SR);
+      if (!full) {
+        outstr(tgoto(CS, LINES - 1, 0));
+        curx = cury = -1;
+      }
+    } else if (Dl != NULL && Al != NULL) {
+      _gotoxy(0, n > 0 ? y1 : y2 - k + 1);
+      for (j = 0; j < k; j++)
+        outstr(Dl);
+      _gotoxy(0, n > 0 ? y2 - k + 1 : y1);
+      while (k--)
+        outstr(Al);
+    } else
+      continue;
+
+    k = n < 0 ? -n : n;
+    if (n > 0) {
+      memmove(_pmap + y1 * COLS, _pmap + (y1 + k) * COLS,
+              (y2 - y1 + 1 - k) * COLS * sizeof(ELM));
+      memmove(_pvalid + y1, _pvalid + y1 + k, y2 - y1 + 1 - k);
+      memset(_pvalid + y2 - k + 1, 0, k);
+    } else {
+      memmove(_pmap + (y1 + k) * COLS, _pmap + y1 * COLS,
+              (y2 - y1 + 1 - k) * COLS * sizeof(ELM));
+      memmove(_pvalid + y1 + k, _pvalid + y1, y2 - y1 + 1 - k);
+      memset(_pvalid + y1, 0, k);
+    }
+  }
+  _nscrolls = 0;
+}
+
+#define SAME(a, b) \
+  ((a)->value == (b)->value && (a)->attr == (b)->attr && \
+   (a)->color == (b)->color)
+
+/*
+ * Send the cells of row y from x1 to x2 that are not on the terminal
+ * yet. A run of less than four cells that are right goes along with
+ * the cells around it, that is cheaper than moving the cursor.
+ */
+static void _row_out(int y, int x1, int x2)
+{
+  ELM *e = gmap + y * COLS;
+  ELM *p = _pmap + y * COLS;
+  int x, i, last;
+
+  if (!_pvalid[y]) {
+    x1 = 0;
+    x2 = COLS - 1;
+  }
+  for (x = x1; x <= x2; x++) {
+    if (_pvalid[y] && SAME(e + x, p + x))
+      continue;
+    if (e[x].value == WIDE_PAD && x > 0)
+      x--;
+    for (last = x, i = x + 1; i <= x2 && i - last <= 4; i++)
+      if (!_pvalid[y] || !SAME(e + i, p + i))
+        last = i;
+    for (; x <= last; x++) {
+      _write(e[x].value, -1, x, y, e[x].attr, e[x].color);
+      p[x] = e[x];
+    }
+    x = last;
+  }
+  _pvalid[y] = 1;
+
+  /* See _write(): the last cell may not be shown yet. */
+  if (_has_am && y == LINES - 1)
+    p[COLS - 1].value = WIDE_PAD + 1;
+}
+
+/*
+ * Send what changed since the last frame to the terminal.
+ */
+void mc_wframe(void)
+{
+  int y, ocurs;
+  struct damage *d;
+  unsigned long long t0;
+
+  if (!_defer || !_defer_pending)
+    return;
+  t0 = stats_ns();
+  _in_frame = 1;
+  _defer = 0;
+  _defer_pending = 0;
+
+  /* The terminal state is unknown after what we skipped. */
+  ocurs = _curstype;
+  curx = cury = -1;
+  _cursor(CNONE);
+  _scroll_out();
+  for (y = 0; y < _ndirty; y++) {
+    d = &_dirty[y];
+    if (d->x1 > d->x2)
+      continue;
+#ifdef ST_LINE
+    if (y >= LINES && !use_status)
+      continue;
+#else
+    if (y >= LINES)
+      break;
+#endif
+    _row_out(y, d->x1, d->x2 < COLS ? d->x2 : COLS - 1);
+    d->x1 = COLS;
+    d->x2 = -1;
+  }
+  _gotoxy(_defer_x, _defer_y);
+  _cursor(ocurs);
+  mc_wflush();
+  _defer = 1;
+  _in_frame = 0;
+  mc_stats.frames++;
+  mc_stats.render_ns += stats_ns() - t0;
+}
+
+
 /* ==== High level routines ==== */
 
 
@@ -537,25 +1190,16 @@ WIN *mc_wopen(int x1, int y1, int x2, int y2, int border, int attr,
 
   /* Do we want history? */
   w->histline = w->histlines = 0;
+  w->histcount = 0;
   w->histbuf = NULL;
   if (histlines) {
-    /* Reserve some memory. */
-    bytes = w->xs * histlines * sizeof(ELM);
-    if ((w->histbuf = malloc(bytes)) == NULL) {
+    /* Lines are blank until they are put there. */
+    if ((w->histbuf = hist_new(w->xs, histlines, attr, color)) == NULL) {
       free(w->map);
       free(w);
       return NULL;
     }
     w->histlines = histlines;
-
-    /* Clear the history buf. */
-    e = w->histbuf;
-    for (y = 0; y < w->xs * histlines; y++) {
-      e->value = ' ';
-      e->attr = attr;
-      e->color = color;
-      e++;
-    }
   }
 
   /* And draw the window */
@@ -630,12 +1274,57 @@ void mc_wclose(WIN *win, int replace)
     _setattr(win->o_attr, win->o_color);
   }
   free(win->map);
-  if (win->histbuf)
-    free(win->histbuf);
+  hist_free(win->histbuf);
   free(win);	/* 1.1.98 dickey@clark.net  */
   mc_wflush();
 }
 
+/*
+ * Window under, which w is on top of, has been written to with
+ * direct off: take what is now under w from the screen image again,
+ * so that closing w shows it.
+ */
+void mc_wresave(WIN *w, const WIN *under)
+{
+  int offs = (w->border != BNONE);
+  int x1 = w->x1 - offs, x2 = w->x2 + offs;
+  int y1 = w->y1 - offs, y2 = w->y2 + offs;
+  int x, y;
+
+  for (y = y1 > under->y1 ? y1 : under->y1;
+       y <= y2 && y <= under->y2; y++)
+    for (x = x1 > under->x1 ? x1 : under->x1;
+         x <= x2 && x <= under->x2; x++)
+      w->map[(y - y1) * (x2 - x1 + 1) + x - x1] = gmap[y * COLS + x];
+}
+
+/*
+ * Write what window w shows to fp, for comparing screens in the tests
+ * (w must be on top, its cells are taken from the screen image):
+ * the cursor and scrolling region, then for every line its text and
+ * the attribute and color from every column where they change.
+ */
+void mc_wdump(WIN *w, FILE *fp)
+{
+  const ELM *e;
+  int x, y, len;
+  const char *text;
+
+  fprintf(fp, "cursor %d %d region %d %d attr %02x color %02x\n",
+          w->cury, w->curx, w->sy1, w->sy2,
+          (unsigned char)w->attr, (unsigned char)w->color);
+  for (y = 0; y < w->ys; y++) {
+    e = gmap + (w->y1 + y) * COLS + w->x1;
+    text = elm_text(e, w->xs, &len);
+    fprintf(fp, "%2d|%s\n  ", y, text);
+    for (x = 0; x < w->xs; x++)
+      if (x == 0 || e[x].attr != e[x - 1].attr || e[x].color != e[x - 1].color)
+        fprintf(fp, " %d:%02x/%02x", x, (unsigned char)e[x].attr,
+                (unsigned char)e[x].color);
+    fputc('\n', fp);
+  }
+}
+
 static int oldx, oldy;
 static int ocursor;
 
@@ -767,7 +1456,7 @@ static int _wclreol(WIN *w)
  */
 void mc_wscroll(WIN *win, int dir)
 {
-  ELM *e, *f;
+  ELM *e;
   char *src, *dst;
   int x, y;
   int doit = 1;
@@ -860,11 +1549,9 @@ void mc_wscroll(WIN *win, int dir)
     /* Calculate screen buffer */
     e = gmap + win->y1 * COLS + win->x1;
 
-    /* Calculate history buffer */
-    f = win->histbuf + (win->xs * win->histline);
-
     /* Copy line from screen to history buffer */
-    memcpy((char *)f, (char *)e, win->xs * sizeof(ELM));
+    hist_put(win->histbuf, win->histline, e);
+    win->histcount++;
 
     /* Position the next line in the history buffer */
     win->histline++;
@@ -878,14 +1565,19 @@ void mc_wscroll(WIN *win, int dir)
   if (phys_scr) {
     len = (win->sy2 - win->sy1) * win->xs * sizeof(ELM);
     if (dir == S_UP)  {
-      dst = (char *)&gmap[0];				/* First line */
-      src = (char *)&gmap[win->xs];			/* Second line */
+      dst = (char *)&gmap[win->sy1 * COLS];		/* First line */
+      src = (char *)&gmap[(win->sy1 + 1) * COLS];	/* Second line */
       win->cury = win->sy2 - win->y1;
     } else {
-      src = (char *)&gmap[0];				/* First line */
-      dst = (char *)&gmap[win->xs];			/* Second line */
+      src = (char *)&gmap[win->sy1 * COLS];		/* First line */
+      dst = (char *)&gmap[(win->sy1 + 1) * COLS];	/* Second line */
       win->cury = win->sy1 - win->y1;
     }
+    if (_defer) {
+      for (y = win->sy1; y <= win->sy2 && y < _ndirty; y++)
+        _damage(y, 0, COLS - 1);
+      _scroll_note(win->sy1, win->sy2, dir == S_UP ? 1 : -1);
+    }
     /* memmove copies len bytes from src to dst, even if the
      * objects overlap.
      */
@@ -968,6 +1660,7 @@ void mc_wlocate(WIN *win, int x, int y)
 void mc_wputc(WIN *win, wchar_t c)
 {
   int mv = 0;
+  int wide;
 
   switch(c) {
     case '\r':
@@ -993,8 +1686,10 @@ void mc_wputc(WIN *win, wchar_t c)
         win->curx = 0;
       /* FALLTHRU */
     default:
+      /* A double width character takes this cell and the next. */
+      wide = c != '\n' && win->xs > 1 && utf8_wide(c);
       /* See if we need to scroll/move. (vt100 behaviour!) */
-      if (c == '\n' || (win->curx >= win->xs && win->wrap)) {
+      if (c == '\n' || (win->curx + wide >= win->xs && win->wrap)) {
         if (c != '\n')
           win->curx = 0;
         win->cury++;
@@ -1010,10 +1705,17 @@ void mc_wputc(WIN *win, wchar_t c)
       }
       /* Now write the character. */
       if (c != '\n') {
-	if (!win->wrap && win->curx >= win->xs)
+	if (!win->wrap && win->curx + wide >= win->xs) {
 	  c = '>';
+	  wide = 0;
+	}
         _write(c, win->direct, win->curx + win->x1,
                win->cury + win->y1, win->attr, win->color);
+        if (wide) {
+          win->curx++;
+          _write(WIDE_PAD, win->direct, win->curx + win->x1,
+                 win->cury + win->y1, win->attr, win->color);
+        }
         if (++win->curx >= win->xs && !win->wrap) {
           win->curx--;
           curx = 0; /* Force to move */
@@ -1029,6 +1731,52 @@ void mc_wputc(WIN *win, wchar_t c)
     mc_wflush();
 }
 
+/*
+ * Print n characters of plain ASCII text (' ' to '~') in a window.
+ * Does what n calls of mc_wputc() would do, a line at a time.
+ */
+void mc_wputn(WIN *win, const char *s, int n)
+{
+  int k;
+
+  if (!win->wrap) {
+    /* Clipped at the margin; not worth a fast path. */
+    _intern = 1;
+    while (n > 0) {
+      mc_wputc(win, (unsigned char)*s++);
+      n--;
+    }
+    _intern = 0;
+  }
+
+  while (n > 0) {
+    if (win->curx >= win->xs) {
+      /* Wrap, as mc_wputc() does. */
+      win->curx = 0;
+      win->cury++;
+      if (win->cury == win->sy2 - win->y1 + 1) {
+        if (win->doscroll)
+          mc_wscroll(win, S_UP);
+        else
+          win->cury = win->sy1 - win->y1;
+      }
+      if (win->cury >= win->ys)
+        win->cury = win->ys - 1;
+    }
+    k = win->xs - win->curx;
+    if (k > n)
+      k = n;
+    _writen(s, k, win->direct, win->curx + win->x1, win->cury + win->y1,
+            win->attr, win->color);
+    win->curx += k;
+    s += k;
+    n -= k;
+  }
+
+  if (win->direct && dirflush && !_intern)
+    mc_wflush();
+}
+
 /* Draw one line in a window */
 void mc_wdrawelm(WIN *w, int y, ELM *e)
 {
@@ -1053,9 +1801,12 @@ void mc_wdrawelm_var(WIN *w, ELM *e, wchar_t *buf)
 
   /* MARK updated 02/17/94 - Fixes bug, to do all 80 cols, not 79 cols */
   for (x = w->x1; x <= w->x2; x++) {
-    buf[c++] = e->value;
+    if (e->value != WIDE_PAD)
+      buf[c++] = e->value;
     e++;
   }
+  while (c < w->xs)
+    buf[c++] = ' ';
 }
 
 /*
@@ -1126,6 +1877,10 @@ int mc_wprintf(WIN *win, const char *fmt, ...)
  */
 void mc_wbell(void)
 {
+  int odefer = _defer;
+
+  /* The bell can not wait for the next frame. */
+  _defer = 0;
   if (BL != NULL)
     outstr(BL);
   else if (VB != NULL)
@@ -1133,6 +1888,7 @@ void mc_wbell(void)
   else
     outchar('\007');
   mc_wflush();
+  _defer = odefer;
 }
 
 /*
@@ -1435,7 +2191,7 @@ void mc_winclr(WIN *w)
 {
   int y;
   int olddir = w->direct;
-  ELM *e, *f;
+  ELM *e;
   int i;
   int m;
 
@@ -1464,8 +2220,8 @@ void mc_winclr(WIN *w)
       e = gmap + y * COLS + w->x1;
 
       /* Now copy this line. */
-      f = w->histbuf + (w->xs * w->histline); /* History buffer */
-      memcpy((char *)f, (char *)e, w->xs * sizeof(ELM));
+      hist_put(w->histbuf, w->histline, e);
+      w->histcount++;
       w->histline++;
       if (w->histline >= w->histlines)
         w->histline = 0;
@@ -1954,6 +2710,14 @@ int win_init(int fg, int bg, int attr)
   BC = tgetstr("bc", &_tptr);
   CR = tgetstr("cr", &_tptr);
   NL = tgetstr("nl", &_tptr);
+  CUU = tgetstr("UP", &_tptr);
+  CUD = tgetstr("DO", &_tptr);
+  CUB = tgetstr("LE", &_tptr);
+  CUF = tgetstr("RI", &_tptr);
+  HPA = tgetstr("ch", &_tptr);
+  VPA = tgetstr("cv", &_tptr);
+  CUU1 = tgetstr("up", &_tptr);
+  CUF1 = tgetstr("nd", &_tptr);
   AC = tgetstr("ac", &_tptr);
   EA = tgetstr("eA", &_tptr);
 #ifdef ST_LINE
@@ -2015,6 +2779,12 @@ int win_init(int fg, int bg, int attr)
   }
   else
     BC = NULL;
+  _uplen = CUU1 ? strlen(CUU1) : 0;
+  _ndlen = CUF1 ? strlen(CUF1) : 0;
+  _bclen = BC ? strlen(BC) : 0;
+  _crlen = strlen(CR);
+  _nllen = strlen(NL);
+  _sgrinit();
 
   /* Special IBM box-drawing characters */
   D_UL  = 201;
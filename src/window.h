@@ -21,6 +21,7 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
 
 /*
  * One character is contained in a "ELM"
@@ -31,6 +32,9 @@ typedef struct _elm {
   char color;
 } ELM;
 
+/* The value of the cell right of a double width character. */
+#define WIDE_PAD	0x110000
+
 /*
  * Control struct of a window
  */
@@ -53,9 +57,10 @@ typedef struct _win {
   char o_attr;
   char o_color;		/* Position & attributes before window was opened */
   ELM *map;		/* Map of contents */
-  ELM *histbuf;		/* History buffer. */
+  struct hist *histbuf;	/* History buffer, see history.c */
   int histlines;	/* How many lines we keep in the history buffer */
   int histline;		/* Current line in the history buffer. */
+  unsigned long histcount;	/* Lines put in the history so far */
 } WIN;
 
 /*
@@ -141,11 +146,17 @@ extern const char *J_col[]; /* Color's names */
  */
 
 int wxgetch(void);
+void wxgetch_bg(int fd, int ms, int (*func)(int ready));
 
 void mc_wflush(void);
+void mc_wdefer(int on);
+int  mc_wpending(void);
+void mc_wframe(void);
 WIN *mc_wopen(int x1, int y1, int x2, int y2, int border,
            int attr, int fg, int bg, int direct, int hl, int rel);
 void mc_wclose(WIN *win, int replace);
+void mc_wresave(WIN *w, const WIN *under);
+void mc_wdump(WIN *w, FILE *fp);
 void mc_wleave(void);
 void mc_wreturn(void);
 void mc_wresize(WIN *w, int x, int y);
@@ -153,6 +164,7 @@ void mc_wredraw(WIN *w, int newdirect);
 void mc_wscroll(WIN *win, int dir);
 void mc_wlocate(WIN *win, int x, int y);
 void mc_wputc(WIN *win, wchar_t c);
+void mc_wputn(WIN *win, const char *s, int n);
 void mc_wdrawelm(WIN *win, int y, ELM *e);
 void mc_wputs(WIN *win, const char *s);
 int mc_wprintf(WIN *, const char *, ...)
@@ -184,6 +196,18 @@ int win_init(char *term, int lines);
 #else
 int win_init(int fg, int bg, int attr);
 #endif
+/* history.c */
+struct hist *hist_new(int xs, int lines, int attr, int color);
+void hist_free(struct hist *h);
+void hist_put(struct hist *h, int n, const ELM *e);
+ELM *hist_get(struct hist *h, int n);
+int hist_spill(struct hist *h, const char *file);
+int hist_spilled(struct hist *h);
+ELM *hist_old(struct hist *h, int no);
+const char *hist_text(struct hist *h, int n, int *len);
+const char *hist_old_text(struct hist *h, int no, int *len);
+const char *elm_text(const ELM *e, int xs, int *len);
+extern const char *hist_file;
 /* fmg 8/20/97: both needed by history search section */
 void mc_wdrawelm_inverse( WIN *w, int y, ELM *e);
 void mc_wdrawelm_var(WIN *w, ELM *e, wchar_t *buf);
@@ -231,6 +255,7 @@ void mc_clear_window_simple(WIN *w);
 #define K_PGDN		274
 #define K_INS		275
 #define K_DEL		276
+#define K_PORT		279	/* Not a key, see wxgetch_bg() */
 
 #define NUM_KEYS	23
 #define KEY_OFFS	256
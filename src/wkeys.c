@@ -44,6 +44,11 @@ static int gotalrm;
 int pendingkeys = 0;
 int io_pending = 0;
 
+/* Called while we wait for a key, see wxgetch_bg(). */
+static int bg_fd = -1;
+static int bg_ms;
+static int (*bg_func)(int ready);
+
 #ifndef NCURSES_CONST
 #define NCURSES_CONST
 #endif
@@ -157,6 +162,45 @@ static void _initkeys(void)
 #endif
 }
 
+/*
+ * While wxgetch() waits for a key, call func when fd has data, with
+ * ready set, and every ms milliseconds if ms is not 0. If func
+ * returns non-zero, wxgetch() returns K_PORT. An fd of -1 stops this.
+ */
+void wxgetch_bg(int fd, int ms, int (*func)(int ready))
+{
+  bg_fd = fd;
+  bg_ms = ms;
+  bg_func = func;
+}
+
+/*
+ * Wait until there is a key, calling bg_func in the meantime.
+ * Returns 1 if bg_func wants wxgetch() to return K_PORT.
+ */
+static int bg_wait(void)
+{
+  struct timeval timeout;
+  fd_set readfds;
+  int n;
+
+  while (bg_fd >= 0) {
+    FD_ZERO(&readfds);
+    FD_SET(0, &readfds);
+    FD_SET(bg_fd, &readfds);
+    timeout.tv_sec = bg_ms / 1000;
+    timeout.tv_usec = bg_ms % 1000 * 1000;
+    n = select(bg_fd + 1, &readfds, NULL, NULL, bg_ms ? &timeout : NULL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 || FD_ISSET(0, &readfds))
+      break;
+    if (bg_func(n > 0))
+      return 1;
+  }
+  return 0;
+}
+
 /*
  * Read a character from the keyboard.
  * Handle special characters too!
@@ -196,6 +240,14 @@ int wxgetch(void)
   gotalrm = 0;
   pendingkeys = 0;
 
+  /* Nothing typed ahead: see to the port while we wait. */
+#if KEY_KLUDGE
+  if (bg_fd >= 0 && keys_in_buf == 0 && bg_wait())
+#else
+  if (bg_fd >= 0 && bg_wait())
+#endif
+    return K_PORT;
+
   for (len = 1; len < 8 && match; len++) {
 #if KEY_KLUDGE
     if (len > 1 && keys_in_buf == 0)
@@ -0,0 +1,230 @@
+/*
+ * histcheck.c	Check that the history gives back the lines it was given.
+ *
+ *		Lines of cells go in with hist_put() and must come back
+ *		the same from hist_get(), and as the right text from
+ *		hist_text(): characters of every UTF-8 length, raw bytes
+ *		from the port, the right halves of wide characters (WIDE_PAD),
+ *		runs of attributes and lengths that take more than one
+ *		byte in a record. The history file must give back the
+ *		lines that left the memory.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "port.h"
+#include "minicom.h"
+
+#define SPILL_FILE	"histcheck.tmp"
+
+static int fail;
+
+static void check(int ok, const char *what)
+{
+  if (!ok) {
+    printf("histcheck: %s\n", what);
+    fail = 1;
+  }
+}
+
+/* A line of xs spaces in attr and color. */
+static void blank(ELM *e, int xs, int attr, int color)
+{
+  int x;
+
+  for (x = 0; x < xs; x++) {
+    e[x].value = ' ';
+    e[x].attr = attr;
+    e[x].color = color;
+  }
+}
+
+static int same(const ELM *a, const ELM *b, int xs)
+{
+  int x;
+
+  for (x = 0; x < xs; x++)
+    if (a[x].value != b[x].value || a[x].attr != b[x].attr ||
+        a[x].color != b[x].color)
+      return 0;
+  return 1;
+}
+
+static int text_is(const char *text, int len, const char *want)
+{
+  return len == (int)strlen(want) && memcmp(text, want, len) == 0;
+}
+
+/* Characters of every kind, in a few attributes. */
+static void odd_line(ELM *e, int xs)
+{
+  static const wchar_t v[] = {
+    'a', 0x7f, 0xe9, 0x7ff, 0x800, 0x20ac, 0xffff, 0x10000, 0x1f600,
+    0x10ffff, 0x4e2d, WIDE_PAD, (char)0xc3, (char)0x80, (char)0xff,
+    WIDE_PAD + 1, 'z'
+  };
+  int x;
+
+  blank(e, xs, 0, 0x70);
+  for (x = 0; x < (int)(sizeof(v) / sizeof(v[0])); x++) {
+    e[x].value = v[x];
+    e[x].attr = x / 4;
+    e[x].color = 0x70 + x % 3;
+  }
+}
+
+static void cells(void)
+{
+  struct hist *h;
+  ELM e[40];
+  const char *t;
+  int len;
+
+  h = hist_new(40, 4, 0, 0x70);
+  check(h != NULL, "hist_new failed");
+  if (h == NULL)
+    return;
+
+  odd_line(e, 40);
+  hist_put(h, 0, e);
+  check(same(hist_get(h, 0), e, 40), "odd characters do not come back");
+  t = hist_text(h, 0, &len);
+  check(text_is(t, len, "a\177\303\251\337\277\340\240\200\342\202\254"
+                "\357\277\277\360\220\200\200\360\237\230\200\364\217\277\277"
+                "\344\270\255????z"),
+        "wrong text for odd characters");
+
+  /* Spaces in the middle stay, those at the end go. */
+  blank(e, 40, 0, 0x70);
+  e[0].value = 'x';
+  e[5].value = 'y';
+  e[39].attr = 1;
+  hist_put(h, 1, e);
+  check(same(hist_get(h, 1), e, 40), "spaces do not come back");
+  t = hist_text(h, 1, &len);
+  check(text_is(t, len, "x    y"), "wrong text for spaces");
+
+  /* A blank line needs no record, but comes back all the same. */
+  blank(e, 40, 0, 0x70);
+  hist_put(h, 2, e);
+  check(same(hist_get(h, 2), e, 40), "a blank line does not come back");
+  t = hist_text(h, 2, &len);
+  check(len == 0 && *t == 0, "a blank line has text");
+
+  /* Blank, but not in the blank attributes. */
+  blank(e, 40, 2, 0x17);
+  hist_put(h, 3, e);
+  check(same(hist_get(h, 3), e, 40),
+        "a blank coloured line does not come back");
+
+  /* A slot used again has the new line. */
+  odd_line(e, 40);
+  e[0].value = 'b';
+  hist_put(h, 0, e);
+  check(same(hist_get(h, 0), e, 40), "a slot used again is wrong");
+  hist_free(h);
+}
+
+/*
+ * A line so wide that the length, the runs and the character count
+ * need two and three bytes in the record.
+ */
+static void wide(void)
+{
+  enum { XS = 20000 };
+  static ELM e[XS];
+  struct hist *h;
+  const char *t;
+  int x, len;
+
+  h = hist_new(XS, 2, 0, 0);
+  check(h != NULL, "hist_new failed for a wide line");
+  if (h == NULL)
+    return;
+  blank(e, XS, 0, 0);
+  for (x = 0; x < 17000; x++)
+    e[x].value = 'a' + x % 26;
+  for (x = 127; x < 127 + 16384; x++)
+    e[x].attr = 1;
+  e[XS - 1].color = 5;
+  hist_put(h, 0, e);
+  check(same(hist_get(h, 0), e, XS), "a wide line does not come back");
+  t = hist_text(h, 0, &len);
+  check(len == 17000 && t[16999] == 'a' + 16999 % 26,
+        "wrong text for a wide line");
+  hist_free(h);
+}
+
+/*
+ * Many lines through a small history, with a history file: those
+ * still in memory and those only in the file must be right.
+ */
+static void spill(void)
+{
+  enum { XS = 80, LINES = 50, TOTAL = 5000 };
+  struct hist *h;
+  ELM e[XS];
+  const char *t;
+  char want[32];
+  int i, len, ok;
+
+  h = hist_new(XS, LINES, 0, 0x70);
+  check(h != NULL, "hist_new failed for the history file");
+  if (h == NULL)
+    return;
+  if (hist_spill(h, SPILL_FILE) < 0) {
+    check(0, "can't make the history file");
+    hist_free(h);
+    return;
+  }
+  for (i = 0; i < TOTAL; i++) {
+    odd_line(e, XS);
+    snprintf(want, sizeof(want), "%d", i);
+    for (len = 0; want[len]; len++)
+      e[20 + len].value = want[len];
+    e[XS - 1].attr = i % 7;
+    hist_put(h, i % LINES, e);
+  }
+  check(hist_spilled(h) == TOTAL - LINES, "lines missing in the history file");
+
+  ok = 1;
+  for (i = 0; i < TOTAL; i++) {
+    odd_line(e, XS);
+    snprintf(want, sizeof(want), "%d", i);
+    for (len = 0; want[len]; len++)
+      e[20 + len].value = want[len];
+    e[XS - 1].attr = i % 7;
+    if (i < TOTAL - LINES) {
+      ok &= same(hist_old(h, i), e, XS);
+      t = hist_old_text(h, i, &len);
+    } else {
+      ok &= same(hist_get(h, i % LINES), e, XS);
+      t = hist_text(h, i % LINES, &len);
+    }
+    /* The number is the last thing on the line. */
+    ok &= len > (int)strlen(want) &&
+          strcmp(t + len - strlen(want), want) == 0;
+  }
+  check(ok, "lines come back wrong from the history file");
+  hist_free(h);
+  unlink(SPILL_FILE);
+}
+
+int main(void)
+{
+  cells();
+  wide();
+  spill();
+  return fail;
+}
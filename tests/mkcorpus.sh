@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# mkcorpus.sh	Write the captures the benchmarks play: what a port
+#		might send at boot, during a coloured build, from a
+#		full screen program and from a hex dump, and text with
+#		only escape sequences or none. The same every time for
+#		a given awk.
+#
+#		mkcorpus.sh DIR [SCALE]
+#
+#		SCALE multiplies the sizes, which are 0.5 to 3 MB at 1.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+out=${1:?usage: mkcorpus.sh DIR [SCALE]}
+scale=${2:-1}
+mkdir -p $out || exit 1
+
+# Kernel and init messages.
+awk -v n=`expr 40000 \* $scale` 'BEGIN {
+  srand(7)
+  split("usb 1-1|eth0|EXT4-fs (sda1)|systemd[1]", who, "|")
+  for (i = 0; i < n; i++) {
+    m = ""
+    for (j = int(rand() * 50) + 10; j > 0; j--)
+      m = m "x"
+    printf "[%6d.%06d] %s: %s\r\n", i / 100, rand() * 1000000, \
+      who[int(rand() * 4) + 1], m
+  }
+}' > $out/boot.log
+
+# Compiler output with colours and UTF-8 quotes.
+awk -v n=`expr 40000 \* $scale` 'BEGIN {
+  srand(7)
+  for (i = 0; i < n; i++) {
+    c = rand()
+    if (c < 0.7) {
+      f = ""
+      for (j = int(rand() * 18) + 3; j > 0; j--)
+        f = f "f"
+      printf "\033[32m  CC\033[0m      drivers/net/%s.o\r\n", f
+    } else if (c < 0.9)
+      printf "\033[1msrc.c:%d:\033[0m \033[35mwarning:\033[0m " \
+        "unused variable \033[1m\047vvvvv\047\033[0m\r\n", i
+    else
+      printf "\033[1;31merror:\033[0m \342\200\230foo\342\200\231 " \
+        "undeclared\r\n"
+  }
+}' > $out/build.log
+
+# A process list redrawn in place, a screen at a time.
+awk -v n=`expr 1000 \* $scale` 'BEGIN {
+  srand(7)
+  for (f = 0; f < n; f++) {
+    printf "\033[H\033[7m top - %05d \033[K\033[0m", f
+    for (y = 2; y < 24; y++)
+      printf "\033[%d;1H%5d root 20 0 %6d %5.1f \033[K", y, \
+        rand() * 9999 + 1, rand() * 99999, rand() * 100
+  }
+}' > $out/curses.log
+
+# Nothing but attribute changes and cursor motion.
+awk -v n=`expr 40000 \* $scale` 'BEGIN {
+  srand(7)
+  for (i = 0; i < n; i++)
+    printf "\033[%d;%dH\033[%d;%dmx\033[0m", rand() * 24 + 1, \
+      rand() * 80 + 1, 30 + rand() * 8, 40 + rand() * 8
+}' > $out/sgrcup.log
+
+# Plain text, no escape sequences.
+awk -v n=`expr 40000 \* $scale` 'BEGIN {
+  srand(7)
+  for (i = 0; i < n; i++) {
+    l = ""
+    for (j = int(rand() * 12) + 2; j > 0; j--)
+      l = l (j > 1 ? "lorem " : "ipsum")
+    printf "%s\r\n", l
+  }
+}' > $out/plain.log
+
+# hexdump -C of random data.
+awk -v n=`expr 20000 \* $scale` 'BEGIN {
+  srand(7)
+  for (i = 32; i < 127; i++)
+    ch[i] = sprintf("%c", i)
+  for (i = 0; i < n; i++) {
+    h = ""; a = ""
+    for (j = 0; j < 16; j++) {
+      b = int(rand() * 256)
+      h = h sprintf(j ? " %02x" : "%02x", b)
+      a = a (b in ch ? ch[b] : ".")
+    }
+    printf "%08x  %s  |%s|\r\n", i * 16, h, a
+  }
+}' > $out/hex.log
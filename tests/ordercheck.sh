@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# ordercheck.sh	Numbered lines come in on the port while menus open
+#		and close; the capture file must have them in order,
+#		without gaps, whichever reader minicom uses.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+# 40 blocks of 16 KB: ptyrun opens a menu after every odd one and
+# closes it after every even one.
+awk 'BEGIN { for (i = 0; i < 65536; i++) printf "L%07d\n", i }' \
+  > $dir/lines.txt
+sed 's/$/\r/' $dir/lines.txt > $dir/in.dat
+
+fail=0
+for reader in direct thread; do
+  rm -f $dir/cap.txt
+  $PTYRUN -P -i $dir/in.dat -m '\x01o' -m '\e' -k '\x01x' -k '\r' \
+    $MINICOM -o -D @PORT@ -C $dir/cap.txt -O reader=$reader
+  status=$?
+  if [ $status != 0 ]; then
+    echo "reader=$reader: minicom exited with $status"
+    fail=1
+  else
+    # minicom may quit before it has shown the last ones.
+    tr -d '\r' < $dir/cap.txt | grep '^L[0-9]\{7\}$' > $dir/got.txt
+    if [ ! -s $dir/got.txt ] ||
+       ! head -n `wc -l < $dir/got.txt` $dir/lines.txt | cmp - $dir/got.txt
+    then
+      echo "reader=$reader: the capture does not have the lines in order"
+      fail=1
+    fi
+  fi
+done
+
+[ $fail = 0 ] && rm -rf $dir
+exit $fail
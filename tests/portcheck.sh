@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# portcheck.sh	What comes in on the port must reach the raw capture
+#		file unchanged, and what is typed must reach the port,
+#		whichever event loop and reader minicom uses.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+# All bytes but ESC, ENQ and the C1 controls: those make the terminal
+# emulation answer on the port.
+dd if=/dev/urandom bs=4096 count=128 2>/dev/null |
+  LC_ALL=C tr -d '\005\033\200-\237' > $dir/in.dat
+printf 'typed at the keyboard\r' > $dir/keys.dat
+
+fail=0
+for reader in direct thread; do
+  rm -f $dir/cap.dat $dir/out.dat
+  $PTYRUN -P -i $dir/in.dat -o $dir/out.dat \
+    -k 'typed at the keyboard\r' -k '\x01x' -k '\r' \
+    $MINICOM -o -D @PORT@ -C $dir/cap.dat -O capture=raw -O reader=$reader
+  status=$?
+  if [ $status != 0 ]; then
+    echo "reader=$reader: minicom exited with $status"
+    fail=1
+  elif ! cmp $dir/in.dat $dir/cap.dat; then
+    echo "reader=$reader: the capture differs from what was sent"
+    fail=1
+  elif ! cmp $dir/keys.dat $dir/out.dat; then
+    echo "reader=$reader: the port did not get what was typed"
+    fail=1
+  fi
+done
+
+[ $fail = 0 ] && rm -rf $dir
+exit $fail
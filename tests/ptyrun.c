@@ -0,0 +1,348 @@
+/*
+ * ptyrun.c	Run a program on a pseudo terminal, for the tests.
+ *
+ *		ptyrun [options] program [args]
+ *
+ *		-s ROWSxCOLS  size of the terminal (24x80)
+ *		-P            make a second pty for the serial port; @PORT@
+ *		              in args is replaced by its name
+ *		-i FILE       write FILE to the port once the program is quiet
+ *		-o FILE       save what the program sends to the port
+ *		-T FILE       save what the program writes to the terminal
+ *		-k KEYS       type KEYS once the program is quiet again; \r,
+ *		              \n, \e, \\ and \xHH can be used. May be repeated.
+ *		-m KEYS       type KEYS while FILE is being written, one -m
+ *		              after every 16 KB, in turn, and wait until the
+ *		              program is quiet. May be repeated.
+ *		-q MS         quiet means no output for that long (300)
+ *		-t SECS       give up after that long (60)
+ *
+ *		What the program writes to the terminal is thrown away,
+ *		but for -T. Exits with the exit status of the program, 124 if it did
+ *		not finish in time.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#define MAX_KEYS	16
+#define MID_EVERY	16384	/* -m keys are typed this often */
+
+static int term = -1;		/* master of the terminal */
+static int port = -1;		/* master of the port */
+static FILE *port_out;
+static FILE *term_out;
+static long long last_output;	/* when the program last wrote, in ms */
+static long long deadline;
+
+static long long now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: ptyrun [-s ROWSxCOLS] [-P] [-i FILE] [-o FILE] "
+                  "[-T FILE] [-k KEYS]... [-m KEYS]... [-q MS] [-t SECS] program [args]\n");
+  exit(2);
+}
+
+static int open_pty(char **name)
+{
+  int fd;
+
+  if ((fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(fd) < 0 ||
+      unlockpt(fd) < 0 || (*name = ptsname(fd)) == NULL) {
+    perror("ptyrun: pty");
+    exit(2);
+  }
+  *name = strdup(*name);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+/* Turn the C escapes of -k into bytes, in place. Returns the length. */
+static size_t unescape(char *s)
+{
+  char *d = s, *p = s;
+
+  while (*p) {
+    if (*p != '\\' || !p[1]) {
+      *d++ = *p++;
+      continue;
+    }
+    p++;
+    switch (*p) {
+      case 'r': *d++ = '\r'; p++; break;
+      case 'n': *d++ = '\n'; p++; break;
+      case 'e': *d++ = 27; p++; break;
+      case 'x':
+        *d++ = strtol(p + 1, &p, 16);
+        break;
+      default: *d++ = *p++; break;
+    }
+  }
+  return d - s;
+}
+
+/*
+ * Read what the program writes to the terminal and the port, for at
+ * most ms milliseconds. Returns -1 once the terminal is closed.
+ */
+static int pump(int ms)
+{
+  struct pollfd pfd[2];
+  char buf[65536];
+  int n, np = 1;
+
+  pfd[0].fd = term;
+  pfd[0].events = POLLIN;
+  if (port >= 0) {
+    pfd[1].fd = port;
+    pfd[1].events = POLLIN;
+    np = 2;
+  }
+  if (poll(pfd, np, ms) <= 0)
+    return 0;
+  if (np == 2 && pfd[1].revents &&
+      (n = read(port, buf, sizeof(buf))) > 0 && port_out)
+    fwrite(buf, 1, n, port_out);
+  if (pfd[0].revents) {
+    if ((n = read(term, buf, sizeof(buf))) <= 0)
+      return -1;
+    if (term_out)
+      fwrite(buf, 1, n, term_out);
+    last_output = now_ms();
+  }
+  return 0;
+}
+
+/* Wait until the program has not written anything for quiet ms. */
+static int wait_quiet(int quiet)
+{
+  while (now_ms() - last_output < quiet) {
+    if (now_ms() > deadline || pump(quiet) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* Write len bytes to fd, reading the program's output meanwhile. */
+static int put(int fd, const char *p, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if (now_ms() > deadline)
+      return -1;
+    n = write(fd, p, len);
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+      return -1;
+    if (n > 0) {
+      p += n;
+      len -= n;
+    }
+    if (pump(n > 0 ? 0 : 10) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  struct winsize ws;
+  struct termios tio;
+  char *term_name, *port_name = NULL, *keys[MAX_KEYS], *mid[MAX_KEYS];
+  size_t mid_len[MAX_KEYS];
+  char *in_file = NULL, *out_file = NULL, *term_file = NULL, size[16];
+  int rows = 24, cols = 80, quiet = 300, secs = 60, nkeys = 0, nmid = 0;
+  int i, c, status, use_port = 0;
+  pid_t pid;
+
+  while ((c = getopt(argc, argv, "+s:Pi:o:T:k:m:q:t:")) != -1) {
+    switch (c) {
+      case 's':
+        if (sscanf(optarg, "%dx%d", &rows, &cols) != 2)
+          usage();
+        break;
+      case 'P': use_port = 1; break;
+      case 'i': in_file = optarg; break;
+      case 'o': out_file = optarg; break;
+      case 'T': term_file = optarg; break;
+      case 'k':
+        if (nkeys == MAX_KEYS)
+          usage();
+        keys[nkeys++] = optarg;
+        break;
+      case 'm':
+        if (nmid == MAX_KEYS)
+          usage();
+        mid[nmid] = optarg;
+        mid_len[nmid] = unescape(optarg);
+        nmid++;
+        break;
+      case 'q': quiet = atoi(optarg); break;
+      case 't': secs = atoi(optarg); break;
+      default: usage();
+    }
+  }
+  if (optind >= argc || ((in_file || out_file) && !use_port))
+    usage();
+  signal(SIGPIPE, SIG_IGN);
+
+  term = open_pty(&term_name);
+  memset(&ws, 0, sizeof(ws));
+  ws.ws_row = rows;
+  ws.ws_col = cols;
+  ioctl(term, TIOCSWINSZ, &ws);
+  /* put() reads the output while the keys wait to go in. */
+  fcntl(term, F_SETFL, O_NONBLOCK);
+  if (use_port) {
+    port = open_pty(&port_name);
+    /* Keep the other side open, or we get EIO until the program
+     * opens it. Raw, so that the data goes through unchanged. */
+    if ((c = open(port_name, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0 ||
+        tcgetattr(c, &tio) < 0) {
+      perror(port_name);
+      return 2;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(c, TCSANOW, &tio);
+    fcntl(port, F_SETFL, O_NONBLOCK);
+    for (i = optind; i < argc; i++) {
+      char *at = strstr(argv[i], "@PORT@");
+
+      if (at) {
+        char *s = malloc(strlen(argv[i]) + strlen(port_name));
+
+        sprintf(s, "%.*s%s%s", (int)(at - argv[i]), argv[i], port_name,
+                at + 6);
+        argv[i] = s;
+      }
+    }
+  }
+  if (out_file && (port_out = fopen(out_file, "w")) == NULL) {
+    perror(out_file);
+    return 2;
+  }
+  if (term_file && (term_out = fopen(term_file, "w")) == NULL) {
+    perror(term_file);
+    return 2;
+  }
+
+  if ((pid = fork()) < 0) {
+    perror("fork");
+    return 2;
+  }
+  if (pid == 0) {
+    setsid();
+    if ((c = open(term_name, O_RDWR)) < 0) {
+      perror(term_name);
+      _exit(2);
+    }
+    dup2(c, 0);
+    dup2(c, 1);
+    if (c > 1)
+      close(c);
+    snprintf(size, sizeof(size), "%d", rows);
+    setenv("LINES", size, 1);
+    snprintf(size, sizeof(size), "%d", cols);
+    setenv("COLUMNS", size, 1);
+    execvp(argv[optind], argv + optind);
+    perror(argv[optind]);
+    _exit(127);
+  }
+
+  deadline = now_ms() + secs * 1000LL;
+  last_output = now_ms();
+  if (wait_quiet(quiet) == 0 && in_file) {
+    FILE *fp = fopen(in_file, "r");
+    char buf[4096];
+    size_t n, done = 0;
+
+    if (fp == NULL) {
+      perror(in_file);
+      kill(pid, SIGTERM);
+    } else {
+      for (i = 0; (n = fread(buf, 1, sizeof(buf), fp)) > 0; ) {
+        if (put(port, buf, n) < 0)
+          break;
+        done += n;
+        if (nmid && done >= MID_EVERY) {
+          done -= MID_EVERY;
+          if (put(term, mid[i], mid_len[i]) < 0)
+            break;
+          /* Keys typed before it acted on these could be flushed,
+           * as minicom does after a command. */
+          last_output = now_ms();
+          if (wait_quiet(quiet) < 0)
+            break;
+          i = (i + 1) % nmid;
+        }
+      }
+      fclose(fp);
+    }
+  }
+  for (i = 0; i < nkeys; i++) {
+    if (wait_quiet(quiet) < 0)
+      break;
+    if (put(term, keys[i], unescape(keys[i])) < 0)
+      break;
+    /* Quiet again means after it had a chance to answer. */
+    last_output = now_ms();
+  }
+
+  /* Let it finish, reading what it still has to say. */
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    if (now_ms() > deadline) {
+      fprintf(stderr, "ptyrun: %s did not finish in %d s\n", argv[optind],
+              secs);
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      return 124;
+    }
+    if (pump(20) < 0)
+      usleep(20000);
+  }
+  if (port_out) {
+    char buf[4096];
+    ssize_t n;
+
+    while ((n = read(port, buf, sizeof(buf))) > 0)
+      fwrite(buf, 1, n, port_out);
+    fclose(port_out);
+  }
+  if (term_out)
+    fclose(term_out);
+  if (WIFSIGNALED(status)) {
+    fprintf(stderr, "ptyrun: %s killed by signal %d\n", argv[optind],
+            WTERMSIG(status));
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# replaybench.sh	Time the terminal emulation: play the captures of
+#		mkcorpus.sh with minicom --replay on a pty and print
+#		what it reports for each, with the emulation time per
+#		byte. Options are passed on to minicom, to compare
+#		-O fps=N, say.
+#
+#		SCALE=N makes the captures N times as big; the times
+#		are only given to the millisecond, so use 10 or more to
+#		compare the emulation of two builds.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+sh $srcdir/mkcorpus.sh $dir ${SCALE:-1} || exit 1
+
+for f in $dir/*.log; do
+  $PTYRUN $MINICOM --replay=$f "$@" 2> $dir/report || exit 1
+  cat $dir/report
+  # The part of the time in the terminal emulation, per byte.
+  awk '/^replay/ { bytes = $3 } /emulation/ { t = $2 }
+       END { if (bytes) printf "  %.1f ns per byte emulated\n", t * 1e9 / bytes }' \
+    $dir/report
+done
+
+rm -rf $dir
@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+# scriptcheck.sh	Run expect statements of runscript on known input and
+#		check which patterns are found, and in what order:
+#		patterns that overlap, that end at the same byte, that
+#		are longer than the old 64 byte window, that began in
+#		the input of the expect before, and regular expressions.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+RUNSCRIPT=${RUNSCRIPT:-../src/runscript}
+
+long=`awk 'BEGIN { for (i = 0; i < 10; i++) printf "0123456789" }'`
+
+# A pattern that is not found waits for the input until the timeout.
+cat > $dir/expect.run <<EOF
+verbose off
+timeout 10
+# Patterns that overlap are found in the order they end.
+expect {
+  "cde"		print cde
+  "abcdef"	print abcdef
+  "bc"		print bc
+  "bcd"		print bcd
+  "END"
+}
+# Of those that end at the same byte, the first in the list.
+expect {
+  "bc"		print bc
+  "abc"		print abc
+  "bc"		print bc-again
+  "END"
+}
+expect {
+  "xyz"		print xyz
+  "yz"		print yz
+  "END"
+}
+expect {
+  "$long"	print long
+  "END"
+}
+# A pattern that began in the input of the expect before.
+expect "foo: log"
+expect {
+  "foo: login:"	print spans
+  "END"
+}
+# A regex sees the line without its end; a plain pattern that ends
+# before the line does goes first.
+expect {
+  regex "\^[0-9]+ ok$"	print number-line
+  "ok"		print plain-ok
+  "END"
+}
+# A prompt without a newline, at the end of the input.
+expect {
+  regex "\^Password: $"
+}
+print prompt
+EOF
+
+printf 'xxabcdefEND\nabcEND\nxyzEND\n%s\nEND\n' "$long" > $dir/expect.in
+printf 'foo: login: END\n42 ok\r\nEND\nPassword: ' >> $dir/expect.in
+
+cat > $dir/expect.ok <<EOF
+bc
+bcd
+cde
+abcdef
+bc
+xyz
+long
+spans
+plain-ok
+number-line
+prompt
+EOF
+
+printf 'verbose off\n\nexpect {\n  regex "a("\n}\n' > $dir/bad.run
+
+fail=0
+$RUNSCRIPT $dir/expect.run < $dir/expect.in > /dev/null 2> $dir/expect.out
+status=$?
+if [ $status != 0 ]; then
+  echo "runscript exited with $status"
+  fail=1
+fi
+if ! tr -d '\r' < $dir/expect.out | cmp -s $dir/expect.ok -; then
+  echo "expect did not find what it should have:"
+  tr -d '\r' < $dir/expect.out | diff $dir/expect.ok -
+  fail=1
+fi
+
+if $RUNSCRIPT $dir/bad.run < /dev/null > /dev/null 2> $dir/bad.out ||
+   ! grep 'line 4 (bad regular expression)' $dir/bad.out > /dev/null; then
+  echo "a bad regular expression is not a syntax error"
+  fail=1
+fi
+
+[ $fail = 0 ] && rm -rf $dir
+exit $fail
@@ -0,0 +1,137 @@
+/*
+ * searchcheck.c	Check the history search on lines of UTF-8 text.
+ *
+ *		Plain patterns, with and without the case, in a UTF-8
+ *		locale: characters of every length, case that changes the
+ *		length, and bytes that are not UTF-8. Regular expressions
+ *		in a UTF-8 locale, and in the C locale, where the line is
+ *		turned into its characters first. utf8_locale() asks the
+ *		locale only once, so the C locale gets a process of its own.
+ *
+ *		This file is part of the minicom communications package.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <locale.h>
+#include <sys/wait.h>
+
+#include "port.h"
+#include "minicom.h"
+
+static const char *where = "";
+static int fail;
+
+/*
+ * Does pattern, as search_new() gets it, find line? want is 1 for yes,
+ * 0 for no and -1 for a pattern that must be refused.
+ */
+static void expect(const wchar_t *pattern, int case_matters, int regex,
+                   const char *line, int want)
+{
+  struct search *s;
+  int got;
+
+  s = search_new(pattern, case_matters, regex);
+  got = s == NULL ? -1 : search_line(s, line, strlen(line));
+  search_free(s);
+  if (got != want) {
+    printf("searchcheck: %s%s \"%ls\"%s on \"%s\": %d, not %d\n", where,
+           regex ? "regex" : "plain", pattern,
+           case_matters ? "" : " (any case)", line, got, want);
+    fail = 1;
+  }
+}
+
+static void utf8_checks(void)
+{
+  where = "UTF-8: ";
+
+  /* Case matters. */
+  expect(L"Caf\u00e9", 1, 0, "un Caf\303\251 noir", 1);
+  expect(L"Caf\u00e9", 1, 0, "un CAF\303\211 noir", 0);
+  expect(L"noir", 1, 0, "un Caf\303\251 noir", 1);
+  expect(L"noire", 1, 0, "un Caf\303\251 noir", 0);
+  expect(L"\u20ac 5", 1, 0, "le prix: \342\202\254 5", 1);
+  expect(L"\U0001f600", 1, 0, "a \360\237\230\200 b", 1);
+
+  /* Any case, both ways round, in every length. */
+  expect(L"caf\u00e9", 0, 0, "UN CAF\303\211 NOIR", 1);
+  expect(L"CAF\u00c9", 0, 0, "un caf\303\251 noir", 1);
+  expect(L"\u03c3\u03bf\u03c6\u03af\u03b1", 0, 0,
+         "\316\243\316\237\316\246\316\212\316\221", 1);
+  expect(L"\u01c6", 0, 0, "x\307\204y", 1);
+  expect(L"\u24d0", 0, 0, "\342\222\266", 1);
+  expect(L"\U00010428", 0, 0, "\360\220\220\200", 1);
+  /* U+0130 is two bytes, the i it folds to is one. */
+  expect(L"iSTANBUL", 0, 0, "\304\260stanbul", 1);
+  expect(L"caf\u00e9", 0, 0, "un cafe noir", 0);
+
+  /* Bytes that are not UTF-8 are '?', and the next byte starts anew. */
+  expect(L"caf\u00e9", 0, 0, "\377\376CAF\303\211", 1);
+  expect(L"caf\u00e9", 0, 0, "\303CAF\303\211", 1);
+  expect(L"caf\u00e9", 0, 0, "\342\202CAF\303\211", 1);
+  expect(L"a?b", 0, 0, "A\200B", 1);
+  expect(L"a?b", 1, 0, "a\200b", 0);
+
+  /* Regular expressions. */
+  expect(L"^caf.$", 0, 1, "CAF\303\211", 1);
+  expect(L"^caf..$", 0, 1, "CAF\303\211", 0);
+  expect(L"^CAF[\u00c9E]", 1, 1, "CAF\303\211 noir", 1);
+  expect(L"^CAF[\u00c9E]", 1, 1, "caf\303\251 noir", 0);
+  expect(L"\u03c3\u03bf\u03c6", 0, 1, "\316\243\316\237\316\246", 1);
+  expect(L"(", 0, 1, "(", -1);
+}
+
+/* In the C locale, a character of the line is one byte for regexec(). */
+static void c_checks(void)
+{
+  where = "C: ";
+
+  expect(L"^caf.$", 0, 1, "CAF\303\211", 1);
+  expect(L"^caf..$", 0, 1, "CAF\303\211", 0);
+  expect(L"^caf.$", 0, 1, "CAF\360\237\230\200", 1);
+  expect(L"^caf.x$", 0, 1, "CAF\303x", 1);
+  expect(L"^caf\\?$", 1, 1, "caf\303\251", 1);
+  expect(L"^CAF$", 1, 1, "caf", 0);
+  expect(L"^CAF$", 0, 1, "caf", 1);
+  /* The C locale has no U+00C9. */
+  expect(L"CAF\u00c9", 0, 1, "CAF\303\211", -1);
+}
+
+int main(void)
+{
+  pid_t pid;
+  int status;
+
+  fflush(stdout);
+  if ((pid = fork()) < 0) {
+    perror("searchcheck: fork");
+    return 1;
+  }
+  if (pid == 0) {
+    setlocale(LC_ALL, "C");
+    c_checks();
+    exit(fail);
+  }
+
+  if (setlocale(LC_ALL, "C.UTF-8") == NULL &&
+      setlocale(LC_ALL, "en_US.UTF-8") == NULL)
+    printf("searchcheck: no UTF-8 locale, only the C one is checked\n");
+  else
+    utf8_checks();
+
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0)
+    fail = 1;
+  return fail;
+}
@@ -0,0 +1,29 @@
+#
+# setup.sh	Sourced by the tests: where minicom is, and a clean
+#		home directory, terminal and locale for it.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+srcdir=${srcdir:-.}
+MINICOM=${MINICOM:-../src/minicom}
+PTYRUN=${PTYRUN:-./ptyrun}
+
+# A directory of our own, also as $HOME so no .minirc gets in the way.
+dir=`basename $0 .sh`.tmp
+rm -rf $dir
+mkdir $dir || exit 1
+HOME=`pwd`/$dir
+TERM=vt100
+export HOME TERM
+
+# minicom wants a UTF-8 locale.
+case `locale charmap 2>/dev/null` in
+  UTF-8) ;;
+  *) LC_ALL=C.UTF-8; export LC_ALL ;;
+esac
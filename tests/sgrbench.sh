@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# sgrbench.sh	Measure what an attribute or color change costs on the
+#		screen: play the coloured captures of mkcorpus.sh with
+#		colors on, an xterm and every change drawn (-O fps=0),
+#		and count the SGR sequences minicom sends for them.
+#		Options are passed on to minicom.
+#
+#		SCALE=N makes the captures N times as big.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+sh $srcdir/mkcorpus.sh $dir ${SCALE:-1} || exit 1
+
+# Its termcap has colors and plain SGR for all the attributes.
+TERM=xterm
+
+# The number of "ESC [ ... m" in a file and the bytes they take.
+sgrcount() {
+  LC_ALL=C awk 'BEGIN { RS = "\033" }
+    NR > 1 && match($0, /^\[[0-9;]*m/) { n++; b += RLENGTH + 1 }
+    END { printf "%d %d\n", n, b }' $1
+}
+
+for f in build sgrcup; do
+  $PTYRUN -T $dir/$f.out $MINICOM --replay=$dir/$f.log -c on -O fps=0 \
+    "$@" 2> $dir/report || exit 1
+  cat $dir/report
+  # Per change in the capture: what went to the terminal for it, and
+  # the time minicom spent drawing.
+  awk -v cap="`sgrcount $dir/$f.log`" -v out="`sgrcount $dir/$f.out`" '
+    /screen/ { t = $5 }
+    END {
+      split(cap, l); split(out, o)
+      if (l[1]) printf "  %d changes: %.2f SGR sequences, %.1f bytes " \
+        "and %.0f ns of screen time each\n", l[1], o[1] / l[1], \
+        o[2] / l[1], t * 1e9 / l[1]
+    }' $dir/report
+done
+
+rm -rf $dir
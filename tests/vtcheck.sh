@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# vtcheck.sh	Run the escape sequences in vt/*.vt through the terminal
+#		emulation (minicom --replay) and compare the screen it
+#		ends up with to vt/*.scr.
+#
+#		A .vt file is text: lines starting with # are comments,
+#		the other lines are joined without their newlines, and
+#		\e, \r, \n, \t, \b, \\ and \xHH stand for those bytes.
+#		VT_UPDATE=1 writes the .scr files instead, for a new test
+#		or an intended change.
+#
+#		This file is part of the minicom communications package.
+#
+#		This program is free software; you can redistribute it and/or
+#		modify it under the terms of the GNU General Public License
+#		as published by the Free Software Foundation; either version
+#		2 of the License, or (at your option) any later version.
+#
+
+. ${srcdir:-.}/setup.sh
+
+vt2bin() {
+  LC_ALL=C awk '
+    BEGIN {
+      for (i = 1; i < 256; i++)
+        byte[sprintf("%02x", i)] = sprintf("%c", i)
+      esc["e"] = "\033"; esc["r"] = "\r"; esc["n"] = "\n"
+      esc["t"] = "\t"; esc["b"] = "\b"; esc["\\"] = "\\"
+    }
+    /^#/ { next }
+    {
+      s = $0
+      while ((i = index(s, "\\")) > 0) {
+        printf "%s", substr(s, 1, i - 1)
+        c = substr(s, i + 1, 1)
+        if (c == "x") {
+          printf "%s", byte[tolower(substr(s, i + 2, 2))]
+          s = substr(s, i + 4)
+        } else {
+          printf "%s", esc[c]
+          s = substr(s, i + 2)
+        }
+      }
+      printf "%s", s
+    }' $1
+}
+
+fail=0
+for vt in $srcdir/vt/*.vt; do
+  name=`basename $vt .vt`
+  scr=$srcdir/vt/$name.scr
+  vt2bin $vt > $dir/$name.in
+  if ! $PTYRUN -s 24x80 $MINICOM --replay=$dir/$name.in \
+       -O dump=$dir/$name.scr 2>/dev/null; then
+    echo "$name: minicom failed"
+    fail=1
+  elif [ "$VT_UPDATE" = 1 ]; then
+    cp $dir/$name.scr $scr
+  elif ! cmp -s $scr $dir/$name.scr; then
+    echo "$name: the screen is not as expected"
+    diff $scr $dir/$name.scr | head -20
+    fail=1
+  fi
+done
+
+[ $fail = 0 ] && rm -rf $dir
+exit $fail